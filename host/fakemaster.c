@@ -0,0 +1,174 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file fakemaster.c
+ * \brief A pty stand-in for the master, to run the daemon without
+ * the hardware.
+ *
+ * It opens a pseudo terminal and links its name to the path given,
+ * then it replies to the host lines like the master does: "OK" to
+ * the known commands, "ko" to the others. The 'P' and 'A' lines
+ * take the time of the frame on the air before the reply.
+ * Every line is printed on stdout with the ms from the start, so
+ * the frames really sent by the daemon can be counted.
+ *
+ * Usage: fakemaster [-l link] [-a airtime ms] [-k ko every n]
+ *
+ * example:
+ *
+ * fakemaster -l /tmp/owmaster &\n
+ * onewayd -d /tmp/owmaster -s /tmp/ow.sock &\n
+ * owctl -s /tmp/ow.sock SET 012f 01 1
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/*! \brief monotonic ms. */
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
+
+/*! \brief reply to a line.
+ * \param ko_every reply "ko" to a frame every n, 0 never.
+ */
+static void reply(const int fd, const char *line, const long airtime,
+		const int ko_every)
+{
+	static int frames;
+	const char *r;
+
+	r = "OK\n";
+
+	switch (*line) {
+		case 'P':
+		case 'A':
+			usleep(airtime * 1000);
+
+			if (ko_every && !(++frames % ko_every))
+				r = "ko\n";
+
+			break;
+		case 'L':
+			r = "0\nOK\n";
+			break;
+		case 'B':
+		case 'C':
+		case 'D':
+		case 'E':
+		case 'K':
+		case 'Q':
+		case 'R':
+		case 'S':
+		case 'T':
+		case 'U':
+		case 'V':
+		case 'W':
+		case 'X':
+		case 'Y':
+		case '?':
+			break;
+		default:
+			r = "ko\n";
+	}
+
+	if (write(fd, r, strlen(r)) < 0)
+		perror("fakemaster");
+}
+
+int main(int argc, char **argv)
+{
+	struct termios tio;
+	char line[128], c;
+	const char *link;
+	long start, airtime;
+	int opt, fd, ko_every;
+	size_t n;
+
+	link = NULL;
+	airtime = 230;
+	ko_every = 0;
+
+	while ((opt = getopt(argc, argv, "l:a:k:")) != -1) {
+		switch (opt) {
+			case 'l': link = optarg; break;
+			case 'a': airtime = atol(optarg); break;
+			case 'k': ko_every = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: fakemaster [-l link] "
+						"[-a airtime ms] [-k ko every n]\n");
+				return(1);
+		}
+	}
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if ((fd < 0) || grantpt(fd) || unlockpt(fd)) {
+		perror("fakemaster");
+		return(1);
+	}
+
+	/* no echo, no line editing, like the serial port */
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+
+	if (link) {
+		unlink(link);
+
+		if (symlink(ptsname(fd), link)) {
+			perror("fakemaster");
+			return(1);
+		}
+	}
+
+	printf("pty %s\n", ptsname(fd));
+	fflush(stdout);
+	start = now_ms();
+	n = 0;
+
+	while (read(fd, &c, 1) == 1) {
+		if ((c != '\r') && (c != '\n')) {
+			if (n < sizeof(line) - 1)
+				line[n++] = c;
+
+			continue;
+		}
+
+		if (!n)
+			continue;
+
+		line[n] = 0;
+		n = 0;
+		printf("%ld %s\n", now_ms() - start, line);
+		fflush(stdout);
+		reply(fd, line, airtime, ko_every);
+	}
+
+	return(0);
+}
@@ -0,0 +1,793 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file onewayd.c
+ * \brief Host daemon between the clients and the master.
+ *
+ * The daemon owns the serial link to the master, see \ref pctxproto,
+ * and serves many clients on a unix socket. It keeps the desired
+ * state of every (address, pin) it has been asked for:
+ * - a state equal to the one already sent is not sent again.
+ * - a state changed again before it is sent replaces the old one,
+ *   the last writer wins, a state changed back is not sent at all.
+ * - a change is held for -h ms to collect the next ones.
+ * - with -b, when every known address has the same new state for
+ *   a pin, the frames of all of them are sent in a row, before
+ *   any other, so the master sends them back to back. They are
+ *   frames for every address, not a broadcast, which would reach
+ *   also the receivers the daemon does not know: the batch saves
+ *   the wait between them, not a frame.
+ * - with -f, the receivers have only the pins 0 and 1, see
+ *   HTV_USE_XIO: when both pins of an address are to get the same
+ *   new state, a single frame for the pin FF sends it to both. An
+ *   address with a known pin over 1 is never folded.
+ * - the frames are paced with a token bucket at -r frames/s.
+ * - in ack mode, see \ref subqcmd, a frame not acknowledged by the
+ *   remote leaves its state unknown, the same state is sent again.
+ *
+ * Client protocol, a line for every request, the reply ends with
+ * a line "OK", "ko" or "ERR":
+ * - SET AAAA PP C, desired state C [0:1] of the pin, replied at once.
+ * - GET AAAA PP, replies "AAAA PP want sent pending".
+ * - RAW line, the line is sent to the master, ex. "S:1", the reply
+ *   of the master is forwarded.
+ * - STAT, counters.
+ *
+ * Usage: onewayd -d device [-s socket] [-r frames/s] [-h hold ms] [-b] [-f] [-v]
+ *
+ * With fakemaster, see fakemaster.c, in place of the serial device
+ * the daemon runs without the hardware.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "owclient.h"
+
+/*! max number of clients */
+#define OWD_CLIENTS 32
+/*! ms to wait the master reply to a frame */
+#define OWD_REPLY_MS 2000
+/*! ms to wait the master reply to a raw line, ex. a scene */
+#define OWD_RAW_MS 30000
+/*! tries for a frame not confirmed by the master */
+#define OWD_RETRY 3
+/*! no client waits the reply */
+#define OWD_NOBODY -1
+/*! the pin number of all the pins of a receiver */
+#define OWD_PIN_ALL 0xff
+
+/*! \struct owd_target
+ * The state of a pin of a remote.
+ */
+struct owd_target {
+	uint16_t address;
+	uint8_t pin;
+	/*! the desired state */
+	uint8_t want;
+	/*! the state confirmed by the master, -1 unknown */
+	int sent;
+	/*! want must be sent */
+	int pending;
+	/*! the frame is waiting the master reply */
+	int inflight;
+	/*! order of the pending targets */
+	unsigned long order;
+	/*! ms when it became pending */
+	long since;
+	/*! tries left */
+	int retry;
+	/*! part of a set sent in a row, see owd_can_batch() */
+	int batch;
+};
+
+/*! \struct owd_raw
+ * A line from a client for the master.
+ */
+struct owd_raw {
+	char line[OW_LINE];
+	/*! the client waiting the reply */
+	int client;
+	struct owd_raw *next;
+};
+
+/*! \struct owd_client
+ * A client connection.
+ */
+struct owd_client {
+	int fd;
+	char buf[OW_LINE];
+	size_t len;
+};
+
+/*! the parameters */
+static double rate = 4.0;
+static long hold_ms = 100;
+static int batching, folding, verbose;
+
+/*! the desired state table */
+static struct owd_target *target;
+static size_t ntarget;
+static unsigned long order_seq;
+
+/*! the raw lines queue */
+static struct owd_raw *raw_head, *raw_tail;
+
+/*! the clients */
+static struct owd_client client[OWD_CLIENTS];
+
+/*! the master link */
+static int master_fd;
+static char mbuf[OW_LINE];
+static size_t mlen;
+/*! waiting a reply, with the timeout */
+static int busy;
+static long busy_until;
+/*! client of the raw line in flight, OWD_NOBODY if none */
+static int busy_client;
+/*! the line in flight is a raw line */
+static int busy_raw;
+/*! state sent by the frame in flight */
+static uint8_t inflight_value;
+
+/*! the token bucket */
+static double tokens;
+static long tokens_ms;
+
+/*! the counters */
+static unsigned long n_requests, n_frames, n_unchanged, n_coalesced,
+		n_batched, n_folded, n_failed, n_acked, n_noack;
+
+/*! \brief monotonic ms. */
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
+
+/*! \brief open the serial link, 9600 8n1 raw. */
+static int serial_open(const char *dev)
+{
+	struct termios tio;
+	int fd;
+
+	fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+	if (fd < 0)
+		return(-1);
+
+	if (!tcgetattr(fd, &tio)) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, B9600);
+		cfsetospeed(&tio, B9600);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	return(fd);
+}
+
+/*! \brief open the unix socket. */
+static int sock_open(const char *path)
+{
+	struct sockaddr_un sa;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return(-1);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+	unlink(path);
+
+	if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) ||
+			(listen(fd, 8) < 0)) {
+		close(fd);
+		return(-1);
+	}
+
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return(fd);
+}
+
+/*! \brief send a line to a client, the errors are ignored. */
+static void client_puts(const int fd, const char *s)
+{
+	if (fd >= 0)
+		if (write(fd, s, strlen(s)) < 0)
+			return;
+}
+
+/*! \brief find the target, create it if asked.
+ * \return the target or NULL.
+ */
+static struct owd_target *target_find(const uint16_t address,
+		const uint8_t pin, const int create)
+{
+	struct owd_target *t;
+	size_t i;
+
+	for (i = 0; i < ntarget; i++)
+		if ((target[i].address == address) && (target[i].pin == pin))
+			return(&target[i]);
+
+	if (!create)
+		return(NULL);
+
+	t = realloc(target, (ntarget + 1) * sizeof(struct owd_target));
+
+	if (!t)
+		return(NULL);
+
+	target = t;
+	t = &target[ntarget++];
+	memset(t, 0, sizeof(struct owd_target));
+	t->address = address;
+	t->pin = pin;
+	t->sent = -1;
+	return(t);
+}
+
+/*! \brief the state the remote will have without new frames. */
+static int target_current(struct owd_target *t)
+{
+	return(t->inflight ? inflight_value : t->sent);
+}
+
+/*! \brief a new desired state. */
+static void owd_set(const uint16_t address, const uint8_t pin,
+		const uint8_t cmd)
+{
+	struct owd_target *t;
+
+	t = target_find(address, pin, 1);
+
+	if (!t)
+		return;
+
+	if (t->pending) {
+		/* last writer wins, a pending frame is replaced */
+		n_coalesced++;
+		t->want = cmd;
+		t->batch = 0;
+
+		if (cmd == target_current(t))
+			t->pending = 0;
+	} else if (cmd == target_current(t)) {
+		n_unchanged++;
+	} else {
+		t->want = cmd;
+		t->pending = 1;
+		t->since = now_ms();
+		t->order = ++order_seq;
+		t->retry = OWD_RETRY;
+	}
+}
+
+/*! \brief queue a raw line for the master. */
+static void owd_raw(const char *line, const int fd)
+{
+	struct owd_raw *r;
+
+	r = calloc(1, sizeof(struct owd_raw));
+
+	if (!r) {
+		client_puts(fd, "ERR\n");
+		return;
+	}
+
+	strncpy(r->line, line, sizeof(r->line) - 1);
+	r->client = fd;
+
+	if (raw_tail)
+		raw_tail->next = r;
+	else
+		raw_head = r;
+
+	raw_tail = r;
+}
+
+/*! \brief send a line to the master and wait the reply. */
+static void master_send(const char *line, const long timeout)
+{
+	if (verbose)
+		fprintf(stderr, "%ld > %s\n", now_ms(), line);
+
+	if ((write(master_fd, line, strlen(line)) < 0) ||
+			(write(master_fd, "\n", 1) < 0))
+		fprintf(stderr, "onewayd: master write: %s\n", strerror(errno));
+
+	busy = 1;
+	busy_until = now_ms() + timeout;
+	tokens -= 1.0;
+}
+
+/*! \brief can every known address get the state in a row.
+ *
+ * True if every target of the pin is already in the state or is
+ * pending for it and ready, and at least two are pending.
+ */
+static int owd_can_batch(struct owd_target *t, const long now)
+{
+	size_t i, n;
+
+	for (i = 0, n = 0; i < ntarget; i++) {
+		if (target[i].pin != t->pin)
+			continue;
+
+		if (target[i].inflight)
+			return(0);
+
+		if (target[i].pending) {
+			if ((target[i].want != t->want) ||
+					(now - target[i].since < hold_ms))
+				return(0);
+
+			n++;
+		} else if (target[i].sent != t->want) {
+			return(0);
+		}
+	}
+
+	return(n > 1);
+}
+
+/*! \brief the other pin of the address, to be sent with t.
+ *
+ * Only with -f, if the address has only the pins 0 and 1 and the
+ * other one is pending for the same state.
+ * \return the target of the other pin, NULL if none.
+ */
+static struct owd_target *owd_fold(struct owd_target *t)
+{
+	struct owd_target *o;
+	size_t i;
+
+	if (!folding || (t->pin > 1))
+		return(NULL);
+
+	for (i = 0; i < ntarget; i++)
+		if ((target[i].address == t->address) && (target[i].pin > 1))
+			return(NULL);
+
+	o = target_find(t->address, !t->pin, 0);
+
+	if (!o || !o->pending || o->inflight || (o->want != t->want))
+		return(NULL);
+
+	return(o);
+}
+
+/*! \brief send the next line to the master, if any. */
+static void owd_next(void)
+{
+	struct owd_target *t, *o;
+	struct owd_raw *r;
+	char line[OW_LINE];
+	long now;
+	size_t i;
+	uint8_t pin;
+
+	now = now_ms();
+	tokens += (now - tokens_ms) * rate / 1000.0;
+	tokens_ms = now;
+
+	/* a burst of 1 s of frames */
+	if (tokens > ((rate > 1.0) ? rate : 1.0))
+		tokens = (rate > 1.0) ? rate : 1.0;
+
+	if (busy || (tokens < 1.0))
+		return;
+
+	/* the raw lines first */
+	if (raw_head) {
+		r = raw_head;
+		raw_head = r->next;
+
+		if (!raw_head)
+			raw_tail = NULL;
+
+		busy_raw = 1;
+		busy_client = r->client;
+		master_send(r->line, OWD_RAW_MS);
+		free(r);
+		return;
+	}
+
+	/* the rest of a set first, then the oldest pending target
+	 * which is ready */
+	for (i = 0, t = NULL; i < ntarget; i++)
+		if (target[i].pending && target[i].batch) {
+			t = &target[i];
+			break;
+		}
+
+	if (!t) {
+		for (i = 0; i < ntarget; i++)
+			if (target[i].pending && !target[i].inflight &&
+					(now - target[i].since >= hold_ms) &&
+					(!t || (target[i].order < t->order)))
+				t = &target[i];
+
+		if (!t)
+			return;
+
+		if (batching && owd_can_batch(t, now))
+			for (i = 0; i < ntarget; i++)
+				if ((target[i].pin == t->pin) && target[i].pending) {
+					target[i].batch = 1;
+					n_batched++;
+				}
+	}
+
+	busy_raw = 0;
+	busy_client = OWD_NOBODY;
+	inflight_value = t->want;
+	t->pending = 0;
+	t->batch = 0;
+	t->inflight = 1;
+	pin = t->pin;
+	o = owd_fold(t);
+
+	/* a frame less, both pins get the state */
+	if (o) {
+		o->pending = 0;
+		o->batch = 0;
+		o->inflight = 1;
+		pin = OWD_PIN_ALL;
+		n_folded++;
+	}
+
+	snprintf(line, sizeof(line), "P:%04x:%02x:%x", t->address, pin,
+			t->want);
+
+	n_frames++;
+	master_send(line, OWD_REPLY_MS);
+}
+
+/*! \brief the master replied, or the timeout.
+ * \param ok true if "OK".
+ */
+static void owd_done(const int ok)
+{
+	size_t i;
+
+	busy = 0;
+
+	if (busy_raw) {
+		client_puts(busy_client, ok ? "OK\n" : "ko\n");
+		busy_client = OWD_NOBODY;
+		return;
+	}
+
+	for (i = 0; i < ntarget; i++) {
+		if (!target[i].inflight)
+			continue;
+
+		target[i].inflight = 0;
+
+		if (ok) {
+			target[i].sent = inflight_value;
+			continue;
+		}
+
+		/* not confirmed, the remote state is unknown */
+		target[i].sent = -1;
+
+		if (target[i].pending)
+			continue;
+
+		if (--target[i].retry > 0) {
+			target[i].want = inflight_value;
+			target[i].pending = 1;
+			target[i].order = ++order_seq;
+		} else {
+			n_failed++;
+			fprintf(stderr, "onewayd: %04x:%02x not sent\n",
+					target[i].address, target[i].pin);
+		}
+	}
+}
+
+/*! \brief the state of a target not acknowledged is unknown. */
+static void owd_unknown(struct owd_target *t, const unsigned int cmd)
+{
+	if (t && !t->inflight && (t->sent == (int)cmd))
+		t->sent = -1;
+}
+
+/*! \brief the result of a frame in ack mode, "!AAAAPPC OK" or
+ * "!AAAAPPC ko".
+ */
+static void owd_ack(const char *line)
+{
+	unsigned int address, pin, cmd;
+	char r[3];
+
+	if (sscanf(line, "!%4x%2x%1x %2s", &address, &pin, &cmd, r) != 4)
+		return;
+
+	if (!strcmp(r, "OK")) {
+		n_acked++;
+		return;
+	}
+
+	n_noack++;
+	fprintf(stderr, "onewayd: %04x:%02x not acknowledged\n",
+			address, pin);
+
+	/* a folded frame, see owd_fold() */
+	if (pin == OWD_PIN_ALL) {
+		owd_unknown(target_find(address, 0, 0), cmd);
+		owd_unknown(target_find(address, 1, 0), cmd);
+	} else {
+		owd_unknown(target_find(address, pin, 0), cmd);
+	}
+}
+
+/*! \brief a line from the master. */
+static void master_line(char *line)
+{
+	char buf[OW_LINE + 1];
+
+	if (verbose)
+		fprintf(stderr, "%ld < %s\n", now_ms(), line);
+
+	/* not a reply, it comes at any time */
+	if (*line == '!') {
+		owd_ack(line);
+		return;
+	}
+
+	if (!busy)
+		return;
+
+	if (!strcmp(line, "OK")) {
+		owd_done(1);
+	} else if (!strcmp(line, "ko")) {
+		owd_done(0);
+	} else if (busy_raw && *line) {
+		/* the output of the command, ex. 'L' */
+		snprintf(buf, sizeof(buf), "%s\n", line);
+		client_puts(busy_client, buf);
+	}
+}
+
+/*! \brief read from the master. */
+static void master_read(void)
+{
+	char c;
+
+	while (read(master_fd, &c, 1) == 1) {
+		if ((c == '\n') || (c == '\r')) {
+			mbuf[mlen] = 0;
+			master_line(mbuf);
+			mlen = 0;
+		} else if (mlen < sizeof(mbuf) - 1) {
+			mbuf[mlen++] = c;
+		}
+	}
+}
+
+/*! \brief a request from a client. */
+static void client_line(struct owd_client *cl, char *line)
+{
+	struct owd_target *t;
+	char reply[OW_LINE * 2];
+	unsigned int address, pin, cmd;
+	char end;
+
+	n_requests++;
+
+	if (sscanf(line, "SET %x %x %x %c", &address, &pin, &cmd, &end) == 3) {
+		if ((address > 0xffff) || (pin > 0xff) || (cmd > 1)) {
+			client_puts(cl->fd, "ERR\n");
+			return;
+		}
+
+		owd_set(address, pin, cmd);
+		client_puts(cl->fd, "OK\n");
+	} else if (sscanf(line, "GET %x %x %c", &address, &pin, &end) == 2) {
+		t = target_find(address, pin, 0);
+
+		if (!t) {
+			client_puts(cl->fd, "ERR\n");
+			return;
+		}
+
+		snprintf(reply, sizeof(reply), "%04x %02x %x %d %d\nOK\n",
+				t->address, t->pin, t->want, t->sent, t->pending);
+		client_puts(cl->fd, reply);
+	} else if (!strncmp(line, "RAW ", 4) && *(line + 4)) {
+		owd_raw(line + 4, cl->fd);
+	} else if (!strcmp(line, "STAT")) {
+		snprintf(reply, sizeof(reply), "requests %lu frames %lu "
+				"unchanged %lu coalesced %lu batched %lu folded %lu "
+				"failed %lu acked %lu noack %lu targets %zu\nOK\n",
+				n_requests, n_frames, n_unchanged, n_coalesced, n_batched,
+				n_folded, n_failed, n_acked, n_noack, ntarget);
+		client_puts(cl->fd, reply);
+	} else {
+		client_puts(cl->fd, "ERR\n");
+	}
+}
+
+/*! \brief the client has gone, forget it. */
+static void client_close(struct owd_client *cl)
+{
+	struct owd_raw *r;
+
+	for (r = raw_head; r; r = r->next)
+		if (r->client == cl->fd)
+			r->client = OWD_NOBODY;
+
+	if (busy_client == cl->fd)
+		busy_client = OWD_NOBODY;
+
+	close(cl->fd);
+	cl->fd = -1;
+}
+
+/*! \brief read from a client. */
+static void client_read(struct owd_client *cl)
+{
+	char c;
+	ssize_t n;
+
+	while ((n = read(cl->fd, &c, 1)) == 1) {
+		if (c == '\n') {
+			cl->buf[cl->len] = 0;
+
+			if (cl->len && (cl->buf[cl->len - 1] == '\r'))
+				cl->buf[cl->len - 1] = 0;
+
+			client_line(cl, cl->buf);
+			cl->len = 0;
+		} else if (cl->len < sizeof(cl->buf) - 1) {
+			cl->buf[cl->len++] = c;
+		}
+	}
+
+	if (!n || ((n < 0) && (errno != EAGAIN)))
+		client_close(cl);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: onewayd -d device [-s socket] [-r frames/s]"
+			" [-h hold ms] [-b] [-f] [-v]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct pollfd pfd[OWD_CLIENTS + 2];
+	const char *dev, *sock;
+	int opt, lfd, fd, i, n;
+
+	dev = NULL;
+	sock = OW_SOCKET;
+
+	while ((opt = getopt(argc, argv, "d:s:r:h:bfv")) != -1) {
+		switch (opt) {
+			case 'd': dev = optarg; break;
+			case 's': sock = optarg; break;
+			case 'r': rate = atof(optarg); break;
+			case 'h': hold_ms = atol(optarg); break;
+			case 'b': batching = 1; break;
+			case 'f': folding = 1; break;
+			case 'v': verbose = 1; break;
+			default: usage();
+		}
+	}
+
+	if (!dev || (rate <= 0))
+		usage();
+
+	signal(SIGPIPE, SIG_IGN);
+	master_fd = serial_open(dev);
+
+	if (master_fd < 0) {
+		fprintf(stderr, "onewayd: %s: %s\n", dev, strerror(errno));
+		return(1);
+	}
+
+	lfd = sock_open(sock);
+
+	if (lfd < 0) {
+		fprintf(stderr, "onewayd: %s: %s\n", sock, strerror(errno));
+		return(1);
+	}
+
+	for (i = 0; i < OWD_CLIENTS; i++)
+		client[i].fd = -1;
+
+	busy_client = OWD_NOBODY;
+	tokens = 1.0;
+	tokens_ms = now_ms();
+	/* the replies are parsed, the echo is not needed */
+	owd_raw("E:0", OWD_NOBODY);
+
+	while (1) {
+		pfd[0].fd = master_fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = lfd;
+		pfd[1].events = POLLIN;
+
+		for (i = 0; i < OWD_CLIENTS; i++) {
+			pfd[i + 2].fd = client[i].fd;
+			pfd[i + 2].events = POLLIN;
+		}
+
+		/* short timeout, for the hold time and the pacing */
+		n = poll(pfd, OWD_CLIENTS + 2, 10);
+
+		if ((n < 0) && (errno != EINTR))
+			break;
+
+		if (pfd[0].revents & POLLIN)
+			master_read();
+
+		if (pfd[1].revents & POLLIN) {
+			fd = accept(lfd, NULL, NULL);
+
+			for (i = 0; (fd >= 0) && (i < OWD_CLIENTS); i++)
+				if (client[i].fd < 0) {
+					fcntl(fd, F_SETFL, O_NONBLOCK);
+					client[i].fd = fd;
+					client[i].len = 0;
+					fd = -1;
+				}
+
+			/* too many clients */
+			if (fd >= 0)
+				close(fd);
+		}
+
+		for (i = 0; i < OWD_CLIENTS; i++)
+			if ((client[i].fd >= 0) &&
+					(pfd[i + 2].revents & (POLLIN | POLLHUP)))
+				client_read(&client[i]);
+
+		if (busy && (now_ms() > busy_until)) {
+			if (verbose)
+				fprintf(stderr, "%ld timeout\n", now_ms());
+
+			owd_done(0);
+		}
+
+		owd_next();
+	}
+
+	return(1);
+}
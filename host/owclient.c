@@ -0,0 +1,148 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file owclient.c
+ * \brief Client library of the host daemon.
+ *
+ * Every request is a line, the reply is zero or more lines
+ * ended by a line "OK", "ko" or "ERR", see onewayd.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "owclient.h"
+
+/*! \brief connect to the daemon.
+ * \param path the socket, NULL for OW_SOCKET.
+ * \return the socket or -1.
+ */
+int ow_open(const char *path)
+{
+	struct sockaddr_un sa;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return(-1);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, path ? path : OW_SOCKET, sizeof(sa.sun_path) - 1);
+
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return(-1);
+	}
+
+	return(fd);
+}
+
+/*! \brief close the connection. */
+void ow_close(const int fd)
+{
+	close(fd);
+}
+
+/*! \brief send a request and wait for the reply.
+ *
+ * \param line the request, without '\\n'.
+ * \param reply the lines of the reply, the last one excluded,
+ * can be NULL.
+ * \param len size of reply.
+ * \return 0 if the reply is "OK", 1 if "ko" or "ERR", -1 if
+ * the connection is lost.
+ */
+int ow_request(const int fd, const char *line, char *reply, const size_t len)
+{
+	char buf[OW_LINE];
+	size_t n, used;
+	char c;
+
+	if ((write(fd, line, strlen(line)) < 0) || (write(fd, "\n", 1) < 0))
+		return(-1);
+
+	used = 0;
+
+	if (reply && len)
+		*reply = 0;
+
+	while (1) {
+		n = 0;
+
+		/* a line, one char at a time, the replies are short */
+		while (1) {
+			if (read(fd, &c, 1) != 1)
+				return(-1);
+
+			if (c == '\n')
+				break;
+
+			if (n < sizeof(buf) - 1)
+				buf[n++] = c;
+		}
+
+		buf[n] = 0;
+
+		if (!strcmp(buf, "OK"))
+			return(0);
+
+		if (!strcmp(buf, "ko") || !strcmp(buf, "ERR"))
+			return(1);
+
+		if (reply && (used + n + 2 <= len)) {
+			memcpy(reply + used, buf, n);
+			used += n;
+			reply[used++] = '\n';
+			reply[used] = 0;
+		}
+	}
+}
+
+/*! \brief set the desired state of a pin.
+ *
+ * The daemon replies at once, the frame is sent later and only
+ * if the state changes.
+ *
+ * \return the same of ow_request().
+ */
+int ow_set(const int fd, const uint16_t address, const uint8_t pin,
+		const uint8_t cmd)
+{
+	char line[OW_LINE];
+
+	snprintf(line, sizeof(line), "SET %04x %02x %x", address, pin, cmd);
+	return(ow_request(fd, line, NULL, 0));
+}
+
+/*! \brief send a line to the master as it is, ex. a scene "S:1".
+ *
+ * The reply comes when the master has replied.
+ *
+ * \return the same of ow_request().
+ */
+int ow_raw(const int fd, const char *line, char *reply, const size_t len)
+{
+	char buf[OW_LINE];
+
+	snprintf(buf, sizeof(buf), "RAW %s", line);
+	return(ow_request(fd, buf, reply, len));
+}
@@ -0,0 +1,40 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file owclient.h
+  \brief Client library of the host daemon.
+  */
+
+#ifndef OWCLIENT_H
+#define OWCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*! default socket of the daemon */
+#define OW_SOCKET "/tmp/oneway.sock"
+/*! max lenght of a line to and from the daemon */
+#define OW_LINE 128
+
+int ow_open(const char *path);
+void ow_close(const int fd);
+int ow_request(const int fd, const char *line, char *reply, const size_t len);
+int ow_set(const int fd, const uint16_t address, const uint8_t pin,
+		const uint8_t cmd);
+int ow_raw(const int fd, const char *line, char *reply, const size_t len);
+
+#endif
@@ -0,0 +1,88 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file owctl.c
+ * \brief Command line client of the host daemon.
+ *
+ * Usage: owctl [-s socket] request
+ *
+ * where request is one of the daemon requests, see onewayd.c, ex.
+ *
+ * owctl SET 012f 01 1\n
+ * owctl RAW S:1\n
+ * owctl STAT
+ *
+ * The exit status is 0 if the reply is "OK".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "owclient.h"
+
+int main(int argc, char **argv)
+{
+	char line[OW_LINE], reply[OW_LINE * 8];
+	const char *sock;
+	int opt, fd, i, err;
+
+	sock = NULL;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+			case 's': sock = optarg; break;
+			default:
+				fprintf(stderr, "usage: owctl [-s socket] request\n");
+				return(2);
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "usage: owctl [-s socket] request\n");
+		return(2);
+	}
+
+	/* the words of the request */
+	*line = 0;
+
+	for (i = optind; i < argc; i++) {
+		if (i > optind)
+			strncat(line, " ", sizeof(line) - strlen(line) - 1);
+
+		strncat(line, argv[i], sizeof(line) - strlen(line) - 1);
+	}
+
+	fd = ow_open(sock);
+
+	if (fd < 0) {
+		perror("owctl");
+		return(2);
+	}
+
+	err = ow_request(fd, line, reply, sizeof(reply));
+	ow_close(fd);
+	fputs(reply, stdout);
+
+	if (err < 0) {
+		fprintf(stderr, "owctl: connection lost\n");
+		return(2);
+	}
+
+	puts(err ? "ko" : "OK");
+	return(err);
+}
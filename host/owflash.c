@@ -0,0 +1,285 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file owflash.c
+ * \brief Firmware update of the receivers over the air.
+ *
+ * The image is a raw binary of the application, see the 'image'
+ * target of src/Makefile. It is cut in blocks of 16 bytes, the
+ * last one filled with 0xff like the erased flash, and its
+ * CRC-CCITT is the one the receivers compare with boot_image_crc().
+ *
+ * The radio is one way, no receiver can tell what it is missing,
+ * so the blocks are sent as a carousel: all of them round after
+ * round, with the image frame every OWF_EVERY blocks to bring
+ * the receivers in the boot loader and keep them there. Every
+ * round fills the holes of the ones before.
+ *
+ * When the master has a key the image frame carries the MAC of
+ * the image in place of its CRC, the same key must be given
+ * with -k, see auth.c. The master refuses the image frame
+ * without it and owflash waits forever.
+ *
+ * Usage: owflash [-s socket] [-r rounds] [-k key] image.bin
+ *
+ * example:
+ *
+ * owflash -r 5 slave.bin
+ * owflash -k 000102030405060708090a0b0c0d0e0f slave.bin
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "owclient.h"
+
+/*! bytes of a block */
+#define OWF_BLOCK 16
+/*! max image, the application flash */
+#define OWF_MAX 0x3800
+/*! the image frame every n blocks */
+#define OWF_EVERY 32
+/*! rounds of the cipher, AUTH_ROUNDS of the firmware */
+#define OWF_ROUNDS 27
+/*! wait on a full queue of the master, us */
+#define OWF_WAIT 500000
+
+/*! \brief CRC-CCITT as _crc_xmodem_update() from avr-libc. */
+static uint16_t crc_xmodem(uint16_t crc, const uint8_t data)
+{
+	int i;
+
+	crc ^= (uint16_t)data << 8;
+
+	for (i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+
+	return(crc);
+}
+
+/*! \brief rotate right. */
+static uint32_t ror(const uint32_t x, const int r)
+{
+	return((x >> r) | (x << (32 - r)));
+}
+
+/*! \brief rotate left. */
+static uint32_t rol(const uint32_t x, const int r)
+{
+	return((x << r) | (x >> (32 - r)));
+}
+
+/*! \brief the round keys of the key, as auth_init().
+ * \return 0 ok, -1 not 32 hex digits.
+ */
+static int speck_key(const char *hex, uint32_t *rk)
+{
+	uint32_t k[4], a, l;
+	unsigned int byte;
+	int i;
+
+	if (strlen(hex) != 32)
+		return(-1);
+
+	memset(k, 0, sizeof(k));
+
+	/* the words are little endian, as on the AVR */
+	for (i = 0; i < 16; i++) {
+		if (sscanf(hex + i * 2, "%2x", &byte) != 1)
+			return(-1);
+
+		k[i / 4] |= (uint32_t)byte << ((i % 4) * 8);
+	}
+
+	a = k[0];
+
+	for (i = 0; i < OWF_ROUNDS; i++) {
+		rk[i] = a;
+		l = (ror(k[i % 3 + 1], 8) + a) ^ i;
+		k[i % 3 + 1] = l;
+		a = rol(a, 3) ^ l;
+	}
+
+	return(0);
+}
+
+/*! \brief the CBC-MAC of the image, as auth_flash(). */
+static uint32_t speck_mac(const uint8_t *image, const int len,
+		const uint32_t *rk)
+{
+	uint8_t b[8];
+	uint32_t x, y;
+	int i, n, r;
+
+	memset(b, 0, sizeof(b));
+	n = 0;
+	y = 0;
+
+	/* the last block padded with 0x80, see auth_end() */
+	for (i = 0; i <= len; i++) {
+		b[n++] ^= (i < len) ? image[i] : 0x80;
+
+		if ((n < 8) && (i < len))
+			continue;
+
+		x = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+		y = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+
+		for (r = 0; r < OWF_ROUNDS; r++) {
+			x = (ror(x, 8) + y) ^ rk[r];
+			y = rol(y, 3) ^ x;
+		}
+
+		for (r = 0; r < 4; r++) {
+			b[r] = y >> (r * 8);
+			b[r + 4] = x >> (r * 8);
+		}
+
+		n = 0;
+	}
+
+	return(y);
+}
+
+/*! \brief send a line until the master takes it.
+ * \return 0 ok, -1 the daemon is gone.
+ */
+static int send(const int fd, const char *line)
+{
+	char reply[OW_LINE];
+	int err;
+
+	while ((err = ow_raw(fd, line, reply, sizeof(reply))) > 0)
+		usleep(OWF_WAIT);
+
+	return(err);
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t image[OWF_MAX];
+	char line[OW_LINE], image_line[OW_LINE], *s;
+	const char *sock, *key;
+	uint32_t rk[OWF_ROUNDS];
+	FILE *f;
+	size_t len;
+	uint16_t crc;
+	int opt, fd, rounds, blocks, r, b, i;
+
+	sock = NULL;
+	key = NULL;
+	rounds = 3;
+
+	while ((opt = getopt(argc, argv, "s:r:k:")) != -1) {
+		switch (opt) {
+			case 's': sock = optarg; break;
+			case 'r': rounds = atoi(optarg); break;
+			case 'k': key = optarg; break;
+			default:
+				fprintf(stderr, "usage: owflash [-s socket] "
+						"[-r rounds] [-k key] image.bin\n");
+				return(2);
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: owflash [-s socket] [-r rounds] "
+				"[-k key] image.bin\n");
+		return(2);
+	}
+
+	if (key && speck_key(key, rk)) {
+		fprintf(stderr, "owflash: the key is 32 hex digits\n");
+		return(2);
+	}
+
+	f = fopen(argv[optind], "rb");
+
+	if (!f) {
+		perror("owflash");
+		return(2);
+	}
+
+	len = fread(image, 1, sizeof(image), f);
+
+	/* an image of exactly OWF_MAX bytes is at the end of file only
+	 * after one more read */
+	if ((fgetc(f) != EOF) || !len) {
+		fprintf(stderr, "owflash: image empty or too big\n");
+		fclose(f);
+		return(2);
+	}
+
+	fclose(f);
+	blocks = (len + OWF_BLOCK - 1) / OWF_BLOCK;
+
+	for (i = len; i < blocks * OWF_BLOCK; i++)
+		image[i] = 0xff;
+
+	crc = 0xffff;
+
+	for (i = 0; i < blocks * OWF_BLOCK; i++)
+		crc = crc_xmodem(crc, image[i]);
+
+	printf("%d blocks, crc %04x\n", blocks, crc);
+
+	if (key) {
+		snprintf(image_line, sizeof(image_line), "B:%03x:%08lx", blocks,
+				(unsigned long)speck_mac(image, blocks * OWF_BLOCK, rk));
+		printf("mac %s\n", image_line + 6);
+	} else {
+		snprintf(image_line, sizeof(image_line), "B:%03x:%04x",
+				blocks, crc);
+	}
+
+	fd = ow_open(sock);
+
+	if (fd < 0) {
+		perror("owflash");
+		return(2);
+	}
+
+	for (r = 0; r < rounds; r++) {
+		for (b = 0; b < blocks; b++) {
+			if (!(b % OWF_EVERY) && send(fd, image_line))
+				break;
+
+			s = line + snprintf(line, sizeof(line), "B:%03x:", b);
+
+			for (i = 0; i < OWF_BLOCK; i++)
+				s += sprintf(s, "%02x", image[b * OWF_BLOCK + i]);
+
+			if (send(fd, line))
+				break;
+		}
+
+		if (b < blocks) {
+			fprintf(stderr, "owflash: connection lost\n");
+			ow_close(fd);
+			return(2);
+		}
+
+		printf("round %d done\n", r + 1);
+		fflush(stdout);
+	}
+
+	ow_close(fd);
+	return(0);
+}
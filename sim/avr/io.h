@@ -0,0 +1,68 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sim/avr/io.h
+  \brief Host stand-in of the AVR registers used by the firmware.
+  */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+
+/*! every register is a plain variable, see stub.c */
+extern volatile uint8_t PORTA, DDRA, PINA, PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0L, UDR0;
+extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1L, UDR1;
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, ICR1;
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2, TIFR2;
+extern volatile uint8_t SPCR, SPSR, SPDR;
+extern volatile uint8_t PCICR, PCMSK3, EICRA, EIMSK;
+
+enum { PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7 };
+enum { PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7 };
+enum { PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7 };
+enum { PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7 };
+enum { MPCM0, U2X0, UPE0, DOR0, FE0, UDRE0, TXC0, RXC0 };
+enum { TXB80, RXB80, UCSZ02, TXEN0, RXEN0, UDRIE0, TXCIE0, RXCIE0 };
+enum { UCPOL0, UCSZ00, UCSZ01, USBS0 };
+enum { MPCM1, U2X1, UPE1, DOR1, FE1, UDRE1, TXC1, RXC1 };
+enum { TXB81, RXB81, UCSZ12, TXEN1, RXEN1, UDRIE1, TXCIE1, RXCIE1 };
+enum { UCPOL1, UCSZ10, UCSZ11, USBS1 };
+enum { EERE, EEPE, EEMPE, EERIE };
+enum { WGM00, WGM01 };
+enum { CS00, CS01, CS02, WGM02 };
+enum { TOIE0, OCIE0A, OCIE0B };
+enum { CS10, CS11, CS12, WGM12, WGM13, ICES1 = 6, ICNC1 };
+enum { TOIE1, OCIE1A, OCIE1B, ICIE1 = 5 };
+enum { TOV1, OCF1A, OCF1B, ICF1 = 5 };
+
+/*! last byte of the EEPROM */
+#define E2END 0x1ff
+
+#endif
@@ -0,0 +1,31 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file host.h
+  \brief avr-libc functions missing on the host, forced in every
+  compiled file.
+  */
+
+#ifndef SIM_HOST_H
+#define SIM_HOST_H
+
+#include <stddef.h>
+
+char *utoa(unsigned int value, char *s, int radix);
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif
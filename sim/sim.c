@@ -0,0 +1,552 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sim.c
+ * \brief Radio channel simulator.
+ *
+ * One master for every ward sends random P commands to the
+ * receivers of its ward, all the receivers hear all the masters.
+ * The frames are built by the real transmit.c and decoded by the
+ * real receive.c and htv.c, one struct htv_t and rx_t for every
+ * virtual receiver.
+ *
+ * The channel model works on the serial chars at 1200 bps 8n2:
+ * - every bit can be flipped, with a two states (Gilbert-Elliott)
+ *   model for burst noise, a flipped start bit loses the char.
+ * - every char can be dropped.
+ * - the chars overlapping another transmission are garbage.
+ *
+ * The masters can transmit as soon as they are ready, in their
+ * tx slot or after listening to the channel, see tx_wait_channel().
+ *
+ * The report gives the goodput (commands applied by the right
+ * receiver per second per ward), the latency from the host to the
+ * receiver, how many damaged frames passed the crc8 check and
+ * how many frames were dropped on their address, see
+ * htv_addr_match().
+ *
+ * usage: oneway_sim [-w wards] [-n receivers per ward]
+ * [-c commands per second per ward] [-t seconds] [-p preamble 'x']
+ * [-r repeat] [-b ber] [-B burst ber] [-g good to burst probability]
+ * [-G burst to good probability] [-d drop probability]
+ * [-a none|slot|lbt channel access] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "receive.h"
+#include "transmit.h"
+#include "stub.h"
+
+/*! radio speed */
+#define SIM_BAUD 1200.0
+/*! one char, 8n2 */
+#define SIM_CHAR_US (11.0 * 1000000.0 / SIM_BAUD)
+/*! start_tx(), carrier up and squelch open */
+#define SIM_KEYUP_US (400.0 + 10000.0)
+/*! tx_str() and stop_tx(), carrier down */
+#define SIM_TAIL_US (1000.0 + 400.0)
+/*! max chars of a transmission */
+#define SIM_TX_LEN 64
+
+/*! a command from the host */
+struct sim_cmd_t {
+	double t;
+	uint16_t address;
+	uint8_t pin;
+	uint8_t cmd;
+	/*! time when the receiver applied it, < 0 never */
+	double done;
+	/*! the string on the air */
+	char str[SIM_TX_LEN];
+	size_t len;
+};
+
+/*! a transmission on the air */
+struct sim_tx_t {
+	double start;
+	double end;
+	/*! index in the commands */
+	size_t cmd;
+	char str[SIM_TX_LEN];
+	size_t len;
+};
+
+/*! a char on the air */
+struct sim_char_t {
+	double t;
+	/*! index in the transmissions */
+	size_t tx;
+	uint8_t c;
+};
+
+/*! a master */
+struct sim_ward_t {
+	/*! next and last + 1 command of the ward */
+	size_t next;
+	size_t last;
+	/*! transmissions of the next command already done */
+	unsigned sent;
+	/*! when the master ends the current transmission */
+	double free;
+};
+
+/*! a virtual receiver */
+struct sim_rx_t {
+	struct htv_t *htv;
+	struct rx_t rx;
+	uint8_t porta;
+	/*! the channel is in the burst state */
+	uint8_t burst;
+};
+
+/*! channel access: transmit when ready */
+#define SIM_ACCESS_NONE 0
+/*! channel access: tx slots, one for every master */
+#define SIM_ACCESS_SLOT 1
+/*! channel access: listen before talk */
+#define SIM_ACCESS_LBT 2
+
+/*! the parameters */
+static unsigned wards = 4, receivers = 100, preamble = 6, repeat = 1;
+static unsigned access_mode = SIM_ACCESS_NONE;
+static double rate = 0.2, seconds = 3600.0;
+static double ber = 0.0, burst_ber = 0.1, to_burst = 0.0, to_good = 0.1;
+static double drop = 0.0;
+static unsigned long long seed = 1;
+
+/*! \brief xorshift64* random number in [0, 1). */
+static double rnd(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return((seed * 2685821657736338717ULL >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return((x > y) - (x < y));
+}
+
+static int cmp_tx(const void *a, const void *b)
+{
+	return(cmp_double(&((const struct sim_tx_t *)a)->start,
+				&((const struct sim_tx_t *)b)->start));
+}
+
+static int cmp_char(const void *a, const void *b)
+{
+	return(cmp_double(&((const struct sim_char_t *)a)->t,
+				&((const struct sim_char_t *)b)->t));
+}
+
+/*! \brief pass a char through the noisy channel of a receiver.
+ * \return 0 if the char is lost.
+ */
+static int channel(struct sim_rx_t *r, uint8_t *c)
+{
+	uint16_t frame;
+	int bit;
+
+	if (drop && (rnd() < drop))
+		return(0);
+
+	if (!ber && !to_burst && !r->burst)
+		return(1);
+
+	/* start bit, 8 data bit lsb first, 2 stop bit */
+	frame = 0x600 | (*c << 1);
+
+	for (bit = 0; bit < 11; bit++) {
+		if (rnd() < (r->burst ? burst_ber : ber))
+			frame ^= 1 << bit;
+
+		if (r->burst)
+			r->burst = !(rnd() < to_good);
+		else
+			r->burst = (rnd() < to_burst);
+	}
+
+	if (frame & 1)
+		return(0);
+
+	*c = frame >> 1;
+	return(1);
+}
+
+/*! \brief when the master of the ward w starts to transmit.
+ *
+ * Same rules of tx_wait_channel(), the slots are aligned and
+ * the listen before talk hears a transmission after 2 chars.
+ *
+ * \param t when the master is ready.
+ * \param tx the transmissions already on the air.
+ */
+static double sim_access(double t, unsigned w, struct sim_tx_t *tx,
+		size_t ntx)
+{
+	double slot, lbt, heard;
+	unsigned long n, slots;
+	size_t j;
+	int busy;
+
+	switch (access_mode) {
+		case SIM_ACCESS_SLOT:
+			slots = (wards < 16) ? wards : 15;
+			slot = TX_SLOT_MS / 1000.0;
+			n = t / slot;
+
+			while ((n % slots != (w & 0x0f) % slots) ||
+					(t > n * slot + TX_SLOT_GUARD / 1000.0)) {
+				n++;
+
+				if (t < n * slot)
+					t = n * slot;
+			}
+
+			return(t);
+		case SIM_ACCESS_LBT:
+			lbt = RADIO_LBT_MS / 1000.0;
+			heard = SIM_KEYUP_US / 1e6 + 2 * SIM_CHAR_US / 1e6;
+
+			do {
+				busy = 0;
+
+				for (j = ntx; j-- && (ntx - j < 4 * wards); )
+					if ((tx[j].start + heard < t + lbt) && (tx[j].end > t))
+						busy = 1;
+
+				if (busy)
+					t += lbt + ((w & 0x0f) + 1) * lbt + rnd() * 0.064;
+			} while (busy);
+
+			return(t + lbt);
+		default:
+			return(t);
+	}
+}
+
+/*! \brief the address of the receiver n of the ward w. */
+static uint16_t sim_address(unsigned w, unsigned n)
+{
+	return(((w + 1) << 8) | (n + 1));
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: oneway_sim [-w wards] [-n receivers per ward]"
+			" [-c commands/s per ward] [-t seconds]\n"
+			"\t[-p preamble] [-r repeat] [-b ber] [-B burst ber]"
+			" [-g to burst] [-G to good]\n"
+			"\t[-d drop] [-a none|slot|lbt] [-s seed]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct debug_t *debug;
+	struct htv_t *mhtv;
+	struct sim_cmd_t *cmd;
+	struct sim_tx_t *tx;
+	struct sim_char_t *air;
+	struct sim_rx_t *rx;
+	struct sim_ward_t *ward;
+	double t, free, dur, airtime, maxdur, *lat;
+	size_t ncmd, ntx, nair, nlat, i, j, k, collided;
+	unsigned w, n;
+	unsigned long frames_ok, frames_err, false_ok, wrong_action, foreign;
+	char line[MAX_CMD_LENGHT], *s;
+	uint8_t c, hit;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:n:c:t:p:r:b:B:g:G:d:a:s:")) != -1) {
+		switch (opt) {
+			case 'w': wards = atoi(optarg); break;
+			case 'n': receivers = atoi(optarg); break;
+			case 'c': rate = atof(optarg); break;
+			case 't': seconds = atof(optarg); break;
+			case 'p': preamble = atoi(optarg); break;
+			case 'r': repeat = atoi(optarg); break;
+			case 'b': ber = atof(optarg); break;
+			case 'B': burst_ber = atof(optarg); break;
+			case 'g': to_burst = atof(optarg); break;
+			case 'G': to_good = atof(optarg); break;
+			case 'd': drop = atof(optarg); break;
+			case 'a':
+				if (!strcmp(optarg, "slot"))
+					access_mode = SIM_ACCESS_SLOT;
+				else if (!strcmp(optarg, "lbt"))
+					access_mode = SIM_ACCESS_LBT;
+				else if (strcmp(optarg, "none"))
+					usage();
+
+				break;
+			case 's': seed = strtoull(optarg, NULL, 0) | 1; break;
+			default: usage();
+		}
+	}
+
+	if (!wards || (wards > 254) || !receivers || (receivers > 254) ||
+			(preamble < 2) || !repeat || (rate <= 0))
+		usage();
+
+	debug = debug_init();
+	debug->active = 0;
+	mhtv = htv_init(NULL);
+	/* the access is simulated here, not the duty-cycle nor the
+	 * state frames */
+	store_set_cfg(STORE_CFG_DUTY, DUTY_OFF);
+	store_set_cfg(STORE_CFG_SYNC, SYNC_OFF);
+
+	/* the host commands, poisson arrivals for every ward */
+	ncmd = 0;
+	cmd = NULL;
+	ward = malloc(wards * sizeof(struct sim_ward_t));
+
+	for (w = 0; w < wards; w++) {
+		ward[w].next = ncmd;
+		ward[w].sent = 0;
+		ward[w].free = 0;
+		t = -log(1.0 - rnd()) / rate;
+
+		while (t < seconds) {
+			cmd = realloc(cmd, (ncmd + 1) * sizeof(struct sim_cmd_t));
+			cmd[ncmd].t = t;
+			cmd[ncmd].address = sim_address(w, rnd() * receivers);
+			cmd[ncmd].pin = rnd() * 2;
+			cmd[ncmd].cmd = rnd() * 2;
+			cmd[ncmd].done = -1;
+			ncmd++;
+			t += -log(1.0 - rnd()) / rate;
+		}
+
+		ward[w].last = ncmd;
+	}
+
+	/* the frames, built by p_cmd() with the id of the ward master */
+	for (i = 0; i < ncmd; i++) {
+		store_set_cfg(STORE_CFG_ID, ((cmd[i].address >> 8) - 1) & 0x0f);
+		sprintf(line, "P:%04x:%02x:%x", cmd[i].address, cmd[i].pin, cmd[i].cmd);
+		sim_air_len = 0;
+
+		if (p_cmd(line, mhtv, debug) != CMD_OK) {
+			fprintf(stderr, "p_cmd refused %s\n", line);
+			return(1);
+		}
+
+		/* on the air */
+		while (tx_run(mhtv, debug));
+
+		/* replace the RADIO_HEAD with the preamble under test */
+		for (s = sim_air; (s < sim_air + sim_air_len) && (*s == 'x'); s++);
+
+		cmd[i].len = 0;
+
+		for (k = 0; (k < preamble) && (cmd[i].len < SIM_TX_LEN); k++)
+			cmd[i].str[cmd[i].len++] = 'x';
+
+		for (k = 0; (s + k < sim_air + sim_air_len) &&
+				(cmd[i].len < SIM_TX_LEN); k++)
+			cmd[i].str[cmd[i].len++] = s[k];
+	}
+
+	/* the masters, one command after the other, the next
+	 * transmission is always the one of the master ready first.
+	 */
+	tx = malloc(ncmd * repeat * sizeof(struct sim_tx_t));
+	ntx = 0;
+	airtime = 0;
+	maxdur = 0;
+	free = 0;
+
+	while (1) {
+		for (w = 0, n = wards; w < wards; w++)
+			if (ward[w].next < ward[w].last) {
+				t = cmd[ward[w].next].t;
+				t = (t > ward[w].free) ? t : ward[w].free;
+
+				if ((n == wards) || (t < free)) {
+					free = t;
+					n = w;
+				}
+			}
+
+		if (n == wards)
+			break;
+
+		i = ward[n].next;
+		dur = SIM_KEYUP_US / 1e6 + cmd[i].len * SIM_CHAR_US / 1e6 +
+			SIM_TAIL_US / 1e6;
+		t = sim_access(free, n, tx, ntx);
+		tx[ntx].start = t;
+		tx[ntx].end = t + dur;
+		tx[ntx].cmd = i;
+		memcpy(tx[ntx].str, cmd[i].str, cmd[i].len);
+		tx[ntx].len = cmd[i].len;
+		airtime += dur;
+		maxdur = (dur > maxdur) ? dur : maxdur;
+		ntx++;
+		ward[n].free = t + dur;
+
+		if (++ward[n].sent == repeat) {
+			ward[n].sent = 0;
+			ward[n].next++;
+		}
+	}
+
+	qsort(tx, ntx, sizeof(struct sim_tx_t), cmp_tx);
+
+	/* the chars on the air, garbage where transmissions overlap */
+	air = malloc(ntx * SIM_TX_LEN * sizeof(struct sim_char_t));
+	nair = 0;
+	collided = 0;
+
+	for (i = 0; i < ntx; i++) {
+		hit = 0;
+
+		for (k = 0; k < tx[i].len; k++) {
+			air[nair].t = tx[i].start + SIM_KEYUP_US / 1e6 +
+				(k + 1) * SIM_CHAR_US / 1e6;
+			air[nair].tx = i;
+			air[nair].c = tx[i].str[k];
+
+			for (j = i + 1; (j < ntx) && (tx[j].start < air[nair].t); j++)
+				if (tx[j].end > air[nair].t - SIM_CHAR_US / 1e6)
+					air[nair].c = rnd() * 256, hit = 1;
+
+			for (j = i; j-- && (tx[j].start > tx[i].start - maxdur); )
+				if ((tx[j].end > air[nair].t - SIM_CHAR_US / 1e6) &&
+						(tx[j].start < air[nair].t))
+					air[nair].c = rnd() * 256, hit = 1;
+
+			nair++;
+		}
+
+		collided += hit;
+	}
+
+	qsort(air, nair, sizeof(struct sim_char_t), cmp_char);
+
+	/* every receiver listens to everything */
+	rx = malloc(wards * receivers * sizeof(struct sim_rx_t));
+	frames_ok = frames_err = false_ok = wrong_action = foreign = 0;
+
+	for (w = 0; w < wards; w++)
+		for (n = 0; n < receivers; n++) {
+			struct sim_rx_t *r = &rx[w * receivers + n];
+
+			r->htv = htv_init(NULL);
+			r->htv->ee_addr = sim_address(w, n);
+			rx_init(&r->rx);
+			tick_init();
+			r->porta = 0;
+			r->burst = 0;
+
+			for (k = 0; k < nair; k++) {
+				struct sim_cmd_t *truth = &cmd[tx[air[k].tx].cmd];
+
+				c = air[k].c;
+
+				if (!channel(r, &c) || !c)
+					continue;
+
+				/* the receiver clock, see rx_seen() */
+				while (tick_ms32() < air[k].t * 1000.0)
+					TIMER0_COMPA_vect();
+
+				PORTA = r->porta;
+
+				switch (rx_char(&r->rx, r->htv, c, debug)) {
+					case RX_DONE:
+						frames_ok++;
+
+						if ((r->htv->type != HTV_TYPE_PIN) ||
+								(r->htv->address != truth->address) ||
+								(r->htv->pin != truth->pin) ||
+								(r->htv->cmd != truth->cmd)) {
+							false_ok++;
+
+							if ((r->htv->address == r->htv->ee_addr) ||
+									(r->htv->address == 0xffff))
+								wrong_action++;
+						} else if ((truth->address == r->htv->ee_addr) &&
+								(truth->done < 0)) {
+							truth->done = air[k].t;
+						}
+
+						break;
+					case RX_ERROR:
+						frames_err++;
+						break;
+					case RX_FOREIGN:
+						foreign++;
+						break;
+					default:
+						break;
+				}
+
+				r->porta = PORTA;
+			}
+		}
+
+	/* latency of the applied commands */
+	lat = malloc(ncmd * sizeof(double));
+	nlat = 0;
+
+	for (i = 0; i < ncmd; i++)
+		if (cmd[i].done >= 0)
+			lat[nlat++] = (cmd[i].done - cmd[i].t) * 1000.0;
+
+	qsort(lat, nlat, sizeof(double), cmp_double);
+
+	printf("wards %u, receivers %u, %.3f cmd/s per ward, %.0f s\n",
+			wards, wards * receivers, rate, seconds);
+	printf("preamble %u, repeat %u, ber %g, burst ber %g (%g/%g), drop %g\n",
+			preamble, repeat, ber, burst_ber, to_burst, to_good, drop);
+	printf("channel access %s\n", (access_mode == SIM_ACCESS_SLOT) ? "slot" :
+			(access_mode == SIM_ACCESS_LBT) ? "lbt" : "none");
+	printf("frame %zu chars, %.1f ms on air\n", ntx ? tx[0].len : 0,
+			ntx ? (tx[0].end - tx[0].start) * 1000.0 : 0);
+	printf("channel busy %.1f%%, collided transmissions %zu of %zu\n",
+			airtime / seconds * 100.0, collided, ntx);
+	printf("commands %zu, applied %zu (%.2f%%)\n", ncmd, nlat,
+			ncmd ? nlat * 100.0 / ncmd : 0);
+	printf("goodput %.4f cmd/s per ward\n", nlat / seconds / wards);
+
+	if (nlat)
+		printf("latency ms: min %.0f p50 %.0f p90 %.0f p99 %.0f max %.0f\n",
+				lat[0], lat[nlat / 2], lat[nlat * 9 / 10],
+				lat[nlat * 99 / 100], lat[nlat - 1]);
+
+	printf("frames decoded %lu, crc errors %lu, false accept %lu",
+			frames_ok + frames_err, frames_err, false_ok);
+
+	if (frames_err + false_ok)
+		printf(" (%.3g of the damaged frames)", (double)false_ok /
+				(frames_err + false_ok));
+
+	printf("\nframes for other addresses skipped %lu\n", foreign);
+	printf("wrong actions executed %lu\n", wrong_action);
+	return(0);
+}
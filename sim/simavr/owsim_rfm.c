@@ -0,0 +1,221 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file owsim_rfm.c
+ * \brief A master and a slave with the packet radio under simavr.
+ *
+ * Both firmwares must be built with HTV_USE_RFM, see htv.h, the
+ * two AVRs run in step, each one with an RFM69 model on its SPI,
+ * see rfm69.c, and the two modules hear each other.
+ *
+ * The lines on stdin are sent to the serial port 0 of the master,
+ * like the host does, ex. "P:..." frames; what the master and the
+ * slave print on their serial port 0 is copied on stdout, every
+ * line after the ms of simulated time and M: or S:. At the end
+ * the packets sent and received by each module are printed.
+ *
+ * usage: owsim_rfm [-t seconds] [-m mcu] master.elf slave.elf
+ *
+ * example:
+ *
+ * echo "P:..." | ./owsim_rfm -t 5 master.elf slave.elf
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <avr_uart.h>
+
+#include "rfm69.h"
+
+/*! the clock of the boards */
+#define OWSIM_FREQ 1000000UL
+/*! a char to the master every, us, it is 9600 bps */
+#define OWSIM_CHAR_US 1100
+/*! chars from stdin */
+#define OWSIM_INPUT 4096
+
+/*! \brief a board, the AVR, its radio and its serial port 0. */
+struct board_t {
+	/*! the AVR */
+	avr_t *avr;
+	/*! the radio */
+	struct rfm69_t rfm;
+	/*! M or S */
+	char name;
+	/*! the line printed on the serial port */
+	char line[256];
+	/*! chars in line */
+	size_t len;
+};
+
+/*! the chars to the master */
+static char input[OWSIM_INPUT];
+/*! chars in input */
+static size_t input_len;
+/*! next char to send */
+static size_t input_idx;
+
+/*! \brief ms of simulated time. */
+static unsigned long owsim_ms(avr_t *avr)
+{
+	return(avr->cycle / (OWSIM_FREQ / 1000UL));
+}
+
+/*! \brief a char on the serial port 0 of a board. */
+static void owsim_uart(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	struct board_t *b;
+
+	b = param;
+
+	if ((value == '\n') || (value == '\r') ||
+			(b->len == sizeof(b->line) - 1)) {
+		if (b->len) {
+			b->line[b->len] = 0;
+			printf("%lu %c: %s\n", owsim_ms(b->avr), b->name, b->line);
+			b->len = 0;
+		}
+
+		return;
+	}
+
+	b->line[b->len++] = value;
+}
+
+/*! \brief the next char of stdin to the master. */
+static avr_cycle_count_t owsim_feed(avr_t *avr, avr_cycle_count_t when,
+		void *param)
+{
+	if (input_idx >= input_len)
+		return(0);
+
+	avr_raise_irq(param, input[input_idx++]);
+	return(when + avr_usec_to_cycles(avr, OWSIM_CHAR_US));
+}
+
+/*! \brief load the firmware and wire the radio and the UART. */
+static int owsim_board(struct board_t *b, const char *mcu,
+		const char *elf, const char name)
+{
+	elf_firmware_t fw;
+	uint32_t flags;
+
+	memset(&fw, 0, sizeof(fw));
+
+	if (elf_read_firmware(elf, &fw)) {
+		fprintf(stderr, "owsim_rfm: cannot read %s\n", elf);
+		return(-1);
+	}
+
+	b->avr = avr_make_mcu_by_name(mcu);
+
+	if (!b->avr) {
+		fprintf(stderr, "owsim_rfm: unknown mcu %s\n", mcu);
+		return(-1);
+	}
+
+	avr_init(b->avr);
+	avr_load_firmware(b->avr, &fw);
+	b->avr->frequency = OWSIM_FREQ;
+	b->name = name;
+	b->len = 0;
+
+	/* the chars come here, not on the simavr stdout */
+	avr_ioctl(b->avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(b->avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(b->avr,
+				AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+			owsim_uart, b);
+
+	rfm69_init(&b->rfm, b->avr);
+	return(0);
+}
+
+int main(int argc, char **argv)
+{
+	struct board_t master, slave;
+	const char *mcu;
+	unsigned long seconds;
+	avr_cycle_count_t end;
+	avr_irq_t *rx;
+	int opt, state;
+	size_t n;
+
+	mcu = "atmega164p";
+	seconds = 5;
+
+	while ((opt = getopt(argc, argv, "t:m:")) != -1) {
+		switch (opt) {
+			case 't': seconds = atol(optarg); break;
+			case 'm': mcu = optarg; break;
+			default:
+				fprintf(stderr, "usage: owsim_rfm [-t seconds] [-m mcu] "
+						"master.elf slave.elf\n");
+				return(1);
+		}
+	}
+
+	if (argc - optind != 2) {
+		fprintf(stderr, "usage: owsim_rfm [-t seconds] [-m mcu] "
+				"master.elf slave.elf\n");
+		return(1);
+	}
+
+	if (owsim_board(&master, mcu, argv[optind], 'M') ||
+			owsim_board(&slave, mcu, argv[optind + 1], 'S'))
+		return(1);
+
+	rfm69_link(&master.rfm, &slave.rfm);
+
+	/* stdin, the host lines */
+	while ((n = fread(input + input_len, 1,
+					sizeof(input) - input_len, stdin)) > 0)
+		input_len += n;
+
+	/* after the boot of the master */
+	rx = avr_io_getirq(master.avr, AVR_IOCTL_UART_GETIRQ('0'),
+			UART_IRQ_INPUT);
+	avr_cycle_timer_register_usec(master.avr, 500000UL, owsim_feed, rx);
+
+	/* the AVR behind runs, they stay in step */
+	end = seconds * OWSIM_FREQ;
+	state = cpu_Running;
+
+	while ((master.avr->cycle < end) || (slave.avr->cycle < end)) {
+		if (master.avr->cycle <= slave.avr->cycle)
+			state = avr_run(master.avr);
+		else
+			state = avr_run(slave.avr);
+
+		if ((state == cpu_Done) || (state == cpu_Crashed))
+			break;
+	}
+
+	printf("master: packets sent %u received %u\n",
+			master.rfm.tx, master.rfm.rx);
+	printf("slave: packets sent %u received %u\n",
+			slave.rfm.tx, slave.rfm.rx);
+	return(state == cpu_Crashed);
+}
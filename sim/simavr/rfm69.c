@@ -0,0 +1,292 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file rfm69.c
+ * \brief RFM69 (SX1231) model for simavr, to run the firmware
+ * built with HTV_USE_RFM, see src/rfm.c.
+ *
+ * Only what the firmware uses is modeled:
+ * - the SPI access, the first byte is the address, bit 7 set for
+ *   a write, then the data, the address goes up at every byte but
+ *   on the FIFO.
+ * - the modes, ready at once, the version 0x24.
+ * - packet mode with variable length, the first byte of the FIFO
+ *   is the length.
+ * - in tx the packet is on the air for its time at the bit rate
+ *   programmed, then PacketSent goes up on DIO0 and the packet is
+ *   put in the FIFO of the peer if it is in rx, with PayloadReady
+ *   up on its DIO0 until the FIFO is read. A peer not in rx, or
+ *   with a packet not read yet, loses it.
+ * - the RSSI is high while the peer is on the air.
+ *
+ * The wiring is the one of rfm.h: NSS on PB4, DIO0 on PD2.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sim_avr.h>
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <avr_spi.h>
+#include <avr_ioport.h>
+
+#include "rfm69.h"
+
+/*! register: the FIFO */
+#define REG_FIFO 0x00
+/*! register: operating mode */
+#define REG_OPMODE 0x01
+/*! register: bit rate msb */
+#define REG_BITRATE 0x03
+/*! register: chip version */
+#define REG_VERSION 0x10
+/*! register: RSSI, -dBm * 2 */
+#define REG_RSSI 0x24
+/*! register: function of the DIO pins */
+#define REG_DIOMAP1 0x25
+/*! register: IRQ flags 1 */
+#define REG_IRQ1 0x27
+/*! register: IRQ flags 2 */
+#define REG_IRQ2 0x28
+/*! register: preamble length, lsb */
+#define REG_PREAMBLE 0x2d
+/*! crystal */
+#define FXOSC 32000000UL
+/*! opmode: transmit */
+#define MODE_TX 3
+/*! opmode: receive */
+#define MODE_RX 4
+/*! IRQ flags 1: ModeReady */
+#define IRQ1_MODEREADY 0x80
+/*! IRQ flags 2: PacketSent */
+#define IRQ2_SENT 0x08
+/*! IRQ flags 2: PayloadReady */
+#define IRQ2_READY 0x04
+/*! RSSI of a quiet channel and of a carrier */
+#define RSSI_QUIET 0xe4
+#define RSSI_CARRIER 0x50
+
+/*! \brief the mode, MODE_*. */
+static uint8_t rfm69_mode(struct rfm69_t *rfm)
+{
+	return((rfm->reg[REG_OPMODE] >> 2) & 7);
+}
+
+/*! \brief DIO0 follows the flag mapped on it.
+ *
+ * Mapping 00 is PacketSent in tx, 01 PayloadReady in rx.
+ */
+static void rfm69_dio0(struct rfm69_t *rfm)
+{
+	uint8_t map, level;
+
+	map = rfm->reg[REG_DIOMAP1] >> 6;
+	level = 0;
+
+	if ((rfm69_mode(rfm) == MODE_TX) && (map == 0))
+		level = !!(rfm->reg[REG_IRQ2] & IRQ2_SENT);
+	else if ((rfm69_mode(rfm) == MODE_RX) && (map == 1))
+		level = !!(rfm->reg[REG_IRQ2] & IRQ2_READY);
+
+	avr_raise_irq(rfm->dio0, level);
+}
+
+/*! \brief the end of the packet on the air. */
+static avr_cycle_count_t rfm69_sent(avr_t *avr, avr_cycle_count_t when,
+		void *param)
+{
+	struct rfm69_t *rfm, *peer;
+
+	rfm = param;
+	peer = rfm->peer;
+	rfm->on_air = 0;
+	rfm->tx++;
+	rfm->reg[REG_IRQ2] |= IRQ2_SENT;
+	rfm69_dio0(rfm);
+
+	if (peer && (rfm69_mode(peer) == MODE_RX) &&
+			!(peer->reg[REG_IRQ2] & IRQ2_READY)) {
+		memcpy(peer->fifo, rfm->pkt, rfm->pkt_len);
+		peer->fifo_len = rfm->pkt_len;
+		peer->fifo_rd = 0;
+		peer->rx++;
+		peer->reg[REG_IRQ2] |= IRQ2_READY;
+		rfm69_dio0(peer);
+	}
+
+	return(0);
+}
+
+/*! \brief send the packet in the FIFO. */
+static void rfm69_tx(struct rfm69_t *rfm)
+{
+	uint32_t bitrate, bytes, us;
+
+	if (!rfm->fifo_len || rfm->on_air)
+		return;
+
+	/* the length byte and the payload */
+	rfm->pkt_len = rfm->fifo[0] + 1;
+
+	if (rfm->pkt_len > rfm->fifo_len)
+		rfm->pkt_len = rfm->fifo_len;
+
+	memcpy(rfm->pkt, rfm->fifo, rfm->pkt_len);
+	rfm->fifo_len = 0;
+	rfm->fifo_rd = 0;
+	rfm->on_air = 1;
+
+	bitrate = FXOSC / ((rfm->reg[REG_BITRATE] << 8) |
+			rfm->reg[REG_BITRATE + 1]);
+	/* preamble, 2 bytes of sync, the packet and the CRC */
+	bytes = rfm->reg[REG_PREAMBLE] + 2 + rfm->pkt_len + 2;
+	us = bytes * 8 * 1000000UL / bitrate;
+	avr_cycle_timer_register_usec(rfm->avr, us, rfm69_sent, rfm);
+}
+
+/*! \brief a register written by the AVR. */
+static void rfm69_write(struct rfm69_t *rfm, const uint8_t addr,
+		const uint8_t value)
+{
+	switch (addr) {
+		case REG_FIFO:
+			if (rfm->fifo_len < RFM69_FIFO)
+				rfm->fifo[rfm->fifo_len++] = value;
+
+			return;
+		case REG_OPMODE:
+			rfm->reg[REG_OPMODE] = value;
+			rfm->reg[REG_IRQ1] |= IRQ1_MODEREADY;
+			rfm->reg[REG_IRQ2] &= ~IRQ2_SENT;
+
+			if (rfm69_mode(rfm) == MODE_TX)
+				rfm69_tx(rfm);
+
+			rfm69_dio0(rfm);
+			return;
+		case REG_VERSION:
+		case REG_RSSI:
+		case REG_IRQ1:
+		case REG_IRQ2:
+			return;
+		default:
+			rfm->reg[addr] = value;
+			rfm69_dio0(rfm);
+	}
+}
+
+/*! \brief a register read by the AVR. */
+static uint8_t rfm69_read(struct rfm69_t *rfm, const uint8_t addr)
+{
+	uint8_t value;
+
+	switch (addr) {
+		case REG_FIFO:
+			if (rfm->fifo_rd >= rfm->fifo_len)
+				return(0);
+
+			value = rfm->fifo[rfm->fifo_rd++];
+
+			/* the FIFO is empty */
+			if (rfm->fifo_rd == rfm->fifo_len) {
+				rfm->fifo_len = 0;
+				rfm->fifo_rd = 0;
+				rfm->reg[REG_IRQ2] &= ~IRQ2_READY;
+				rfm69_dio0(rfm);
+			}
+
+			return(value);
+		case REG_RSSI:
+			return((rfm->peer && rfm->peer->on_air) ?
+					RSSI_CARRIER : RSSI_QUIET);
+		default:
+			return(rfm->reg[addr]);
+	}
+}
+
+/*! \brief a byte from the AVR on the SPI, the reply goes back
+ * at once.
+ */
+static void rfm69_spi(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	struct rfm69_t *rfm;
+	uint8_t reply;
+
+	rfm = param;
+	reply = 0;
+
+	if (!rfm->selected)
+		return;
+
+	if (rfm->first) {
+		rfm->first = 0;
+		rfm->write = value & 0x80;
+		rfm->addr = value & 0x7f;
+	} else {
+		if (rfm->write)
+			rfm69_write(rfm, rfm->addr, value);
+		else
+			reply = rfm69_read(rfm, rfm->addr);
+
+		if (rfm->addr != REG_FIFO)
+			rfm->addr = (rfm->addr + 1) & 0x7f;
+	}
+
+	avr_raise_irq(rfm->miso, reply);
+}
+
+/*! \brief NSS, every access starts with the address. */
+static void rfm69_nss(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	struct rfm69_t *rfm;
+
+	rfm = param;
+	rfm->selected = !value;
+
+	if (rfm->selected)
+		rfm->first = 1;
+}
+
+/*! \brief wire a module to the SPI, PB4 and PD2 of the AVR. */
+void rfm69_init(struct rfm69_t *rfm, avr_t *avr)
+{
+	memset(rfm, 0, sizeof(*rfm));
+	rfm->avr = avr;
+	rfm->reg[REG_OPMODE] = 0x04;
+	rfm->reg[REG_BITRATE] = 0x1a;
+	rfm->reg[REG_BITRATE + 1] = 0x0b;
+	rfm->reg[REG_VERSION] = 0x24;
+	rfm->reg[REG_IRQ1] = IRQ1_MODEREADY;
+	rfm->reg[REG_PREAMBLE] = 3;
+
+	rfm->miso = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0),
+			SPI_IRQ_INPUT);
+	rfm->dio0 = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0),
+				SPI_IRQ_OUTPUT), rfm69_spi, rfm);
+	avr_irq_register_notify(avr_io_getirq(avr,
+				AVR_IOCTL_IOPORT_GETIRQ('B'), 4), rfm69_nss, rfm);
+	avr_raise_irq(rfm->dio0, 0);
+}
+
+/*! \brief put two modules on the same channel. */
+void rfm69_link(struct rfm69_t *a, struct rfm69_t *b)
+{
+	a->peer = b;
+	b->peer = a;
+}
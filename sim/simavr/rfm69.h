@@ -0,0 +1,72 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file rfm69.h
+  \brief RFM69 model for simavr, see rfm69.c.
+  */
+
+#ifndef RFM69_H
+#define RFM69_H
+
+#include <stdint.h>
+
+#include <sim_avr.h>
+#include <sim_irq.h>
+
+/*! FIFO of the module */
+#define RFM69_FIFO 66
+
+/*! \brief a module wired to the SPI of an AVR. */
+struct rfm69_t {
+	/*! the AVR of the module */
+	avr_t *avr;
+	/*! the module on the air with this one */
+	struct rfm69_t *peer;
+	/*! the registers */
+	uint8_t reg[0x80];
+	/*! the FIFO */
+	uint8_t fifo[RFM69_FIFO];
+	/*! bytes in the FIFO */
+	uint8_t fifo_len;
+	/*! next byte to read from the FIFO */
+	uint8_t fifo_rd;
+	/*! NSS is low */
+	uint8_t selected;
+	/*! the next byte on the SPI is the address */
+	uint8_t first;
+	/*! register of the next byte */
+	uint8_t addr;
+	/*! the SPI access is a write */
+	uint8_t write;
+	/*! a packet is on the air */
+	uint8_t on_air;
+	/*! the packet on the air */
+	uint8_t pkt[RFM69_FIFO];
+	/*! bytes of the packet on the air */
+	uint8_t pkt_len;
+	/*! packets sent and received */
+	uint32_t tx, rx;
+	/*! the SPI byte to the AVR */
+	avr_irq_t *miso;
+	/*! the DIO0 pin of the AVR */
+	avr_irq_t *dio0;
+};
+
+void rfm69_init(struct rfm69_t *rfm, avr_t *avr);
+void rfm69_link(struct rfm69_t *a, struct rfm69_t *b);
+
+#endif
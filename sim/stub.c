@@ -0,0 +1,205 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file stub.c
+ * \brief Host replacement of the hardware: registers, EEPROM and
+ * serial ports.
+ *
+ * The radio port (1) output is collected in sim_air, its input
+ * from icp.c in sim_rx, the console
+ * (0) is discarded. The EEMEM variables are plain variables, the
+ * fixed addresses of the EEPROM, AUTH_KEY_EE and BOOT_FLAG, are
+ * in sim_ee.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include "uart.h"
+#include "store.h"
+#include "stub.h"
+
+volatile uint8_t PORTA, DDRA, PINA, PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0L, UDR0;
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1L, UDR1;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2, TIFR2;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t PCICR, PCMSK3, EICRA, EIMSK;
+
+/*! what has been sent on the air */
+char sim_air[SIM_AIR_SIZE];
+/*! number of chars in sim_air */
+size_t sim_air_len;
+/*! what the receiver has put in the radio port */
+char sim_rx[SIM_AIR_SIZE];
+/*! number of chars in sim_rx */
+size_t sim_rx_len;
+
+/* The EEMEM variables are plain variables on the host. */
+
+/*! the EEPROM at a fixed address, AUTH_KEY_EE and BOOT_FLAG */
+static uint8_t sim_ee[E2END + 1];
+
+/*! \brief the host memory of an EEPROM address, the EEMEM
+ * variables are plain variables, see avr/eeprom.h.
+ */
+static uint8_t *sim_ee_ptr(const void *p)
+{
+	return(((uintptr_t)p <= E2END) ? sim_ee + (uintptr_t)p : (uint8_t *)p);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return(*sim_ee_ptr(p));
+}
+
+uint16_t eeprom_read_word(const uint16_t *p)
+{
+	return(*p);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, sim_ee_ptr(src), n);
+}
+
+void eeprom_write_byte(uint8_t *p, uint8_t value)
+{
+	*sim_ee_ptr(p) = value;
+}
+
+void eeprom_write_word(uint16_t *p, uint16_t value)
+{
+	*p = value;
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	memcpy(sim_ee_ptr(dst), src, n);
+}
+
+/*! \brief end the writes of the store, the EEPROM is always
+ * ready at once, see store.c.
+ */
+void sim_eeprom(void)
+{
+	while (store_busy()) {
+		EECR &= ~_BV(EEPE);
+		EE_READY_vect();
+	}
+
+	EECR &= ~_BV(EEPE);
+}
+
+char *utoa(unsigned int value, char *s, int radix)
+{
+	char tmp[sizeof(unsigned int) * 8 + 1];
+	int i = 0, j = 0;
+
+	do {
+		tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[value % radix];
+		value /= radix;
+	} while (value);
+
+	while (i)
+		s[j++] = tmp[--i];
+
+	s[j] = 0;
+	return(s);
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size) {
+		size = (len < size) ? len : size - 1;
+		memcpy(dst, src, size);
+		dst[size] = 0;
+	}
+
+	return(len);
+}
+
+void uart_tx(const uint8_t port, const uint8_t enable)
+{
+}
+
+void uart_rx(const uint8_t port, const uint8_t enable)
+{
+}
+
+void uart_init(const uint8_t port)
+{
+}
+
+void uart_shutdown(const uint8_t port)
+{
+}
+
+char uart_getchar(const uint8_t port, const uint8_t locked)
+{
+	return(0);
+}
+
+void uart_putchar(const uint8_t port, const char c)
+{
+	if (port && (sim_air_len < SIM_AIR_SIZE))
+		sim_air[sim_air_len++] = c;
+}
+
+void uart_printstr(const uint8_t port, const char *s)
+{
+	while (*s)
+		uart_putchar(port, *s++);
+}
+
+void uart_flush(const uint8_t port)
+{
+}
+
+void uart_rx_put(const uint8_t port, const char c)
+{
+	if (port && (sim_rx_len < SIM_AIR_SIZE))
+		sim_rx[sim_rx_len++] = c;
+}
+
+uint8_t uart_tx_free(const uint8_t port)
+{
+	return(port ? 0 : UART_TXBUF_MASK);
+}
+
+uint8_t uart_rx_head(const uint8_t port)
+{
+	return(0);
+}
+
+char uart_rx_peek(const uint8_t port, const uint8_t i)
+{
+	return(0);
+}
+
+uint8_t uart_rx_full(const uint8_t port)
+{
+	return(0);
+}
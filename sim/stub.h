@@ -0,0 +1,45 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file stub.h
+  \brief Host replacement of the hardware.
+  */
+
+#ifndef SIM_STUB_H
+#define SIM_STUB_H
+
+#include <stddef.h>
+
+/*! max chars collected from the radio port */
+#define SIM_AIR_SIZE 256
+
+extern char sim_air[SIM_AIR_SIZE];
+extern size_t sim_air_len;
+/* the chars put in the rx buffer of the radio port, see icp.c */
+extern char sim_rx[SIM_AIR_SIZE];
+extern size_t sim_rx_len;
+
+/*! the Timer0 IRQ of tick.c, called to move the clock */
+void TIMER0_COMPA_vect(void);
+/*! the EEPROM IRQ of store.c, see sim_eeprom() */
+void EE_READY_vect(void);
+void sim_eeprom(void);
+/*! the Timer1 IRQ of icp.c, called by the line of test.c */
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+
+#endif
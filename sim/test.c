@@ -0,0 +1,358 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file test.c
+ * \brief Host tests of the firmware, on the stubs of the simulator.
+ *
+ * The frames are built by the same code of the master and given
+ * to rx_char() a char at a time, as the radio would, the writes
+ * of the store end at once, see sim_eeprom(). Every check
+ * prints PASS or FAIL with its name, the exit status is the
+ * number of failed checks.
+ *
+ * usage: oneway_test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "receive.h"
+#include "transmit.h"
+#include "icp.h"
+#include "stub.h"
+
+/*! a key for the authenticated frames */
+#define TEST_KEY "000102030405060708090a0b0c0d0e0f"
+/*! no key */
+#define TEST_NOKEY "ffffffffffffffffffffffffffffffff"
+
+/*! number of failed checks */
+static unsigned failed;
+
+/*! \brief print the result of a check. */
+static void check(const char *name, const int ok)
+{
+	printf("%s %s\n", ok ? "PASS" : "FAIL", name);
+
+	if (!ok)
+		failed++;
+}
+
+/*! \brief give the chars to the receiver.
+ * \return the result of rx_char() for the last char.
+ */
+static uint8_t test_rx(struct rx_t *rx, struct htv_t *htv, const char *s,
+		struct debug_t *debug)
+{
+	uint8_t r;
+
+	r = RX_BUSY;
+
+	while (*s)
+		r = rx_char(rx, htv, *s++, debug);
+
+	sim_eeprom();
+	return(r);
+}
+
+/*! \brief an authenticated frame, VIHCCCCCC<frame>:MMMMMMMM.
+ * \param s the frame with room for the envelope and the MAC.
+ */
+static void test_auth_frame(char *s, const uint32_t ctr, const char *frame)
+{
+	strcpy(s, "xxxV30");
+	htv_hex(s + 6, ctr >> 8, 4);
+	htv_hex(s + 10, ctr, 2);
+	strcpy(s + 12, frame);
+	auth_append(s + 3);
+}
+
+/*! \brief the MAC of every frame type, the state frame has a
+ * lenght known only after its 2nd char.
+ */
+static void test_auth(struct debug_t *debug)
+{
+	struct htv_t *htv;
+	struct rx_t rx;
+	char s[MAX_CMD_LENGHT + 8];
+
+	htv = htv_init(NULL);
+	htv->ee_addr = 0x012f;
+	rx_init(&rx);
+	auth_set_key(TEST_KEY);
+	PORTA = 0;
+
+	test_auth_frame(s, 0x100, "012f011");
+	check("auth P frame", (test_rx(&rx, htv, s, debug) == RX_DONE) &&
+			(PORTA & _BV(IO_PIN1)));
+
+	test_auth_frame(s, 0x101, "T012f003000a");
+	check("auth T frame", test_rx(&rx, htv, s, debug) == RX_DONE);
+
+	/* the pin 0 has the timer of the T frame, the pin 1 goes off */
+	test_auth_frame(s, 0x102, "S2012f80130c");
+	check("auth S frame", (test_rx(&rx, htv, s, debug) == RX_DONE) &&
+			!(PORTA & _BV(IO_PIN1)));
+
+	/* a char changed, the MAC is wrong */
+	test_auth_frame(s, 0x103, "S1012f4");
+	s[strlen(s) - 10] = '5';
+	check("auth S frame damaged", test_rx(&rx, htv, s, debug) == RX_ERROR);
+
+	/* the pin 1 on again, then the state frame again, a replay */
+	test_auth_frame(s, 0x104, "012f011");
+	test_rx(&rx, htv, s, debug);
+	test_auth_frame(s, 0x102, "S2012f80130c");
+	test_rx(&rx, htv, s, debug);
+	check("auth S frame replay", PORTA & _BV(IO_PIN1));
+
+	/* the image frame with the MAC of the image, too many blocks
+	 * for this flash so it is not looked at */
+	test_auth_frame(s, 0x105, "Yfff12345678");
+	check("auth Y frame", test_rx(&rx, htv, s, debug) == RX_DONE);
+
+	/* an old frame sent again with the sequence number of the
+	 * next one, which must not be taken for a copy */
+	test_auth_frame(s, 0x006, "012f010");
+	check("auth replay refused", test_rx(&rx, htv, s, debug) == RX_ERROR);
+	test_auth_frame(s, 0x106, "012f010");
+	check("auth after a replay", (test_rx(&rx, htv, s, debug) == RX_DONE) &&
+			!(PORTA & _BV(IO_PIN1)));
+
+	auth_set_key(TEST_NOKEY);
+	sim_eeprom();
+	htv_free(htv);
+}
+
+/*! \brief true if the frame went on the air. */
+static int test_air(const char *frame)
+{
+	size_t i, len;
+
+	len = strlen(frame);
+
+	for (i = 0; i + len <= sim_air_len; i++)
+		if (!memcmp(sim_air + i, frame, len))
+			return(1);
+
+	return(0);
+}
+
+/*! \brief send the pin commands, one after the other before the
+ * queue is sent, like a quick finger.
+ */
+static void test_p(struct htv_t *htv, const char *line1, const char *line2,
+		struct debug_t *debug)
+{
+	char line[16];
+
+	sim_air_len = 0;
+	strcpy(line, line1);
+	p_cmd(line, htv, debug);
+	strcpy(line, line2);
+	p_cmd(line, htv, debug);
+
+	/* the airtime comes back with the time */
+	while (tx_run(htv, debug))
+		TIMER0_COMPA_vect();
+}
+
+/*! \brief a toggle is folded with the queued command of the same
+ * pin, an absolute command replaces it.
+ */
+static void test_supersede(struct debug_t *debug)
+{
+	struct htv_t *htv;
+
+	htv = htv_init(NULL);
+
+	test_p(htv, "P:012f:01:2", "P:012f:01:2", debug);
+	check("toggle toggle", !test_air("012f01"));
+
+	test_p(htv, "P:012f:01:1", "P:012f:01:2", debug);
+	check("on toggle", test_air("012f010") && !test_air("012f011") &&
+			!test_air("012f012"));
+
+	test_p(htv, "P:012f:01:0", "P:012f:01:2", debug);
+	check("off toggle", test_air("012f011") && !test_air("012f010"));
+
+	test_p(htv, "P:012f:01:2", "P:012f:01:1", debug);
+	check("toggle on", test_air("012f011") && !test_air("012f012"));
+
+	test_p(htv, "P:012f:01:2", "P:012f:00:2", debug);
+	check("toggle other pin", test_air("012f012") && test_air("012f002"));
+
+	htv_free(htv);
+}
+
+/*! \brief a host command, the queue is sent.
+ * \return the reply.
+ */
+static uint8_t test_cmd(uint8_t (*cmd)(char *, struct htv_t *,
+			struct debug_t *), struct htv_t *htv, const char *s,
+		struct debug_t *debug)
+{
+	char line[32];
+	uint8_t r;
+
+	strcpy(line, s);
+	r = cmd(line, htv, debug);
+
+	while (tx_run(htv, debug))
+		TIMER0_COMPA_vect();
+
+	return(r);
+}
+
+/*! \brief the pin and the command of P, S:N and T are checked. */
+static void test_check_pin(struct debug_t *debug)
+{
+	struct htv_t *htv;
+
+	htv = htv_init(NULL);
+	/* the EEMEM variables are 0 on the host, all in the scene 0 */
+	test_cmd(x_cmd, htv, "X:0", debug);
+
+	check("P pin all", test_cmd(p_cmd, htv, "P:012f:ff:1", debug) == CMD_OK);
+	check("P last xio pin", test_cmd(p_cmd, htv, "P:012f:3f:1", debug) == CMD_OK);
+	check("P pin too big", test_cmd(p_cmd, htv, "P:012f:40:1", debug) == CMD_KO);
+	check("P pulse", test_cmd(p_cmd, htv, "P:012f:01:3", debug) == CMD_KO);
+	check("P cmd f", test_cmd(p_cmd, htv, "P:012f:01:f", debug) == CMD_KO);
+	check("S:N ok", test_cmd(sa_cmd, htv, "S:1:012f:01:1", debug) == CMD_OK);
+	check("S:N timed", test_cmd(sa_cmd, htv, "S:1:012f:01:4", debug) == CMD_KO);
+	check("S:N pin too big", test_cmd(sa_cmd, htv, "S:1:012f:80:1", debug) == CMD_KO);
+	check("S:N scene f", test_cmd(sa_cmd, htv, "S:f:012f:01:1", debug) == CMD_KO);
+	test_cmd(x_cmd, htv, "X:1", debug);
+	check("T ok", test_cmd(t_cmd, htv, "T:0:00010000:0000:012f:01:1",
+				debug) == CMD_OK);
+	check("T pulse", test_cmd(t_cmd, htv, "T:0:00010000:0000:012f:01:3",
+				debug) == CMD_KO);
+	check("T pin too big", test_cmd(t_cmd, htv,
+				"T:0:00010000:0000:012f:41:1", debug) == CMD_KO);
+	check("T scene", test_cmd(t_cmd, htv, "T:1:00010000:003c:S:2",
+				debug) == CMD_OK);
+
+	htv_free(htv);
+}
+
+/*! \brief a pseudo random number, the same every run. */
+static unsigned test_rand(void)
+{
+	static unsigned long x = 1;
+
+	x = x * 1103515245UL + 12345;
+	return((x >> 16) & 0x7fff);
+}
+
+/*! \brief the radio line to the ICP1 pin.
+ *
+ * The bits at 1200 bps become edges, moved by up to jitter
+ * cycles, with the flush of Timer1 when no edge comes, as on the
+ * board. The line starts and ends idle, high.
+ * \param noise random bits before the frame.
+ */
+static void test_icp_line(const char *s, const unsigned noise,
+		const unsigned jitter)
+{
+	uint8_t bits[512], level;
+	uint16_t edge;
+	unsigned i, j, n;
+
+	n = 0;
+
+	for (i = 0; i < noise; i++)
+		bits[n++] = test_rand() & 1;
+
+	for (i = 0; i < ICP_IDLE_BITS; i++)
+		bits[n++] = 1;
+
+	/* 8n2 */
+	for (; *s; s++) {
+		bits[n++] = 0;
+
+		for (j = 0; j < 8; j++)
+			bits[n++] = (*s >> j) & 1;
+
+		bits[n++] = 1;
+		bits[n++] = 1;
+	}
+
+	for (i = 0; i < ICP_IDLE_BITS * 2; i++)
+		bits[n++] = 1;
+
+	sim_rx_len = 0;
+	TCNT1 = 0;
+	icp_init();
+	level = 1;
+
+	for (i = 0; i < n; i++) {
+		if (bits[i] == level)
+			continue;
+
+		level = bits[i];
+		edge = i * ICP_BIT + (jitter ? test_rand() % (jitter * 2) : 0) -
+			jitter;
+
+		/* no edge up to the compare match */
+		while ((uint16_t)(edge - OCR1A) < 0x8000)
+			TIMER1_COMPA_vect();
+
+		ICR1 = edge;
+		TIMER1_CAPT_vect();
+	}
+
+	for (i = 0; i < ICP_IDLE_BITS * 2 / ICP_FLUSH; i++)
+		TIMER1_COMPA_vect();
+
+	icp_stop();
+}
+
+/*! \brief the ICP decoder gives the chars after the sync word. */
+static void test_icp(void)
+{
+	const char *frame = "xx012f011:a5";
+
+	test_icp_line(frame, 0, 0);
+	check("icp frame", (sim_rx_len == strlen(frame)) &&
+			!memcmp(sim_rx, frame, sim_rx_len));
+
+	/* 1/5 of a bit either way */
+	test_icp_line(frame, 60, ICP_BIT / 5);
+	check("icp frame noise jitter", (sim_rx_len == strlen(frame)) &&
+			!memcmp(sim_rx, frame, sim_rx_len));
+
+	/* the noise alone is never decoded */
+	test_icp_line("", 400, 0);
+	check("icp noise only", !sim_rx_len);
+}
+
+int main(void)
+{
+	struct debug_t *debug;
+
+	debug = debug_init();
+	debug->active = 0;
+	tick_init();
+
+	test_auth(debug);
+	test_supersede(debug);
+	test_check_pin(debug);
+	test_icp();
+
+	printf("%u failed\n", failed);
+	return(failed);
+}
@@ -0,0 +1,53 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sim/util/crc16.h
+  \brief Host version of the avr-libc crc functions.
+  */
+
+#ifndef SIM_UTIL_CRC16_H
+#define SIM_UTIL_CRC16_H
+
+#include <stdint.h>
+
+/*! Dallas/Maxim 8 bit crc, same as avr-libc */
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+	uint8_t i;
+
+	crc ^= data;
+
+	for (i = 0; i < 8; i++)
+		crc = (crc & 1) ? ((crc >> 1) ^ 0x8c) : (crc >> 1);
+
+	return(crc);
+}
+
+/*! CRC-CCITT (XModem), same as avr-libc */
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+	uint8_t i;
+
+	crc ^= ((uint16_t)data << 8);
+
+	for (i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+
+	return(crc);
+}
+
+#endif
@@ -0,0 +1,294 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file auth.c
+ * \brief Authenticated frames, MAC and rolling counters.
+ *
+ * The MAC is a CBC-MAC with Speck 64/128, truncated to 32 bit,
+ * over the chars of the frame, see \ref subrxvcmd. The frames
+ * on the air are a prefix-free set, the lenght of a frame is
+ * given by its first chars, so the plain CBC-MAC is enough, the
+ * last block is padded with 0x80 and zeros.
+ *
+ * The receiver computes the MAC while the chars arrive, a block
+ * every 8 chars, at the end of the frame only the last block is
+ * left: about 2000 cpu cycles, less than the 9 ms of a char at
+ * 1200 bps with the cpu at 1 MHz.
+ *
+ * The counter of the master goes in every frame and the receiver
+ * accepts only counters higher than the last one from the same
+ * master id. Both are saved in EEPROM only every 256 frames:
+ * - the master starts from the next block of 256 after a reset,
+ *   it never sends the same counter twice.
+ * - the receiver starts from the first counter of the last block
+ *   it has seen, after a reset up to 255 old frames of a master
+ *   can be replayed.
+ *
+ * The counter is 24 bit, 16M frames for every master.
+ * The key is in EEPROM, erased (all 0xff) means no key and no
+ * authentication. It is at AUTH_KEY_EE, where the boot loader
+ * finds it to check the image of an update, see boot.c.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "auth.h"
+#include "htv.h"
+#include "store.h"
+
+/*! master, the block of 256 of the last counter used */
+uint16_t EEMEM EE_auth_tx;
+/*! receiver, the block of 256 of the last counter of every master */
+uint16_t EEMEM EE_auth_rx[AUTH_MASTERS];
+
+/*! the round keys, 0 rounds if there is no key. */
+static uint32_t auth_rk[AUTH_ROUNDS];
+/*! the key is set */
+static uint8_t auth_valid;
+/*! master, the next counter */
+static uint32_t auth_ctr;
+/*! receiver, the lowest counter accepted from every master */
+static uint32_t auth_low[AUTH_MASTERS];
+
+/*! \brief rotate right. */
+static uint32_t auth_ror(const uint32_t x, const uint8_t r)
+{
+	return((x >> r) | (x << (32 - r)));
+}
+
+/*! \brief rotate left. */
+static uint32_t auth_rol(const uint32_t x, const uint8_t r)
+{
+	return((x << r) | (x >> (32 - r)));
+}
+
+/*! \brief a word of the EEPROM, an erased one is 0. */
+static uint32_t auth_block(const uint16_t *p)
+{
+	uint16_t block;
+
+	block = eeprom_read_word(p);
+	return((block == 0xffff) ? 0 : (uint32_t)block << 8);
+}
+
+/*! \brief load the key and the counters. */
+void auth_init(void)
+{
+	uint32_t k[AUTH_KEY_SIZE / 4];
+	uint32_t a, l;
+	uint8_t i;
+
+	eeprom_read_block(k, AUTH_KEY_EE, AUTH_KEY_SIZE);
+	auth_valid = 0;
+
+	for (i = 0; i < AUTH_KEY_SIZE / 4; i++)
+		if (k[i] != 0xffffffff)
+			auth_valid = 1;
+
+	/* Speck key schedule */
+	a = k[0];
+
+	for (i = 0; i < AUTH_ROUNDS; i++) {
+		auth_rk[i] = a;
+		l = (auth_ror(k[i % 3 + 1], 8) + a) ^ i;
+		k[i % 3 + 1] = l;
+		a = auth_rol(a, 3) ^ l;
+	}
+
+	/* the next block of 256 */
+	auth_ctr = auth_block(&EE_auth_tx);
+
+	if (eeprom_read_word(&EE_auth_tx) != 0xffff)
+		auth_ctr += 0x100;
+
+	for (i = 0; i < AUTH_MASTERS; i++)
+		auth_low[i] = auth_block(&EE_auth_rx[i]);
+}
+
+/*! \brief true if the frames are authenticated. */
+uint8_t auth_key_valid(void)
+{
+	return(auth_valid);
+}
+
+/*! \brief set the key.
+ * \param hex the key, AUTH_KEY_SIZE * 2 hex digits.
+ */
+void auth_set_key(const char *hex)
+{
+	uint8_t key[AUTH_KEY_SIZE];
+	char byte[3];
+	uint8_t i;
+
+	byte[2] = 0;
+
+	for (i = 0; i < AUTH_KEY_SIZE; i++) {
+		byte[0] = *(hex + i * 2);
+		byte[1] = *(hex + i * 2 + 1);
+		key[i] = strtoul(byte, 0, 16);
+	}
+
+	while (store_busy());
+
+	eeprom_update_block(key, AUTH_KEY_EE, AUTH_KEY_SIZE);
+	auth_init();
+}
+
+/*! \brief encrypt the block in place. */
+static void auth_encrypt(struct auth_t *a)
+{
+	uint32_t x, y;
+	uint8_t i;
+
+	x = a->s.w[1];
+	y = a->s.w[0];
+
+	for (i = 0; i < AUTH_ROUNDS; i++) {
+		x = (auth_ror(x, 8) + y) ^ auth_rk[i];
+		y = auth_rol(y, 3) ^ x;
+	}
+
+	a->s.w[1] = x;
+	a->s.w[0] = y;
+}
+
+/*! \brief start a new MAC. */
+void auth_start(struct auth_t *a)
+{
+	a->s.w[0] = 0;
+	a->s.w[1] = 0;
+	a->n = 0;
+}
+
+/*! \brief add a byte, a block is encrypted every 8 bytes. */
+void auth_byte(struct auth_t *a, const uint8_t c)
+{
+	a->s.b[a->n++] ^= c;
+
+	if (a->n == sizeof(a->s)) {
+		auth_encrypt(a);
+		a->n = 0;
+	}
+}
+
+/*! \brief pad the last block.
+ * \return the MAC.
+ */
+uint32_t auth_end(struct auth_t *a)
+{
+	a->s.b[a->n] ^= 0x80;
+	auth_encrypt(a);
+	return(a->s.w[0]);
+}
+
+/*! \brief append the MAC, s becomes s:MMMMMMMM.
+ *
+ * The hops are not in the MAC, the repeaters change them.
+ * \param s the frame in the envelope, with space for
+ * HTV_MAC_LEN more chars.
+ */
+void auth_append(char *s)
+{
+	struct auth_t a;
+	uint32_t mac;
+	uint8_t i, len;
+
+	len = strlen(s);
+	auth_start(&a);
+
+	for (i = 0; i < len; i++)
+		auth_byte(&a, (i == HTV_HOPS_IDX) ? '0' : *(s + i));
+
+	mac = auth_end(&a);
+	*(s + len) = ':';
+	htv_hex(s + len + 1, mac >> 16, 4);
+	htv_hex(s + len + 5, mac, 4);
+}
+
+/*! \brief master, the counter of the next frame. */
+uint32_t auth_next(void)
+{
+	/* a new block, save it first */
+	if (!(auth_ctr & 0xff)) {
+		while (store_busy());
+
+		eeprom_write_word(&EE_auth_tx, auth_ctr >> 8);
+	}
+
+	return(auth_ctr++);
+}
+
+#ifdef HTV_USE_BENCH
+/*! \brief master, change the counter of the next frame.
+ *
+ * Only for the benchmark, see m_cmd(), which gives the counter
+ * back: a counter not a multiple of 256 is not saved in EEPROM
+ * by auth_next().
+ * \return the counter before.
+ */
+uint32_t auth_swap(const uint32_t ctr)
+{
+	uint32_t old;
+
+	old = auth_ctr;
+	auth_ctr = ctr;
+	return(old);
+}
+#endif
+
+/*! \brief receiver, check and take the counter of a frame.
+ *
+ * \note call it only for frames with a valid MAC.
+ * \return true if the counter is new.
+ */
+uint8_t auth_fresh(const uint8_t master, const uint32_t ctr)
+{
+	if ((master >= AUTH_MASTERS) || (ctr < auth_low[master]))
+		return(0);
+
+	/* a new block, save it */
+	if ((ctr >> 8) != (auth_low[master] >> 8) || !(auth_low[master] & 0xff)) {
+		while (store_busy());
+
+		eeprom_write_word(&EE_auth_rx[master], ctr >> 8);
+	}
+
+	auth_low[master] = ctr + 1;
+	return(1);
+}
+
+/*! \brief add bytes of the flash to a MAC.
+ *
+ * The MAC of the image of an update is the one of the first
+ * bytes of the flash, the boot loader checks it the same way.
+ * About 2 s for 8 KiB at 1 MHz, the receiver adds a block at a
+ * time, see boot_run() in receive.c.
+ * \param addr the first byte.
+ * \param n the bytes.
+ */
+void auth_flash(struct auth_t *a, const uint16_t addr, const uint8_t n)
+{
+	uint8_t i;
+
+	for (i = 0; i < n; i++)
+		auth_byte(a, pgm_read_byte((const uint8_t *)(uintptr_t)(addr + i)));
+}
@@ -0,0 +1,64 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file auth.h
+  \brief Authenticated frames, MAC and rolling counters.
+  */
+
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/*! bytes of the key */
+#define AUTH_KEY_SIZE 16
+/*! the key in EEPROM, just below BOOT_FLAG and not an EEMEM
+ * variable, the boot loader reads it too, EEPROM_MAX in the
+ * Makefile keeps the EEMEM variables below it */
+#define AUTH_KEY_EE ((uint8_t *)(E2END - AUTH_KEY_SIZE))
+/*! rounds of the cipher, Speck 64/128 */
+#define AUTH_ROUNDS 27
+/*! number of master id, see STORE_CFG_ID */
+#define AUTH_MASTERS 16
+
+/*! \struct auth_t
+ * A CBC-MAC being computed, a byte at a time.
+ */
+struct auth_t {
+	/*! the chained block */
+	union {
+		uint32_t w[2];
+		uint8_t b[8];
+	} s;
+	/*! bytes in the current block */
+	uint8_t n;
+};
+
+void auth_init(void);
+uint8_t auth_key_valid(void);
+void auth_set_key(const char *hex);
+void auth_start(struct auth_t *a);
+void auth_byte(struct auth_t *a, const uint8_t c);
+uint32_t auth_end(struct auth_t *a);
+void auth_append(char *s);
+uint32_t auth_next(void);
+uint32_t auth_swap(const uint32_t ctr);
+void auth_flash(struct auth_t *a, const uint16_t addr, const uint8_t n);
+uint8_t auth_fresh(const uint8_t master, const uint32_t ctr);
+
+#endif
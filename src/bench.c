@@ -0,0 +1,235 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file bench.c
+ * \brief Benchmark of the firmware on the board.
+ *
+ * With HTV_USE_BENCH the master 'M' command and the slave 'm'
+ * console command run a set of tests, every one BENCH_RUNS
+ * times, and print a line for each:
+ *
+ * NAME:MMMM:AAAA:XXXX
+ *
+ * where MMMM, AAAA and XXXX are the min, the average and the max
+ * cpu cycles of a run, hex, FFFF is over the range of the timer.
+ * The IRQ are on, the min is the time of the code alone, the max
+ * shows the IRQ which came in between.
+ *
+ * - crc8: crc8_str() of an enveloped pin frame.
+ * - pin, timed, env: htv_check_cmd() of a pin frame, of a frame
+ *   with a duration and of a pin frame in the envelope.
+ * - pgm: debug_print_P() of 8 chars, a line of dots is printed.
+ * - uart: the cycles of a char on the console, BENCH_UART_CHARS
+ *   dots a run, until the last one is out of the shift register.
+ *   With the TXD jumpered to the RXD of the console, the chars
+ *   come back: loop:NNNN is the number of chars received.
+ * - p: the master also builds a P frame, see m_cmd().
+ *
+ * The cycles are counted by the Timer1 at clk/1, its setup is
+ * saved and put back at the end. With HTV_USE_ICP the chars
+ * received by the radio during the benchmark are lost.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "bench.h"
+#include "uart.h"
+
+uint16_t bench_overhead;
+
+/*! the Timer1 before the benchmark */
+static uint8_t tccr1a, tccr1b, timsk1;
+
+/*! the frames of the htv_check_cmd() tests, the crc is added */
+static const char bench_pin[] PROGMEM = "0123011";
+static const char bench_timed[] PROGMEM = "T0123013001f";
+static const char bench_env[] PROGMEM = "M01070123011";
+
+/*! \brief take the Timer1, clk/1, and measure the overhead. */
+void bench_begin(void)
+{
+	tccr1a = TCCR1A;
+	tccr1b = TCCR1B;
+	timsk1 = TIMSK1;
+	TIMSK1 = 0;
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+
+	bench_overhead = 0;
+	bench_start();
+	bench_overhead = bench_stop();
+}
+
+/*! \brief give the Timer1 back. */
+void bench_end(void)
+{
+	TCCR1B = 0;
+	TCCR1A = tccr1a;
+	TIFR1 = 0xff;
+	TIMSK1 = timsk1;
+	TCCR1B = tccr1b;
+}
+
+/*! \brief start a test. */
+void bench_clear(struct bench_t *b)
+{
+	b->min = BENCH_OVER;
+	b->max = 0;
+	b->sum = 0;
+	b->n = 0;
+}
+
+/*! \brief add a run to the test. */
+void bench_add(struct bench_t *b, const uint16_t cycles)
+{
+	if (cycles < b->min)
+		b->min = cycles;
+
+	if (cycles > b->max)
+		b->max = cycles;
+
+	b->sum += cycles;
+	b->n++;
+}
+
+/*! \brief print NAME:MMMM:AAAA:XXXX. */
+void bench_print(PGM_P name, struct bench_t *b, struct debug_t *debug)
+{
+	debug_print_P(name, debug);
+	debug_print_P(PSTR(":"), debug);
+	htv_hex(debug->line, b->min, 4);
+	debug_print(debug);
+	debug_print_P(PSTR(":"), debug);
+	htv_hex(debug->line, b->n ? b->sum / b->n : 0, 4);
+	debug_print(debug);
+	debug_print_P(PSTR(":"), debug);
+	htv_hex(debug->line, b->max, 4);
+	debug_print(debug);
+	debug_print_P(PSTR("\n"), debug);
+}
+
+/*! \brief wait for the console buffer to be empty. */
+static void bench_drain(void)
+{
+	while (uart_tx_free(0) != UART_TXBUF_MASK);
+}
+
+/*! \brief htv_check_cmd() of a frame.
+ * \param frame the frame without crc, in flash.
+ */
+static void bench_check(PGM_P name, PGM_P frame, struct htv_t *htv,
+		struct debug_t *debug)
+{
+	struct bench_t b;
+	uint8_t i;
+
+	/* the frame on the air in debug->string */
+	strcpy_P(debug->string, frame);
+	htv_crc_append(debug->string);
+	bench_clear(&b);
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		strcpy(htv->x10str, debug->string);
+		bench_start();
+		htv_check_cmd(htv);
+		bench_add(&b, bench_stop());
+	}
+
+	bench_print(name, &b, debug);
+}
+
+/*! \brief the cycles of a char on the console. */
+static void bench_uart(struct debug_t *debug)
+{
+	struct bench_t b;
+	uint16_t back, t;
+	uint8_t i, j;
+
+	bench_clear(&b);
+	back = 0;
+	bench_drain();
+	uart_flush(0);
+	uart_tx(0, 1);
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		/* clear the TXC, the next one is the last char out */
+		UART_UCSRA(0) |= _BV(UART_TXC);
+		bench_start();
+
+		for (j = 0; j < BENCH_UART_CHARS; j++)
+			uart_putchar(0, '.');
+
+		bench_drain();
+		loop_until_bit_is_set(UART_UCSRA(0), UART_TXC);
+		t = bench_stop();
+		bench_add(&b, (t == BENCH_OVER) ? t : t / BENCH_UART_CHARS);
+
+		while (uart_getchar(0, 0) == '.')
+			back++;
+	}
+
+	debug_print_P(PSTR("\n"), debug);
+	bench_print(PSTR("uart"), &b, debug);
+	debug_print_P(PSTR("loop:"), debug);
+	htv_hex(debug->line, back, 4);
+	debug_print(debug);
+	debug_print_P(PSTR("\n"), debug);
+}
+
+/*! \brief run the tests, the Timer1 must be taken, see
+ * bench_begin().
+ */
+void bench_run(struct htv_t *htv, struct debug_t *debug)
+{
+	struct bench_t b;
+	uint8_t i;
+
+	/* crc8 */
+	strcpy_P(debug->string, bench_env);
+	bench_clear(&b);
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		bench_start();
+		crc8_str(debug->string);
+		bench_add(&b, bench_stop());
+	}
+
+	bench_print(PSTR("crc8"), &b, debug);
+
+	/* htv_check_cmd() */
+	bench_check(PSTR("pin"), bench_pin, htv, debug);
+	bench_check(PSTR("timed"), bench_timed, htv, debug);
+	bench_check(PSTR("env"), bench_env, htv, debug);
+
+	/* PROGMEM print, with the buffer empty */
+	bench_clear(&b);
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		bench_drain();
+		bench_start();
+		debug_print_P(PSTR("........"), debug);
+		bench_add(&b, bench_stop());
+	}
+
+	debug_print_P(PSTR("\n"), debug);
+	bench_print(PSTR("pgm"), &b, debug);
+
+	bench_uart(debug);
+}
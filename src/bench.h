@@ -0,0 +1,85 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file bench.h
+  \brief Benchmark of the firmware on the board, see HTV_USE_BENCH.
+  */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "debug.h"
+#include "htv.h"
+
+/*! runs of every test */
+#define BENCH_RUNS 16
+/*! chars sent by a run of the uart test */
+#define BENCH_UART_CHARS 16
+/*! a time over the range of the Timer1, 65 ms at 1 MHz */
+#define BENCH_OVER 0xffff
+
+/*! \struct bench_t
+ * The times of a test, cpu cycles.
+ */
+struct bench_t {
+	/*! the shortest run */
+	uint16_t min;
+	/*! the longest run */
+	uint16_t max;
+	/*! all the runs */
+	uint32_t sum;
+	/*! number of runs */
+	uint8_t n;
+};
+
+/*! cycles of bench_start() and bench_stop() alone */
+extern uint16_t bench_overhead;
+
+/*! \brief start to count the cycles. */
+static inline void bench_start(void)
+{
+	TIFR1 = _BV(TOV1);
+	TCNT1 = 0;
+}
+
+/*! \brief the cycles since bench_start().
+ * \return the cycles or BENCH_OVER.
+ */
+static inline uint16_t bench_stop(void)
+{
+	uint16_t t;
+
+	t = TCNT1;
+
+	if (bit_is_set(TIFR1, TOV1))
+		return(BENCH_OVER);
+
+	return((t > bench_overhead) ? t - bench_overhead : 0);
+}
+
+void bench_begin(void);
+void bench_end(void);
+void bench_clear(struct bench_t *b);
+void bench_add(struct bench_t *b, const uint16_t cycles);
+void bench_print(PGM_P name, struct bench_t *b, struct debug_t *debug);
+void bench_run(struct htv_t *htv, struct debug_t *debug);
+
+#endif
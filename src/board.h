@@ -0,0 +1,110 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file board.h
+  \brief Pin maps and register bindings of the board.
+  */
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <avr/io.h>
+
+/*
+ * The board: an ATmega164P with the console on the USART0 and
+ * the radio on the USART1. A board with an other AVR, ex. a
+ * receiver with a single USART, changes only this file: the
+ * drivers see the pins and the registers through these names,
+ * with a constant port they are resolved by the compiler.
+ */
+
+/*! the port where led are connected. */
+#define LED_PORT PORTB
+/*! the data direction register. */
+#define LED_DDR DDRB
+/*! red led pin */
+#define LED_RED PB2
+/*! green led pin */
+#define LED_GREEN PB3
+
+/*! port where the rtx modules is connected */
+#define AU_PORT PORTA
+/*! data direction register */
+#define AU_DDR DDRA
+/*! enable tx pin connected to. */
+#define AU_ENABLE PA5
+/*! switch tx/rx pin connected to. */
+#define AU_TXRX PA6
+
+/*! port where the IO pin are connected in the rx module. */
+#define IO_PORT PORTA
+/*! data direction register */
+#define IO_DDR DDRA
+#define IO_PIN0 PA0
+#define IO_PIN1 PA1
+/*! the IO pins in use */
+#define IO_MASK (_BV(IO_PIN0) | _BV(IO_PIN1))
+
+/*! port of the 74HC595 chain on the SPI, see xio.c */
+#define XIO_PORT PORTB
+/*! data direction register */
+#define XIO_DDR DDRB
+/*! /OE of the chain, high until the first latch */
+#define XIO_OE PB1
+/*! RCLK, the latch, on the SS pin which must be an output */
+#define XIO_RCLK PB4
+/*! SER of the first 74HC595 */
+#define XIO_MOSI PB5
+/*! SRCLK */
+#define XIO_SCK PB7
+
+/*! data register of the serial port 0 or 1 */
+#define UART_UDR(port) (*((port) ? &UDR1 : &UDR0))
+/*! status register */
+#define UART_UCSRA(port) (*((port) ? &UCSR1A : &UCSR0A))
+/*! control register, tx, rx and IRQ enable */
+#define UART_UCSRB(port) (*((port) ? &UCSR1B : &UCSR0B))
+/*! control register, frame format */
+#define UART_UCSRC(port) (*((port) ? &UCSR1C : &UCSR0C))
+/*! baud rate, low byte */
+#define UART_UBRRL(port) (*((port) ? &UBRR1L : &UBRR0L))
+
+/* the bits are in the same place on both ports */
+/*! UCSRA: a char has been received */
+#define UART_RXC RXC0
+/*! UCSRA: the last char is out of the shift register */
+#define UART_TXC TXC0
+/*! UCSRA: the data register is empty */
+#define UART_UDRE UDRE0
+/*! UCSRA: double speed */
+#define UART_U2X U2X0
+/*! UCSRB: transmitter enable */
+#define UART_TXEN TXEN0
+/*! UCSRB: receiver enable */
+#define UART_RXEN RXEN0
+/*! UCSRB: rx complete IRQ enable */
+#define UART_RXCIE RXCIE0
+/*! UCSRB: data register empty IRQ enable */
+#define UART_UDRIE UDRIE0
+/*! UCSRC: 2 stop bits */
+#define UART_USBS USBS0
+/*! UCSRC: 8 bits, low bit */
+#define UART_UCSZ0 UCSZ00
+/*! UCSRC: 8 bits, high bit */
+#define UART_UCSZ1 UCSZ01
+
+#endif
@@ -0,0 +1,486 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file boot.c
+ * \brief Boot loader, over the air update of the slaves.
+ *
+ * A separate program in the boot section, see the boot target of
+ * the Makefile, with the fuses BOOTSZ 1024 words and BOOTRST.
+ * After a reset it jumps at once to the application unless the
+ * BOOT_FLAG in EEPROM asks for an update, the slave sets it when
+ * it receives the image frame of a new image, see \ref subrxycmd.
+ *
+ * The update is a carousel: the master sends the blocks of the
+ * image again and again, with the image frame every few blocks,
+ * and all the slaves receive at the same time. Every block has
+ * its number and a CRC-CCITT, a good block is written at once in
+ * its flash page, the other blocks of the page already received
+ * are read back from the flash. The blocks received are marked in
+ * RAM, a missing block is taken in the next round.
+ *
+ * When all the blocks of the image are in, the CRC-CCITT of the
+ * whole image in the flash is checked against the one in the
+ * image frame, only then the application is run. A wrong image
+ * is received again from the start.
+ *
+ * With a key, see auth.c, the image frame is taken only in the
+ * authenticated envelope with a good MAC, and it carries the MAC
+ * of the image in place of its CRC: the blocks have only their
+ * CRC, but an image with a block from someone else does not
+ * pass. The key is read at AUTH_KEY_EE, the cipher is the same
+ * of auth.c. The counter of the envelope is not checked here,
+ * an old image frame sent again can only bring back an old image
+ * of the same master. About 2 s to check 8 KiB at 1 MHz.
+ *
+ * The first image frame starts the update, a different one is
+ * taken only when the image received turns out wrong, so no one
+ * can move an update to another image half way.
+ *
+ * If nothing is received for about a minute and the application
+ * has not been touched yet, it is run again.
+ *
+ * The radio is read polling the USART1, no IRQ are used and the
+ * IRQ vectors stay in the application.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#include "htv.h"
+#include "uart.h"
+#include "auth.h"
+#include "boot.h"
+
+/*! the frame being received, the block is the longest */
+static char buf[HTV_BLOCK_LEN + 1];
+/*! the blocks received */
+static uint8_t have[BOOT_BLOCKS_MAX / 8];
+/*! a flash page */
+static uint8_t page[SPM_PAGESIZE];
+/*! number of blocks of the image, 0 unknown */
+static uint16_t blocks;
+/*! CRC-CCITT of the image, or its MAC with a key */
+static uint32_t image_check;
+/*! the round keys, as in auth_init() */
+static uint32_t rk[AUTH_ROUNDS];
+/*! the key is set */
+static uint8_t key;
+
+/*! \brief the value of n hex digits, -1 if not hex. */
+static int32_t boot_hex(const char *s, uint8_t n)
+{
+	int32_t v;
+	char c;
+
+	v = 0;
+
+	while (n--) {
+		c = *s++;
+
+		if ((c >= '0') && (c <= '9'))
+			c -= '0';
+		else if ((c >= 'a') && (c <= 'f'))
+			c -= 'a' - 10;
+		else
+			return(-1);
+
+		v = (v << 4) | c;
+	}
+
+	return(v);
+}
+
+/*! \brief rotate right. */
+static uint32_t boot_ror(const uint32_t x, const uint8_t r)
+{
+	return((x >> r) | (x << (32 - r)));
+}
+
+/*! \brief rotate left. */
+static uint32_t boot_rol(const uint32_t x, const uint8_t r)
+{
+	return((x << r) | (x >> (32 - r)));
+}
+
+/*! \brief load the key, as in auth_init(). */
+static void boot_key(void)
+{
+	uint32_t k[AUTH_KEY_SIZE / 4];
+	uint32_t a, l;
+	uint8_t i;
+
+	eeprom_read_block(k, AUTH_KEY_EE, AUTH_KEY_SIZE);
+	key = 0;
+
+	for (i = 0; i < AUTH_KEY_SIZE / 4; i++)
+		if (k[i] != 0xffffffff)
+			key = 1;
+
+	a = k[0];
+
+	for (i = 0; i < AUTH_ROUNDS; i++) {
+		rk[i] = a;
+		l = (boot_ror(k[i % 3 + 1], 8) + a) ^ i;
+		k[i % 3 + 1] = l;
+		a = boot_rol(a, 3) ^ l;
+	}
+}
+
+/*! \brief add a byte to the MAC, as auth_byte(). */
+static void boot_mac_byte(struct auth_t *a, const uint8_t c)
+{
+	uint32_t x, y;
+	uint8_t i;
+
+	a->s.b[a->n++] ^= c;
+
+	if (a->n < sizeof(a->s))
+		return;
+
+	x = a->s.w[1];
+	y = a->s.w[0];
+
+	for (i = 0; i < AUTH_ROUNDS; i++) {
+		x = (boot_ror(x, 8) + y) ^ rk[i];
+		y = boot_rol(y, 3) ^ x;
+	}
+
+	a->s.w[1] = x;
+	a->s.w[0] = y;
+	a->n = 0;
+}
+
+/*! \brief pad the last block, as auth_end().
+ * \return the MAC.
+ */
+static uint32_t boot_mac_end(struct auth_t *a)
+{
+	a->s.b[a->n] ^= 0x80;
+	/* the block is full, encrypt it */
+	a->n = sizeof(a->s) - 1;
+	boot_mac_byte(a, 0);
+	return(a->s.w[0]);
+}
+
+/*! \brief the value of 8 hex digits, a MAC.
+ * \return 0 if not hex, the MAC is not looked at then.
+ */
+static uint8_t boot_hex32(const char *s, uint32_t *v)
+{
+	int32_t hi, lo;
+
+	hi = boot_hex(s, 4);
+	lo = boot_hex(s + 4, 4);
+	*v = ((uint32_t)hi << 16) | lo;
+	return((hi >= 0) && (lo >= 0));
+}
+
+/*! \brief the MAC of the first bytes of the flash, as auth_flash(). */
+static uint32_t boot_image_mac(const uint16_t len)
+{
+	struct auth_t a;
+	uint16_t addr;
+
+	memset(&a, 0, sizeof(a));
+
+	for (addr = 0; addr < len; addr++)
+		boot_mac_byte(&a, pgm_read_byte((const uint8_t *)(uintptr_t)addr));
+
+	return(boot_mac_end(&a));
+}
+
+/*! \brief true if the block n has been received. */
+static uint8_t boot_have(const uint16_t n)
+{
+	return(have[n >> 3] & _BV(n & 7));
+}
+
+/*! \brief run the application. */
+static void boot_app(void)
+{
+	void (*app)(void) = 0;
+
+	TCCR1B = 0;
+	UART_UCSRB(1) = 0;
+	app();
+}
+
+/*! \brief the lenght of the frame, 0 not for the boot loader. */
+static uint8_t boot_frame_len(void)
+{
+	switch (*buf) {
+		case HTV_TYPE_BLOCK:
+			return(HTV_BLOCK_LEN);
+		case HTV_TYPE_MASTER:
+		case HTV_TYPE_ACKREQ:
+			return(HTV_MASTER_LEN + HTV_BOOT_LEN + 3);
+		case HTV_TYPE_AUTH:
+			return(HTV_AUTH_LEN + HTV_BOOT_AUTH_LEN + HTV_MAC_LEN);
+		default:
+			return(0);
+	}
+}
+
+/*! \brief the image frame in the envelope.
+ *
+ * Without a key the crc8 of the envelope is checked, with a key
+ * only the authenticated envelope with a good MAC is taken, as
+ * in rx_char() the hops are not in the MAC.
+ * Once the update has started a different image is refused, see
+ * main().
+ */
+static uint8_t boot_image(const uint8_t len)
+{
+	struct auth_t a;
+	char *s;
+	int32_t n, crc;
+	uint32_t check, mac;
+	uint8_t crc8, i, ok;
+
+	if (key) {
+		if ((*buf != HTV_TYPE_AUTH) || (buf[len - HTV_MAC_LEN] != ':') ||
+				!boot_hex32(buf + len - HTV_MAC_LEN + 1, &mac))
+			return(0);
+
+		memset(&a, 0, sizeof(a));
+
+		for (i = 0; i < len - HTV_MAC_LEN; i++)
+			boot_mac_byte(&a, (i == HTV_HOPS_IDX) ? '0' : buf[i]);
+
+		if (boot_mac_end(&a) != mac)
+			return(0);
+
+		s = buf + HTV_AUTH_LEN;
+		ok = boot_hex32(s + 4, &check);
+	} else {
+		if (*buf == HTV_TYPE_AUTH)
+			return(0);
+
+		s = buf + HTV_MASTER_LEN;
+		crc8 = 0;
+
+		for (i = 0; i < len - 3; i++)
+			crc8 = _crc_ibutton_update(crc8, buf[i]);
+
+		if ((buf[len - 3] != ':') || (boot_hex(buf + len - 2, 2) != crc8))
+			return(0);
+
+		crc = boot_hex(s + 4, 4);
+		check = crc;
+		ok = (crc >= 0);
+	}
+
+	n = boot_hex(s + 1, 3);
+
+	if ((*s != HTV_TYPE_BOOT) || (n <= 0) || (n > BOOT_BLOCKS_MAX) || !ok)
+		return(0);
+
+	/* the first image, a different one is not taken */
+	if (!blocks) {
+		blocks = n;
+		image_check = check;
+		memset(have, 0, sizeof(have));
+	}
+
+	return((n == blocks) && (check == image_check));
+}
+
+/*! \brief write a block in its page.
+ * \return 0 if the frame is not a good block.
+ */
+static uint8_t boot_block(void)
+{
+	uint16_t crc, n, addr;
+	uint8_t i;
+
+	crc = 0xffff;
+
+	for (i = 0; i < HTV_BLOCK_LEN - 4; i++)
+		crc = _crc_xmodem_update(crc, buf[i]);
+
+	if (boot_hex(buf + HTV_BLOCK_LEN - 4, 4) != crc)
+		return(0);
+
+	n = boot_hex(buf + 1, 3);
+
+	if (n >= BOOT_BLOCKS_MAX)
+		return(0);
+
+	if (boot_have(n))
+		return(1);
+
+	/* the blocks of the page already written */
+	addr = (n * BOOT_BLOCK_SIZE) & ~(SPM_PAGESIZE - 1);
+
+	for (i = 0; i < SPM_PAGESIZE; i++)
+		page[i] = boot_have((addr + i) / BOOT_BLOCK_SIZE) ?
+			pgm_read_byte(addr + i) : 0xff;
+
+	for (i = 0; i < BOOT_BLOCK_SIZE; i++)
+		page[(n * BOOT_BLOCK_SIZE) % SPM_PAGESIZE + i] =
+			boot_hex(buf + 4 + i * 2, 2);
+
+	/* from now on the application is not there */
+	if (eeprom_read_byte(BOOT_FLAG) != BOOT_DIRTY) {
+		eeprom_write_byte(BOOT_FLAG, BOOT_DIRTY);
+		eeprom_busy_wait();
+	}
+
+	boot_page_erase(addr);
+	boot_spm_busy_wait();
+
+	for (i = 0; i < SPM_PAGESIZE; i += 2)
+		boot_page_fill(addr + i, page[i] | (page[i + 1] << 8));
+
+	boot_page_write(addr);
+	boot_spm_busy_wait();
+	boot_rww_enable();
+	have[n >> 3] |= _BV(n & 7);
+	return(1);
+}
+
+/*! \brief true if all the blocks of the image are in. */
+static uint8_t boot_complete(void)
+{
+	uint16_t n;
+
+	if (!blocks)
+		return(0);
+
+	for (n = 0; n < blocks; n++)
+		if (!boot_have(n))
+			return(0);
+
+	return(1);
+}
+
+/*! \brief receive the update. */
+int main(void)
+{
+	uint8_t sync, idx, len;
+	char c;
+
+	/* the watchdog is still on after its reset */
+	MCUSR = 0;
+	wdt_disable();
+
+	if ((eeprom_read_byte(BOOT_FLAG) != BOOT_UPDATE) &&
+			(eeprom_read_byte(BOOT_FLAG) != BOOT_DIRTY))
+		boot_app();
+
+#ifdef HTV_USE_RTX
+	/* the receive sequence of the module, see radio_power() */
+	AU_DDR |= _BV(AU_ENABLE) | _BV(AU_TXRX);
+	AU_PORT |= _BV(AU_ENABLE);
+	_delay_us(20);
+	AU_PORT |= _BV(AU_TXRX);
+	_delay_us(200);
+	AU_PORT &= ~_BV(AU_TXRX);
+	_delay_us(40);
+	AU_PORT &= ~_BV(AU_ENABLE);
+	_delay_us(20);
+	AU_PORT |= _BV(AU_ENABLE);
+	_delay_us(200);
+#endif
+
+	/* the radio as in uart_init() */
+#if F_CPU < 2000000UL
+	UART_UCSRA(1) = _BV(UART_U2X);
+	UART_UBRRL(1) = (F_CPU / (8UL * UART_BAUD_1)) - 1;
+#else
+	UART_UBRRL(1) = (F_CPU / (16UL * UART_BAUD_1)) - 1;
+#endif
+	UART_UCSRC(1) = _BV(UART_USBS) | _BV(UART_UCSZ0) | _BV(UART_UCSZ1);
+	UART_UCSRB(1) = _BV(UART_RXEN);
+
+	boot_key();
+
+	/* the idle time, clk/1024 overflows in 67 s at 1 MHz */
+	TCCR1B = _BV(CS12) | _BV(CS10);
+	sync = 0;
+	idx = 0;
+	len = 0;
+
+	while (1) {
+		if (bit_is_set(TIFR1, TOV1) &&
+				(eeprom_read_byte(BOOT_FLAG) == BOOT_UPDATE)) {
+			eeprom_write_byte(BOOT_FLAG, BOOT_RUN);
+			eeprom_busy_wait();
+			boot_app();
+		}
+
+		if (bit_is_clear(UART_UCSRA(1), UART_RXC))
+			continue;
+
+		c = UART_UDR(1);
+
+		/* 2 'x' and the frame, as in rx_char() */
+		if (c == 'x') {
+			sync = (sync < 2) ? sync + 1 : 2;
+			idx = 0;
+			continue;
+		}
+
+		if (sync < 2) {
+			sync = 0;
+			continue;
+		}
+
+		buf[idx++] = c;
+
+		if (idx == 1)
+			len = boot_frame_len();
+
+		if (!len) {
+			sync = 0;
+			continue;
+		}
+
+		if (idx < len)
+			continue;
+
+		sync = 0;
+		buf[idx] = 0;
+
+		if ((*buf == HTV_TYPE_BLOCK) ? boot_block() : boot_image(len)) {
+			/* something for us, restart the idle time */
+			TCNT1 = 0;
+			TIFR1 = _BV(TOV1);
+		}
+
+		if (boot_complete()) {
+			if ((key ? boot_image_mac(blocks * BOOT_BLOCK_SIZE) :
+						boot_image_crc(blocks)) == image_check) {
+				eeprom_write_byte(BOOT_FLAG, BOOT_RUN);
+				eeprom_busy_wait();
+				boot_app();
+			}
+
+			/* a wrong image, all again from the next image frame */
+			blocks = 0;
+			memset(have, 0, sizeof(have));
+		}
+	}
+
+	return(0);
+}
@@ -0,0 +1,65 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file boot.h
+  \brief Over the air update, shared by the boot loader and the slave.
+  */
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+#include "htv.h"
+
+/*! byte address of the boot loader, BOOTSZ 1024 words */
+#define BOOT_START 0x3800
+/*! bytes of data in a block, see HTV_BLOCK_LEN */
+#define BOOT_BLOCK_SIZE ((HTV_BLOCK_LEN - 8) / 2)
+/*! max number of blocks, the application section */
+#define BOOT_BLOCKS_MAX (BOOT_START / BOOT_BLOCK_SIZE)
+
+/*! the EEPROM byte of the boot loader, the last one, not used by
+ * the EEMEM variables of the application, checked at link time by
+ * EEPROM_MAX in the Makefile */
+#define BOOT_FLAG ((uint8_t *)E2END)
+/*! flag: run the application, the EEPROM erased is the same */
+#define BOOT_RUN 0xff
+/*! flag: stay in the boot loader, the application is still there */
+#define BOOT_UPDATE 0x01
+/*! flag: stay in the boot loader, the application is being written */
+#define BOOT_DIRTY 0x02
+
+/*! \brief CRC-CCITT of the first blocks of the flash.
+ * \param blocks number of blocks.
+ */
+static inline uint16_t boot_image_crc(const uint16_t blocks)
+{
+	uint16_t addr, crc;
+
+	crc = 0xffff;
+
+	for (addr = 0; addr < blocks * BOOT_BLOCK_SIZE; addr++)
+		crc = _crc_xmodem_update(crc, pgm_read_byte((const uint8_t *)(uintptr_t)addr));
+
+	return(crc);
+}
+
+#endif
@@ -0,0 +1,169 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file cmd.c
+ * \brief Table driven command dispatcher.
+ *
+ * Both the master host link and the slave console use a table
+ * of struct cmd_t stored in flash. Every entry has the pattern
+ * of the whole command line, which is checked before calling
+ * the handler, and the help line printed by the '?' command.
+ * A command can have more entries, the first one which matches
+ * is used.
+ *
+ * Pattern chars:
+ * - 'h' an hex digit [0-9a-fA-F].
+ * - 'b' a binary digit [0-1].
+ * - any other char must be present as it is.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "cmd.h"
+
+/*! \brief get a line from the serial port, never waits.
+ *
+ * Every call takes the chars already received, the line is
+ * terminated by a '\\r' or a '\\n', empty lines are ignored.
+ * A maximum of MAX_CMD_LENGHT - 1 chars can be entered,
+ * backspace removes the last one.
+ *
+ * \param line the line being typed.
+ * \param port the serial port.
+ * \param echo 1: echo the chars while typing.
+ * \return true if the line is complete, the next call starts
+ * a new line.
+ */
+uint8_t cmd_getline(struct cmd_line_t *line, const uint8_t port,
+		const uint8_t echo)
+{
+	char c;
+
+	while ((c = uart_getchar(port, 0))) {
+		if (echo)
+			uart_putchar(port, c);
+
+		switch (c) {
+			case '\r':
+			case '\n':
+				if (line->idx) {
+					*(line->buf + line->idx) = 0;
+					line->idx = 0;
+					return(1);
+				}
+
+				break;
+			case '\b':
+			case 0x7f:
+				if (line->idx)
+					line->idx--;
+
+				break;
+			default:
+				*(line->buf + line->idx) = c;
+
+				if (line->idx < (MAX_CMD_LENGHT - 1))
+					line->idx++;
+		}
+	}
+
+	return(0);
+}
+
+/*! \brief check the line against the pattern.
+ * \return true if it matches.
+ */
+static uint8_t cmd_check(const char *line, PGM_P args)
+{
+	char p;
+
+	while ((p = pgm_read_byte(args++))) {
+		switch (p) {
+			case 'h':
+				if (!(((*line >= '0') && (*line <= '9')) ||
+						((*line >= 'a') && (*line <= 'f')) ||
+						((*line >= 'A') && (*line <= 'F'))))
+					return(0);
+
+				break;
+			case 'b':
+				if ((*line != '0') && (*line != '1'))
+					return(0);
+
+				break;
+			default:
+				if (*line != p)
+					return(0);
+		}
+
+		line++;
+	}
+
+	/* the line must not be longer than the pattern */
+	return(!*line);
+}
+
+/*! \brief find the command and execute it.
+ *
+ * Unknown commands or wrong arguments are replied with "ko".
+ *
+ * \param table the command table in flash.
+ * \param line the command line.
+ */
+void cmd_exec(const struct cmd_t *table, char *line,
+		struct htv_t *htv, struct debug_t *debug)
+{
+	struct cmd_t cmd;
+	uint8_t err;
+
+	err = CMD_KO;
+	memcpy_P(&cmd, table, sizeof(struct cmd_t));
+
+	/* the same command can have more entries with different args */
+	while (cmd.id && ((cmd.id != *line) || !cmd_check(line, cmd.args))) {
+		table++;
+		memcpy_P(&cmd, table, sizeof(struct cmd_t));
+	}
+
+	if (cmd.id)
+		err = cmd.exec(line, htv, debug);
+
+	switch (err) {
+		case CMD_OK:
+			debug_print_P(PSTR("OK\n"), debug);
+			break;
+		case CMD_KO:
+			debug_print_P(PSTR("ko\n"), debug);
+			break;
+		default:
+			break;
+	}
+}
+
+/*! \brief print the help line of every command in the table. */
+void cmd_help(const struct cmd_t *table, struct debug_t *debug)
+{
+	PGM_P help;
+
+	debug_print_P(PSTR("Help:\n"), debug);
+
+	while (pgm_read_byte(&table->id)) {
+		help = (PGM_P)pgm_read_word(&table->help);
+		debug_print_P(help, debug);
+		table++;
+	}
+}
@@ -0,0 +1,67 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file cmd.h
+  \brief Table driven command dispatcher.
+  */
+
+#ifndef CMD_H
+#define CMD_H
+
+#include <avr/pgmspace.h>
+#include "debug.h"
+#include "htv.h"
+
+/*! handler return: print "OK" */
+#define CMD_OK 0
+/*! handler return: print "ko" */
+#define CMD_KO 1
+/*! handler return: the handler has already replied */
+#define CMD_DONE 2
+
+/*! \struct cmd_line_t
+ * A line being typed on a serial port.
+ */
+struct cmd_line_t {
+	/*! MAX_CMD_LENGHT chars, the line */
+	char *buf;
+	/*! number of chars already in buf */
+	uint8_t idx;
+};
+
+/*! \struct cmd_t
+ * A command of the table, the table lives in flash and it is
+ * terminated by an entry with id 0.
+ */
+struct cmd_t {
+	/*! the first char of the command */
+	char id;
+	/*! the pattern of the whole command, see cmd_check() */
+	PGM_P args;
+	/*! the function which executes the command */
+	uint8_t (*exec)(char *line, struct htv_t *htv, struct debug_t *debug);
+	/*! the help line */
+	PGM_P help;
+};
+
+uint8_t cmd_getline(struct cmd_line_t *line, const uint8_t port,
+		const uint8_t echo);
+void cmd_exec(const struct cmd_t *table, char *line,
+		struct htv_t *htv, struct debug_t *debug);
+void cmd_help(const struct cmd_t *table, struct debug_t *debug);
+
+#endif
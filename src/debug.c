@@ -45,16 +45,52 @@ void debug_print(struct debug_t *debug)
 		uart_printstr(0, debug->line);
 }
 
-/*! \brief boot message */
-static void hello(struct debug_t *debug)
+/*! boot message lines */
+static const char hello_0[] PROGMEM = "\nOneWay Rel: " GITREL "\n\n";
+static const char hello_1[] PROGMEM = "Andrea Marabini <info@marabo.it>\n";
+static const char hello_2[] PROGMEM = "Enrico Rossi <e.rossi@tecnobrain.com>\n";
+static const char hello_3[] PROGMEM = "URL: http://tecnobrain.com/\n";
+static const char hello_4[] PROGMEM = "GNU GPL v3 - use at your own risk!\n\n";
+
+/*! the boot message */
+static PGM_P const hello[] PROGMEM = {
+	hello_0, hello_1, hello_2, hello_3, hello_4
+};
+
+/*! \brief boot message, printed in background.
+ *
+ * Print the chars of the boot message which fit in the console
+ * buffer, it never waits. A line longer than the buffer goes out
+ * in more pieces.
+ *
+ * \return true while there are lines to be printed.
+ */
+uint8_t debug_hello(struct debug_t *debug)
 {
-        debug_print_P(PSTR("\nOneWay Rel: "), debug);
-        debug_print_P(PSTR(GITREL), debug);
-        debug_print_P(PSTR("\n\n"), debug);
-        debug_print_P(PSTR("Andrea Marabini <info@marabo.it>\n"), debug);
-        debug_print_P(PSTR("Enrico Rossi <e.rossi@tecnobrain.com>\n"), debug);
-        debug_print_P(PSTR("URL: http://tecnobrain.com/\n"), debug);
-        debug_print_P(PSTR("GNU GPL v3 - use at your own risk!\n\n"), debug);
+	PGM_P line;
+	uint8_t n;
+	char c;
+
+	if (!debug->active || (debug->hello >= sizeof(hello) / sizeof(PGM_P)))
+		return(0);
+
+	line = (PGM_P)pgm_read_word(&hello[debug->hello]);
+	n = uart_tx_free(0);
+
+	while (n--) {
+		c = pgm_read_byte(line + debug->hello_idx);
+
+		if (!c) {
+			debug->hello++;
+			debug->hello_idx = 0;
+			break;
+		}
+
+		uart_putchar(0, c);
+		debug->hello_idx++;
+	}
+
+	return(1);
 }
 
 /*! \brief press 'y' or 'n' */
@@ -81,7 +117,9 @@ uint8_t debug_wait_for_y(struct debug_t *debug)
 	return(0);
 }
 
-/*! \brief initialize debug struct and uart console */
+/*! \brief initialize debug struct and uart console.
+ * \note the boot message is not printed here, see debug_hello().
+ */
 struct debug_t *debug_init(void)
 {
 	struct debug_t *debug;
@@ -93,7 +131,9 @@ struct debug_t *debug_init(void)
 	debug->line = malloc(MAX_LINE_LENGHT);
 	debug->string = malloc(MAX_STRING_LENGHT);
 	debug->active = 1;
-	hello(debug);
+	debug->hello = 0;
+	debug->hello_idx = 0;
+	debug->addr_state = DEBUG_ADDR_OFF;
 	/*
 	debug_print_P(PSTR("\nActivate debug? (y/N): "), debug);
 
@@ -161,36 +201,64 @@ void debug_print_address(struct htv_t *htv, struct debug_t *debug)
 	debug_print_P(PSTR("\n"), debug);
 }
 
-/*! \brief input and store the address of the unit in EEPROM.
- * \note the function will cycle until a correct address is entered.
+/*! \brief start the dialog to change the address.
+ *
+ * The dialog never waits, the console lines are given to
+ * debug_address_line() while the receiver keeps running.
  */
-void debug_setup_address(struct htv_t *htv, struct debug_t *debug)
+void debug_address_start(struct htv_t *htv, struct debug_t *debug)
 {
-	uint8_t i;
-	char c = 0;
-
-	while ((c != 'y') && (c != 'Y')) {
-		debug_print_address(htv, debug);
-		debug_print_P(PSTR("\nChange address, remeber:\n"), debug);
-		debug_print_P(PSTR(" - the address is in HEX, use digit from 0 to f\n"), debug);
-		debug_print_P(PSTR(" - do not use 0000 or ffff as address\n"), debug);
-		debug_print_P(PSTR("\nEnter the 4 digit address [0001 - fffe]: "), debug);
-
-		for (i=0; i<4; i++) {
-			*(htv->substr + i) = uart_getchar(0, 1);
-			uart_putchar(0, *(htv->substr + i));
-		}
+	debug_print_address(htv, debug);
+	debug_print_P(PSTR("\nChange address, remeber:\n"), debug);
+	debug_print_P(PSTR(" - the address is in HEX, use digit from 0 to f\n"), debug);
+	debug_print_P(PSTR(" - do not use 0000 or ffff as address\n"), debug);
+	debug_print_P(PSTR("\nEnter the 4 digit address [0001 - fffe]: "), debug);
+	debug->addr_state = DEBUG_ADDR_ENTER;
+}
 
-		/* terminate the string */
-		*(htv->substr + 4) = 0;
-		htv->ee_addr = strtoul(htv->substr, 0, 16);
-		debug_print_address(htv, debug);
-		debug_print_P(PSTR("confirm? (y/n) "), debug);
-		c = uart_getchar(0, 1);
-		uart_putchar(0, c);
+/*! \brief a console line to the address dialog.
+ *
+ * The address is changed only when confirmed, between two frames,
+ * and stored in EEPROM.
+ *
+ * \return true if the line is for the dialog.
+ */
+uint8_t debug_address_line(char *line, struct htv_t *htv,
+		struct debug_t *debug)
+{
+	char *end;
+
+	switch (debug->addr_state) {
+		case DEBUG_ADDR_ENTER:
+			debug->addr = strtoul(line, &end, 16);
+
+			if ((strlen(line) != 4) || *end || !debug->addr ||
+					(debug->addr == 0xffff)) {
+				debug_print_P(PSTR("\nEnter the 4 digit address [0001 - fffe]: "), debug);
+				break;
+			}
+
+			debug_print_P(PSTR("\nNew address: 0x"), debug);
+			utoa(debug->addr, debug->line, 16);
+			debug_print(debug);
+			debug_print_P(PSTR("\nconfirm? (y/n) "), debug);
+			debug->addr_state = DEBUG_ADDR_CONFIRM;
+			break;
+		case DEBUG_ADDR_CONFIRM:
+			if ((*line != 'y') && (*line != 'Y')) {
+				debug_address_start(htv, debug);
+				break;
+			}
+
+			htv->ee_addr = debug->addr;
+			htv_store_address(htv);
+			debug->addr_state = DEBUG_ADDR_OFF;
+			debug_print_P(PSTR("\nAddress changed and saved.\n"), debug);
+			debug_print_P(PSTR("Reset the receiver to check if everything is OK\n"), debug);
+			break;
+		default:
+			return(0);
 	}
 
-	htv_store_address(htv);
-	debug_print_P(PSTR("\nAddress changed and saved.\n"), debug);
-	debug_print_P(PSTR("Reset the receiver to check if everything is OK\n"), debug);
+	return(1);
 }
@@ -26,9 +26,9 @@
 #include "uart.h"
 #include "htv.h"
 
-/*! unused */
+/*! see QUOTEME() */
 #define QUOTEME_(x) #x
-/*! unused */
+/*! the value of a macro as a string, ex. in a help line */
 #define QUOTEME(x) QUOTEME_(x)
 
 /*! Maximum number of char a line can be */
@@ -44,6 +44,13 @@ conversions have to be made from int to string etc. */
 /*! seconds to wait for press 'y' when not locked */
 #define SEC_FOR_Y 5
 
+/*! address dialog: not running */
+#define DEBUG_ADDR_OFF 0
+/*! address dialog: waiting for the address */
+#define DEBUG_ADDR_ENTER 1
+/*! address dialog: waiting for the confirm */
+#define DEBUG_ADDR_CONFIRM 2
+
 /*! \struct debug_t
   The main debug structure, it has to be allocated,
   eventually, if debug is not active, you can avoid the
@@ -56,15 +63,26 @@ struct debug_t {
 	char *string;
 	/*! debug status [0, 1] */
 	uint8_t active;
+	/*! next line of the boot message to be printed */
+	uint8_t hello;
+	/*! next char of the line, see debug_hello() */
+	uint8_t hello_idx;
+	/*! the address dialog, one of DEBUG_ADDR_* */
+	uint8_t addr_state;
+	/*! the address entered, not yet confirmed */
+	uint16_t addr;
 };
 
 void debug_print_P(PGM_P string, struct debug_t *debug);
 void debug_print(struct debug_t *debug);
 uint8_t debug_wait_for_y(struct debug_t *debug);
+uint8_t debug_hello(struct debug_t *debug);
 struct debug_t *debug_init(void);
 void debug_free(struct debug_t *debug);
 void debug_print_htv(struct htv_t *htv, struct debug_t *debug);
-void debug_setup_address(struct htv_t *htv, struct debug_t *debug);
+void debug_address_start(struct htv_t *htv, struct debug_t *debug);
+uint8_t debug_address_line(char *line, struct htv_t *htv,
+		struct debug_t *debug);
 void debug_print_address(struct htv_t *htv, struct debug_t *debug);
 
 #endif
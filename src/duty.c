@@ -0,0 +1,121 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file duty.c
+ * \brief Airtime duty-cycle limiter.
+ *
+ * A token bucket of airtime: it holds the duty-cycle of
+ * DUTY_WINDOW_S, ex. 36 s for 1% of an hour, it is refilled at
+ * the duty-cycle rate and every transmission takes its measured
+ * time on the air, see radio_airtime(). A frame is sent only if
+ * the bucket has its time, a burst of frames can use the whole
+ * bucket and then the frames wait.
+ *
+ * The duty-cycle is STORE_CFG_DUTY in 0.1% units, 0 is
+ * DUTY_DEFAULT and DUTY_OFF is no limit.
+ *
+ * Every radio channel, DUTY_RADIO and DUTY_SUART, is on its own
+ * frequency and has its own bucket of the same size.
+ */
+
+#include <stdint.h>
+
+#include "duty.h"
+#include "store.h"
+#include "tick.h"
+
+/*! the tokens, ms of airtime * 1000 */
+static uint32_t tokens[DUTY_CHANNELS];
+/*! tick_ms32() of the last refill */
+static uint32_t last[DUTY_CHANNELS];
+
+/*! \brief the duty-cycle in 0.1% units, DUTY_OFF no limit. */
+uint8_t duty_get(void)
+{
+	uint8_t duty;
+
+	duty = store_get_cfg(STORE_CFG_DUTY);
+	return(duty ? duty : DUTY_DEFAULT);
+}
+
+/*! \brief the size of the bucket, ms of airtime. */
+uint32_t duty_capacity(void)
+{
+	return(duty_get() * DUTY_WINDOW_S);
+}
+
+/*! \brief start with the bucket full.
+ * \note the tick must be running, see tick_init().
+ */
+void duty_init(void)
+{
+	uint8_t ch;
+
+	for (ch = 0; ch < DUTY_CHANNELS; ch++) {
+		tokens[ch] = duty_capacity() * 1000UL;
+		last[ch] = tick_ms32();
+	}
+}
+
+/*! \brief add the tokens of the time passed. */
+static void duty_refill(const uint8_t ch)
+{
+	uint32_t now, elapsed;
+
+	now = tick_ms32();
+	elapsed = now - last[ch];
+	last[ch] = now;
+
+	/* a whole window fills the bucket, no overflow */
+	if (elapsed > DUTY_WINDOW_S * 1000UL)
+		elapsed = DUTY_WINDOW_S * 1000UL;
+
+	tokens[ch] += elapsed * duty_get();
+
+	if (tokens[ch] > duty_capacity() * 1000UL)
+		tokens[ch] = duty_capacity() * 1000UL;
+}
+
+/*! \brief the airtime left on the channel, ms. */
+uint32_t duty_left(const uint8_t ch)
+{
+	duty_refill(ch);
+	return(tokens[ch] / 1000UL);
+}
+
+/*! \brief true if ms of airtime can be used now on the channel. */
+uint8_t duty_ok(const uint8_t ch, const uint16_t ms)
+{
+	if (duty_get() == DUTY_OFF)
+		return(1);
+
+	return(duty_left(ch) >= ms);
+}
+
+/*! \brief take the airtime used on the channel. */
+void duty_spend(const uint8_t ch, const uint16_t ms)
+{
+	if (duty_get() == DUTY_OFF)
+		return;
+
+	duty_refill(ch);
+
+	if (tokens[ch] > ms * 1000UL)
+		tokens[ch] -= ms * 1000UL;
+	else
+		tokens[ch] = 0;
+}
@@ -0,0 +1,53 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file duty.h
+  \brief Airtime duty-cycle limiter.
+  */
+
+#ifndef DUTY_H
+#define DUTY_H
+
+#include <stdint.h>
+
+#include "htv.h"
+
+/*! the duty-cycle is measured over this window, s */
+#define DUTY_WINDOW_S 3600UL
+/*! duty-cycle when not configured, 0.1% units */
+#define DUTY_DEFAULT 10
+/*! STORE_CFG_DUTY value: no limit */
+#define DUTY_OFF 0xff
+/*! bucket of the radio on the USART1 */
+#define DUTY_RADIO 0
+/*! bucket of the radio on the software UART, see suart.c */
+#define DUTY_SUART 1
+#ifdef HTV_USE_SUART
+/*! number of buckets, a radio channel each */
+#define DUTY_CHANNELS 2
+#else
+#define DUTY_CHANNELS 1
+#endif
+
+void duty_init(void);
+uint8_t duty_get(void);
+uint32_t duty_capacity(void);
+uint32_t duty_left(const uint8_t ch);
+uint8_t duty_ok(const uint8_t ch, const uint16_t ms);
+void duty_spend(const uint8_t ch, const uint16_t ms);
+
+#endif
@@ -27,18 +27,21 @@
 #include <avr/eeprom.h>
 
 #include "htv.h"
+#include "store.h"
 
-/*! The HTV network address */
+/*! The HTV network address
+ * \deprecated read only to migrate old units, see store.c */
 uint16_t EEMEM EE_address;
 /*! The ~EE_address to check the correct value of the address */
 uint16_t EEMEM EE_naddress;
 
 /*! \brief store the address of the unit in EEPROM.
+ *
+ * \note the write is done in background, see store.c.
  */
 void htv_store_address(struct htv_t *htv)
 {
-	eeprom_write_word(&EE_address, htv->ee_addr);
-	eeprom_write_word(&EE_naddress, ~(htv->ee_addr));
+	store_set_address(htv->ee_addr);
 }
 
 /*! \brief initialize the htv struct */
@@ -47,11 +50,20 @@ struct htv_t *htv_init(struct htv_t *htv)
 	htv = malloc(sizeof(struct htv_t));
 	htv->substr = malloc(MAX_SUBSTR_LENGHT);
 	htv->x10str = malloc(MAX_CMD_LENGHT);
-	htv->ee_addr = eeprom_read_word(&EE_address);
+	htv->ee_addr = store_get_address();
+
+	/* unit not configured, check for an address stored
+	 * the old way and move it to the store.
+	 */
+	if (!htv->ee_addr) {
+		htv->ee_addr = eeprom_read_word(&EE_address);
+
+		/* check the if the network address is correct */
+		if (htv->ee_addr != (uint16_t)~(eeprom_read_word(&EE_naddress)))
+			htv->ee_addr = 0;
 
-	/* check the if the network address is correct */
-	if (htv->ee_addr != ~(eeprom_read_word(&EE_naddress)))
-		htv->ee_addr = 0;
+		htv_store_address(htv);
+	}
 
 	return(htv);
 }
@@ -138,8 +150,385 @@ void s10_to_htv(struct htv_t *htv)
 	htv->crc = strtoul(htv->substr, 0, 16);
 }
 
+/*! \brief NOOOONNNN to htv_t.
+ * \sa aaaa_to_htv */
+void s9_to_htv(struct htv_t *htv)
+{
+	/* old address */
+	strlcpy(htv->substr, htv->x10str + 1, 5);
+	htv->address = strtoul(htv->substr, 0, 16);
+	/* new address */
+	strlcpy(htv->substr, htv->x10str + 5, 5);
+	htv->value = strtoul(htv->substr, 0, 16);
+}
+
+/*! \brief NOOOONNNN:RR to htv_t.
+ * \sa aaaa_to_htv */
+void s12_to_htv(struct htv_t *htv)
+{
+	s9_to_htv(htv);
+	/* crc */
+	strlcpy(htv->substr, htv->x10str + 10, 3);
+	htv->crc = strtoul(htv->substr, 0, 16);
+}
+
+/*! \brief true if c is an hex digit. */
+static uint8_t htv_is_hex(const char c)
+{
+	return(((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f')) ||
+			((c >= 'A') && (c <= 'F')));
+}
+
+/*! \brief TAAAAPPCDDDD to htv_t.
+ * \sa aaaa_to_htv */
+void st12_to_htv(struct htv_t *htv)
+{
+	/* address */
+	strlcpy(htv->substr, htv->x10str + 1, 5);
+	htv->address = strtoul(htv->substr, 0, 16);
+	/* pin code */
+	strlcpy(htv->substr, htv->x10str + 5, 3);
+	htv->pin = strtoul(htv->substr, 0, 16);
+	/* cmd code */
+	strlcpy(htv->substr, htv->x10str + 7, 2);
+	htv->cmd = strtoul(htv->substr, 0, 16);
+	/* duration */
+	strlcpy(htv->substr, htv->x10str + 8, 5);
+	htv->value = strtoul(htv->substr, 0, 16);
+}
+
+/*! \brief TAAAAPPCDDDD:RR to htv_t.
+ * \sa aaaa_to_htv */
+void st15_to_htv(struct htv_t *htv)
+{
+	st12_to_htv(htv);
+	/* crc */
+	strlcpy(htv->substr, htv->x10str + 13, 3);
+	htv->crc = strtoul(htv->substr, 0, 16);
+}
+
+/*! \brief KIAAAASS:RR to htv_t.
+ * \sa aaaa_to_htv */
+void sk11_to_htv(struct htv_t *htv)
+{
+	/* master id */
+	strlcpy(htv->substr, htv->x10str + 1, 2);
+	htv->master = strtoul(htv->substr, 0, 16);
+	/* address */
+	strlcpy(htv->substr, htv->x10str + 2, 5);
+	htv->address = strtoul(htv->substr, 0, 16);
+	/* acknowledged sequence number */
+	strlcpy(htv->substr, htv->x10str + 6, 3);
+	htv->seq = strtoul(htv->substr, 0, 16);
+	/* crc */
+	strlcpy(htv->substr, htv->x10str + 9, 3);
+	htv->crc = strtoul(htv->substr, 0, 16);
+}
+
+/*! \brief the value of an hex digit. */
+static uint8_t htv_hex_value(const char c)
+{
+	if (c <= '9')
+		return(c - '0');
+
+	return((c | 0x20) - 'a' + 10);
+}
+
+/*! \brief check the state frame SNAAAAV..AAAAV.
+ * \return 0 if ok.
+ */
+static uint8_t htv_check_sync(struct htv_t *htv)
+{
+	uint8_t i, n;
+
+	n = htv_hex_value(*(htv->x10str + 1));
+
+	if (!n || (n > HTV_SYNC_MAX) || (strlen(htv->x10str) != 2 + n * 5U))
+		return(_BV(1));
+
+	for (i = 1; i < 2 + n * 5; i++)
+		if (!htv_is_hex(*(htv->x10str + i)))
+			return(_BV(2));
+
+	htv->type = HTV_TYPE_SYNC;
+	htv->address = 0xffff;
+	return(0);
+}
+
+/*! \brief check the firmware frame YBBBCCCC.
+ *
+ * The number of blocks goes in htv->value, the CRC of the
+ * image is left in the string, see boot.c. In the authenticated
+ * envelope the frame is YBBBMMMMMMMM, with the MAC of the image.
+ * \return 0 if ok.
+ */
+static uint8_t htv_check_boot(struct htv_t *htv)
+{
+	uint8_t i, len;
+
+	len = htv->auth ? HTV_BOOT_AUTH_LEN : HTV_BOOT_LEN;
+
+	if (strlen(htv->x10str) != len)
+		return(_BV(1));
+
+	for (i = 1; i < len; i++)
+		if (!htv_is_hex(*(htv->x10str + i)))
+			return(_BV(2));
+
+	strlcpy(htv->substr, htv->x10str + 1, 4);
+	htv->value = strtoul(htv->substr, 0, 16);
+	htv->type = HTV_TYPE_BOOT;
+	htv->address = 0xffff;
+	return(0);
+}
+
+/*! \brief true if the char starts a master envelope. */
+static uint8_t htv_is_envelope(const char c)
+{
+	return((c == HTV_TYPE_MASTER) || (c == HTV_TYPE_ACKREQ) ||
+			(c == HTV_TYPE_AUTH));
+}
+
+/*! \brief the lenght of the frame on the air.
+ *
+ * The lenght depends on the first char of the frame after the
+ * 'x', or on the first char after the envelope.
+ *
+ * \param s the chars received so far.
+ * \param n the number of chars in s, at least 1.
+ * \return the number of chars, crc included, 0 if unknown.
+ * If the value is greater than n it may change when more
+ * chars are received.
+ */
+uint8_t htv_frame_len(const char *s, const uint8_t n)
+{
+	uint8_t len, env;
+
+	if (htv_is_envelope(*s)) {
+		env = (*s == HTV_TYPE_AUTH) ? HTV_AUTH_LEN : HTV_MASTER_LEN;
+
+		/* the frame starts after the envelope */
+		if (n <= env)
+			return(env + 1);
+
+		/* no envelope, ack or block in the envelope */
+		if (htv_is_envelope(*(s + env)) || (*(s + env) == HTV_TYPE_ACK) ||
+				(*(s + env) == HTV_TYPE_BLOCK))
+			return(0);
+
+		len = htv_frame_len(s + env, n - env);
+
+		if (!len)
+			return(0);
+
+		/* the MAC in place of the crc, and the MAC of the image
+		 * in place of its CRC */
+		if (*s == HTV_TYPE_AUTH) {
+			if (*(s + env) == HTV_TYPE_BOOT)
+				len += HTV_BOOT_AUTH_LEN - HTV_BOOT_LEN;
+
+			return(env + len - 3 + HTV_MAC_LEN);
+		}
+
+		return(env + len);
+	}
+
+	if (htv_is_hex(*s))
+		return(10);
+
+	if (*s == HTV_TYPE_ADDR)
+		return(12);
+
+	if (*s == HTV_TYPE_TIMED)
+		return(15);
+
+	if (*s == HTV_TYPE_ACK)
+		return(HTV_ACK_LEN);
+
+	/* only in the envelope, which adds the :RR */
+	if (*s == HTV_TYPE_BOOT)
+		return(HTV_BOOT_LEN + 3);
+
+	if (*s == HTV_TYPE_BLOCK)
+		return(HTV_BLOCK_LEN);
+
+	if (*s == HTV_TYPE_SYNC) {
+		/* the number of remotes is the 2nd char */
+		if (n < 2)
+			return(2);
+
+		if (!htv_is_hex(*(s + 1)) || !htv_hex_value(*(s + 1)) ||
+				(htv_hex_value(*(s + 1)) > HTV_SYNC_MAX))
+			return(0);
+
+		return(2 + htv_hex_value(*(s + 1)) * 5 + 3);
+	}
+
+	return(0);
+}
+
+/*! \brief check the address of a frame as soon as it is complete.
+ *
+ * Only the address is looked at, the frame is not checked. The
+ * pin frames are for the address or the broadcast, the change
+ * address frame only for the old address, the acks are for the
+ * master. The state and the firmware frames have no single
+ * address and are always received.
+ *
+ * \param s the chars received so far.
+ * \param n the number of chars in s, at least 1.
+ * \param addr our address.
+ * \return HTV_ADDR_WAIT until the address is complete, then
+ * HTV_ADDR_MAYBE or HTV_ADDR_FOREIGN.
+ */
+uint8_t htv_addr_match(const char *s, const uint8_t n, const uint16_t addr)
+{
+	uint8_t i, start;
+	uint16_t a;
+
+	if (htv_is_envelope(*s)) {
+		start = (*s == HTV_TYPE_AUTH) ? HTV_AUTH_LEN : HTV_MASTER_LEN;
+
+		if (n <= start)
+			return(HTV_ADDR_WAIT);
+
+		return(htv_addr_match(s + start, n - start, addr));
+	}
+
+	if (*s == HTV_TYPE_ACK)
+		return(HTV_ADDR_FOREIGN);
+
+	if (htv_is_hex(*s))
+		start = 0;
+	else if ((*s == HTV_TYPE_TIMED) || (*s == HTV_TYPE_ADDR))
+		start = 1;
+	else
+		return(HTV_ADDR_MAYBE);
+
+	if (n < start + 4)
+		return(HTV_ADDR_WAIT);
+
+	a = 0;
+
+	for (i = start; i < start + 4; i++) {
+		if (!htv_is_hex(*(s + i)))
+			return(HTV_ADDR_FOREIGN);
+
+		a = (a << 4) | htv_hex_value(*(s + i));
+	}
+
+	if ((a == addr) || ((a == 0xffff) && (*s != HTV_TYPE_ADDR)))
+		return(HTV_ADDR_MAYBE);
+
+	return(HTV_ADDR_FOREIGN);
+}
+
+/*! \brief check and remove the envelope MIHSS<frame>:RR.
+ *
+ * The envelope QIHSS<frame>:RR is the same, the master also
+ * waits for an ack, see htv_t.ack.
+ *
+ * The crc of the whole string is checked, then the envelope and
+ * the crc are removed and only the inner frame without crc is
+ * left in the string.
+ *
+ * The authenticated envelope VIHCCCCCC<frame>:MMMMMMMM has the
+ * 24 bit counter in place of SS and the MAC in place of the crc,
+ * the MAC must be already in htv->mac, see rx_char(). The low
+ * byte of the counter is the sequence number.
+ *
+ * \return the same errors of htv_check_cmd().
+ */
+static uint8_t htv_check_envelope(struct htv_t *htv)
+{
+	uint8_t i, len, env, tail;
+
+	len = strlen(htv->x10str);
+
+	if (htv->auth) {
+		env = HTV_AUTH_LEN;
+		tail = HTV_MAC_LEN;
+	} else {
+		env = HTV_MASTER_LEN;
+		tail = 3;
+	}
+
+	/* at least MIHSS<char>:RR */
+	if ((len < env + 1 + tail) || (*(htv->x10str + len - tail) != ':'))
+		return(_BV(2));
+
+	for (i = 1; i < env; i++)
+		if (!htv_is_hex(*(htv->x10str + i)))
+			return(_BV(2));
+
+	if (htv->auth) {
+		strlcpy(htv->substr, htv->x10str + len - tail + 1, tail);
+
+		if (strtoul(htv->substr, 0, 16) != htv->mac)
+			return(_BV(3));
+
+		*(htv->x10str + len - tail) = 0;
+		strlcpy(htv->substr, htv->x10str + 3, 7);
+		htv->ctr = strtoul(htv->substr, 0, 16);
+		htv->seq = htv->ctr;
+	} else {
+		strlcpy(htv->substr, htv->x10str + len - 2, 3);
+		htv->crc = strtoul(htv->substr, 0, 16);
+		*(htv->x10str + len - 3) = 0;
+
+		if (htv->crc != crc8_str(htv->x10str))
+			return(_BV(3));
+
+		strlcpy(htv->substr, htv->x10str + 3, 3);
+		htv->seq = strtoul(htv->substr, 0, 16);
+	}
+
+	strlcpy(htv->substr, htv->x10str + 1, 2);
+	htv->master = strtoul(htv->substr, 0, 16);
+	strlcpy(htv->substr, htv->x10str + HTV_HOPS_IDX, 2);
+	htv->hops = strtoul(htv->substr, 0, 16);
+	memmove(htv->x10str, htv->x10str + env, len - env - tail + 1);
+	return(0);
+}
+
+/*! \brief convert to a fixed number of hex digits.
+ *
+ * \param s the string, digits + 1 chars.
+ * \param value the value to convert.
+ * \param digits number of digits, leading '0' are added.
+ * \return the string.
+ */
+char *htv_hex(char *s, uint16_t value, const uint8_t digits)
+{
+	uint8_t i, n;
+
+	for (i = digits; i; i--) {
+		n = value & 0x0f;
+		*(s + i - 1) = (n < 10) ? ('0' + n) : ('a' + n - 10);
+		value >>= 4;
+	}
+
+	*(s + digits) = 0;
+	return(s);
+}
+
+/*! \brief append the crc of the string, s becomes s:RR.
+ * \param s the string, with space for 3 more chars.
+ */
+void htv_crc_append(char *s)
+{
+	uint8_t len, crc;
+
+	len = strlen(s);
+	crc = crc8_str(s);
+	*(s + len) = ':';
+	htv_hex(s + len + 1, crc, 2);
+}
+
 /*! \brief check the validity of the x10str command string.
  *
+ * If the string is in an envelope, the envelope is checked and
+ * removed first, see htv_check_envelope().
  * Based on the string lenght, choose which protocol to check.
  * If cmd is not correct clear the cmd string and return FALSE
  * else if cmd is ok, modify cmd and keep only AAAAPPC.
@@ -150,7 +539,32 @@ void s10_to_htv(struct htv_t *htv)
 uint8_t htv_check_cmd(struct htv_t *htv)
 {
 	uint8_t err=0;
-	uint8_t crc;
+	uint8_t crc, env;
+
+	htv->type = HTV_TYPE_PIN;
+	htv->master = 0;
+	htv->hops = 0;
+	htv->ack = (*htv->x10str == HTV_TYPE_ACKREQ);
+	htv->auth = (*htv->x10str == HTV_TYPE_AUTH);
+	env = htv_is_envelope(*htv->x10str);
+
+	if (env)
+		err = htv_check_envelope(htv);
+
+	/* the state and the firmware frames have no crc of their own */
+	if (!err && (*htv->x10str == HTV_TYPE_SYNC))
+		err = env ? htv_check_sync(htv) : _BV(2);
+
+	if (!err && (*htv->x10str == HTV_TYPE_BOOT))
+		err = env ? htv_check_boot(htv) : _BV(2);
+
+	if (err || (htv->type == HTV_TYPE_SYNC) ||
+			(htv->type == HTV_TYPE_BOOT)) {
+		if (err)
+			*htv->x10str = 0;
+
+		return(err);
+	}
 
 	switch (strlen(htv->x10str)) {
 		/* simplified str without crc: AAAAP */
@@ -192,6 +606,73 @@ uint8_t htv_check_cmd(struct htv_t *htv)
 					err |= _BV(3);
 			}
 
+			break;
+		/* KIAAAASS:RR */
+		case 11:
+			/* check for "K" and ":" */
+			if ((*htv->x10str != HTV_TYPE_ACK) ||
+					(*(htv->x10str + 8) != ':')) {
+				err |= _BV(2);
+			} else {
+				htv->type = HTV_TYPE_ACK;
+				sk11_to_htv(htv);
+				*(htv->x10str + 8) = 0;
+				crc = crc8_str(htv->x10str);
+
+				/* crc error */
+				if (crc != htv->crc)
+					err |= _BV(3);
+			}
+
+			break;
+		/* NOOOONNNN */
+		case 9:
+			if (*htv->x10str != HTV_TYPE_ADDR) {
+				err |= _BV(2);
+			} else {
+				htv->type = HTV_TYPE_ADDR;
+				s9_to_htv(htv);
+			}
+
+			break;
+		/* NOOOONNNN:RR or TAAAAPPCDDDD */
+		case 12:
+			if (*htv->x10str == HTV_TYPE_TIMED) {
+				htv->type = HTV_TYPE_TIMED;
+				st12_to_htv(htv);
+			/* check for "N" and ":" */
+			} else if ((*htv->x10str != HTV_TYPE_ADDR) ||
+					(*(htv->x10str + 9) != ':')) {
+				err |= _BV(2);
+			} else {
+				htv->type = HTV_TYPE_ADDR;
+				s12_to_htv(htv);
+				*(htv->x10str + 9) = 0;
+				crc = crc8_str(htv->x10str);
+
+				/* crc error */
+				if (crc != htv->crc)
+					err |= _BV(3);
+			}
+
+			break;
+		/* TAAAAPPCDDDD:RR */
+		case 15:
+			/* check for "T" and ":" */
+			if ((*htv->x10str != HTV_TYPE_TIMED) ||
+					(*(htv->x10str + 12) != ':')) {
+				err |= _BV(2);
+			} else {
+				htv->type = HTV_TYPE_TIMED;
+				st15_to_htv(htv);
+				*(htv->x10str + 12) = 0;
+				crc = crc8_str(htv->x10str);
+
+				/* crc error */
+				if (crc != htv->crc)
+					err |= _BV(3);
+			}
+
 			break;
 		default:
 			/* strlen error */
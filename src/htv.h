@@ -23,22 +23,103 @@
 #define HTV_H
 
 /*! command's number of char */
-#define MAX_CMD_LENGHT 20
+#define MAX_CMD_LENGHT 42
 /*! helpfull substring max number of char */
 #define MAX_SUBSTR_LENGHT 10
 
 /*#define HTV_USE_RTX */
-/*! port where the rtx modules is connected */
-#define AU_PORT PORTA
-/*! data direction register */
-#define AU_DDR DDRA
-/*! enable tx pin connected to. */
-#define AU_ENABLE PA5
-/*! switch tx/rx pin connected to. */
-#define AU_TXRX PA6
+/*! receive with the Timer1 input capture instead of the USART,
+ * the data out of the module also on ICP1, see icp.c.
+ */
+/*#define HTV_USE_ICP */
+/*! a packet radio on the SPI instead of the module on the USART1,
+ * see rfm.c.
+ */
+/*#define HTV_USE_RFM */
+/*! master, a second radio module on a software UART, see suart.c.
+ */
+/*#define HTV_USE_SUART */
+/*! slave, echo every char received and check every frame, also
+ * the ones for other addresses, to watch the whole network.
+ */
+/*#define HTV_USE_MONITOR */
+/*! the benchmark command, 'M' on the master and 'm' on the slave
+ * console, see bench.c.
+ */
+/*#define HTV_USE_BENCH */
+/*! slave, the outputs on a chain of 74HC595 on the SPI instead
+ * of IO_PIN0 and IO_PIN1, see xio.c.
+ */
+/*#define HTV_USE_XIO */
+/* the pins of the rtx module are in board.h */
+
+/*! the pin number of all the pins */
+#define IO_PIN_ALL 0xff
+/*! pin command: off */
+#define IO_CMD_OFF 0
+/*! pin command: on */
+#define IO_CMD_ON 1
+/*! pin command: toggle */
+#define IO_CMD_TOGGLE 2
+/*! pin command: on for value ms, HTV_TYPE_TIMED only */
+#define IO_CMD_PULSE 3
+/*! pin command: on for value minutes, HTV_TYPE_TIMED only */
+#define IO_CMD_TIMED 4
+
+/*! frame type: set a pin, AAAAPPC:RR */
+#define HTV_TYPE_PIN 'P'
+/*! frame type: change address, NOOOONNNN:RR */
+#define HTV_TYPE_ADDR 'N'
+/*! frame type: command with a duration, TAAAAPPCDDDD:RR */
+#define HTV_TYPE_TIMED 'T'
+/*! envelope with the master id, MIHSS<frame>:RR */
+#define HTV_TYPE_MASTER 'M'
+/*! envelope asking the receiver for an ack, QIHSS<frame>:RR */
+#define HTV_TYPE_ACKREQ 'Q'
+/*! authenticated envelope, VIHCCCCCC<frame>:MMMMMMMM */
+#define HTV_TYPE_AUTH 'V'
+/*! number of chars of the authenticated envelope */
+#define HTV_AUTH_LEN 9
+/*! number of chars of the MAC, ':' included */
+#define HTV_MAC_LEN 9
+/*! frame type: ack from a receiver, KIAAAASS:RR */
+#define HTV_TYPE_ACK 'K'
+/*! number of chars of the ack frame, crc included */
+#define HTV_ACK_LEN 11
+/*! frame type: state of the remotes, SNAAAAV..AAAAV, only in the
+ * envelope */
+#define HTV_TYPE_SYNC 'S'
+/*! max number of remotes in a state frame */
+#define HTV_SYNC_MAX 4
+/*! frame type: a new firmware, YBBBCCCC, only in the envelope,
+ * see boot.c */
+#define HTV_TYPE_BOOT 'Y'
+/*! number of chars of the firmware frame */
+#define HTV_BOOT_LEN 8
+/*! number of chars of the firmware frame in the authenticated
+ * envelope, YBBBMMMMMMMM with the MAC of the image */
+#define HTV_BOOT_AUTH_LEN 12
+/*! frame type: a block of the firmware, ZBBBDD..DDCCCC, never in
+ * the envelope, see boot.c */
+#define HTV_TYPE_BLOCK 'Z'
+/*! number of chars of the block frame, 16 bytes of data */
+#define HTV_BLOCK_LEN 40
+/*! number of chars of the master envelope */
+#define HTV_MASTER_LEN 5
+/*! position of the hops in the master envelope */
+#define HTV_HOPS_IDX 2
+
+/*! htv_addr_match(): the address is not complete */
+#define HTV_ADDR_WAIT 0
+/*! htv_addr_match(): the frame can be for us */
+#define HTV_ADDR_MAYBE 1
+/*! htv_addr_match(): the frame is for someone else */
+#define HTV_ADDR_FOREIGN 2
 
 /*! structure of the data packet */
 struct htv_t {
+	/*! frame type, HTV_TYPE_* */
+	char type;
 	/*! full 16 bit address */
 	uint16_t address;
 	/*! pin code */
@@ -47,6 +128,22 @@ struct htv_t {
 	uint8_t cmd;
 	/*! crc */
 	uint8_t crc;
+	/*! argument of the frame, ex. the new address or the duration */
+	uint16_t value;
+	/*! id of the master which sent the frame */
+	uint8_t master;
+	/*! repeaters the frame can still go through */
+	uint8_t hops;
+	/*! sequence number of the frame from the master */
+	uint8_t seq;
+	/*! the master waits for an ack, HTV_TYPE_ACKREQ envelope */
+	uint8_t ack;
+	/*! authenticated frame, HTV_TYPE_AUTH envelope */
+	uint8_t auth;
+	/*! the counter of the authenticated frame */
+	uint32_t ctr;
+	/*! the MAC computed while receiving, see rx_char() */
+	uint32_t mac;
 	/*! x10 like string from the host */
 	char *x10str;
 	/*! string space used during conversion */
@@ -60,5 +157,9 @@ struct htv_t *htv_init(struct htv_t *htv);
 void htv_free(struct htv_t *htv);
 uint8_t crc8_str(const char *str);
 uint8_t htv_check_cmd(struct htv_t *htv);
+uint8_t htv_frame_len(const char *s, const uint8_t n);
+uint8_t htv_addr_match(const char *s, const uint8_t n, const uint16_t addr);
+char *htv_hex(char *s, uint16_t value, const uint8_t digits);
+void htv_crc_append(char *s);
 
 #endif
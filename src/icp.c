@@ -0,0 +1,190 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file icp.c
+ * \brief Radio receiver on the Timer1 input capture.
+ *
+ * An alternative to the USART for the receiver, see HTV_USE_ICP.
+ * The data out of the radio module, wired also to the ICP1 pin
+ * (PD6), is timed edge by edge with Timer1: the time between two
+ * edges gives the number of bits at the level before the edge.
+ *
+ * The bits are compared with the sync word, the RADIO_SYNC chars
+ * as they are on the air with their start and stop bits. When
+ * the sync word is found the chars are decoded from the same
+ * bits, the first bit after the sync is a bit boundary, and put
+ * in the rx buffer of the port 1 after the RADIO_SYNC, as if the
+ * USART had received them.
+ *
+ * The USART needs some chars to find the start bit of a char in
+ * the noise, a match of 22 bits does not, so the master sends only
+ * the sync word as header, see RADIO_HEAD, and the noise is never
+ * decoded.
+ *
+ * At 1200 bps a bit is 833 cpu cycles, the IRQ is called at most
+ * once per bit plus once every ICP_FLUSH bits of a line without
+ * edges.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "icp.h"
+#include "uart.h"
+#include "radio.h"
+
+/*! the sync word, the first bit on the air in the higher bit */
+static uint32_t icp_sync;
+/*! the last bits received, the newest in bit 0 */
+static uint32_t icp_sr;
+/*! ICR1 of the last edge or of the last flush */
+static uint16_t icp_last;
+/*! one of ICP_HUNT, ICP_IDLE, ICP_DATA */
+static uint8_t icp_state;
+/*! bits of the char, or idle bits */
+static uint8_t icp_n;
+/*! the char being received */
+static uint8_t icp_c;
+
+/*! \brief add the 8n2 bits of a char to the sync word. */
+static void icp_sync_char(const uint8_t c)
+{
+	uint8_t i;
+
+	/* the start bit */
+	icp_sync <<= 1;
+
+	for (i = 0; i < 8; i++)
+		icp_sync = (icp_sync << 1) | ((c >> i) & 1);
+
+	/* 2 stop bits */
+	icp_sync = (icp_sync << 2) | 3;
+}
+
+/*! \brief a bit of the line. */
+static void icp_bit(const uint8_t b)
+{
+	switch (icp_state) {
+		case ICP_HUNT:
+			icp_sr = (icp_sr << 1) | b;
+
+			if ((icp_sr & ((1UL << ICP_SYNC_BITS) - 1)) == icp_sync) {
+				uart_rx_put(1, RADIO_SYNC[0]);
+				uart_rx_put(1, RADIO_SYNC[1]);
+				icp_state = ICP_IDLE;
+				icp_n = 0;
+			}
+
+			break;
+		case ICP_IDLE:
+			if (!b) {
+				/* the start bit */
+				icp_state = ICP_DATA;
+				icp_n = 0;
+			} else if (++icp_n > ICP_IDLE_BITS) {
+				/* the transmission is over */
+				icp_state = ICP_HUNT;
+				icp_sr = 0;
+			}
+
+			break;
+		default:
+			if (icp_n < 8) {
+				/* LSB first */
+				icp_c = (icp_c >> 1) | (b ? 0x80 : 0);
+				icp_n++;
+			} else if (b) {
+				/* the stop bit, the 2nd one is idle */
+				uart_rx_put(1, icp_c);
+				icp_state = ICP_IDLE;
+				icp_n = 0;
+			} else {
+				/* framing error, sync lost */
+				icp_state = ICP_HUNT;
+				icp_sr = 0;
+			}
+	}
+}
+
+/*! \brief the bits of the time passed at the same level.
+ * \param level the level of the line.
+ * \param t Timer1 cycles from icp_last.
+ */
+static void icp_bits(const uint8_t level, uint16_t t)
+{
+	/* round to the nearest bit, glitches are 0 bits */
+	for (t += ICP_BIT / 2; t >= ICP_BIT; t -= ICP_BIT)
+		icp_bit(level);
+}
+
+/*! \brief start the receiver.
+ *
+ * Timer1 free running at clk/1, capture of the falling edge
+ * with the noise canceler.
+ */
+void icp_init(void)
+{
+	icp_sync = 0;
+	icp_sync_char(RADIO_SYNC[0]);
+	icp_sync_char(RADIO_SYNC[1]);
+	icp_state = ICP_HUNT;
+	icp_sr = 0;
+
+	/* PD6 input, no pull-up */
+	DDRD &= ~_BV(PD6);
+	PORTD &= ~_BV(PD6);
+
+	TCCR1A = 0;
+	TCCR1B = _BV(ICNC1) | _BV(CS10);
+	icp_last = TCNT1;
+	OCR1A = icp_last + ICP_FLUSH * ICP_BIT;
+	TIFR1 = _BV(ICF1) | _BV(OCF1A);
+	TIMSK1 = _BV(ICIE1) | _BV(OCIE1A);
+}
+
+/*! \brief stop the receiver. */
+void icp_stop(void)
+{
+	TIMSK1 = 0;
+	TCCR1B = 0;
+}
+
+/*! \brief an edge of the line. */
+ISR(TIMER1_CAPT_vect)
+{
+	uint16_t t;
+	uint8_t level;
+
+	t = ICR1;
+	/* waiting for a rising edge, the line was low */
+	level = bit_is_clear(TCCR1B, ICES1);
+	TCCR1B ^= _BV(ICES1);
+	/* the flag after the change of edge, and no flush now */
+	TIFR1 = _BV(ICF1) | _BV(OCF1A);
+	icp_bits(level, t - icp_last);
+	icp_last = t;
+	OCR1A = t + ICP_FLUSH * ICP_BIT;
+}
+
+/*! \brief no edges for ICP_FLUSH bits. */
+ISR(TIMER1_COMPA_vect)
+{
+	icp_bits(bit_is_clear(TCCR1B, ICES1), ICP_FLUSH * ICP_BIT);
+	icp_last += ICP_FLUSH * ICP_BIT;
+	OCR1A = icp_last + ICP_FLUSH * ICP_BIT;
+}
@@ -0,0 +1,46 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file icp.h
+  \brief Radio receiver on the Timer1 input capture.
+  */
+
+#ifndef ICP_H
+#define ICP_H
+
+#include <stdint.h>
+
+/*! cpu cycles of a bit on the air, Timer1 runs at clk/1 */
+#define ICP_BIT (F_CPU / UART_BAUD_1)
+/*! bits of the sync word, two 8n2 chars */
+#define ICP_SYNC_BITS 22
+/*! the bits of the line are pushed at least every ICP_FLUSH bits */
+#define ICP_FLUSH 11
+/*! bits of idle line after a char to look for the sync again */
+#define ICP_IDLE_BITS 33
+
+/*! looking for the sync word */
+#define ICP_HUNT 0
+/*! in sync, waiting for the start bit */
+#define ICP_IDLE 1
+/*! in sync, receiving a char */
+#define ICP_DATA 2
+
+void icp_init(void);
+void icp_stop(void);
+
+#endif
@@ -22,58 +22,20 @@
 #include <util/delay.h>
 #include "led.h"
 
-/*! \brief turn on, off and blink a led or both.
+/*! \brief blink a led or both, NONE is both.
  *
- * \param led RED, GREEN, BOTH, NONE.
- * \param status ON, OFF, BLINK */
-void led_set(const uint8_t led, const uint8_t status)
+ * \param led RED, GREEN, BOTH, NONE. */
+void led_blink(const uint8_t led)
 {
-	switch (status) {
-		case OFF:
-			/* led_set(NONE, OFF); */
-
-			if ((led == RED) || (led == BOTH))
-				LED_PORT |= _BV(LED_RED);
-
-			if ((led == GREEN) || (led == BOTH))
-				LED_PORT |= _BV(LED_GREEN);
-
-			break;
-		case ON:
-			/* led_set(NONE, OFF); */
-
-			if ((led == RED) || (led == BOTH))
-				 LED_PORT &= ~_BV(LED_RED);
-
-			if ((led == GREEN) || (led == BOTH))
-				LED_PORT &= ~_BV(LED_GREEN);
-
-			break;
-		case BLINK:
-			LED_DELAY;
-
-			switch (led) {
-				case RED:
-					led_set(RED, ON);
-					break;
-				case GREEN:
-					led_set(GREEN, ON);
-					break;
-				default:
-					led_set(BOTH, ON);
-			}
-
-			LED_DELAY;
-			led_set(NONE, OFF);
-			break;
-		default:
-			LED_PORT |= (_BV(LED_RED) | _BV(LED_GREEN));
-	}
+	LED_DELAY;
+	led_set(led ? led : BOTH, ON);
+	LED_DELAY;
+	led_set(BOTH, OFF);
 }
 
 /*! \brief initialize the port and turn both led on. */
 void led_init(void)
 {
-	LED_DDR |= (_BV(LED_RED) | _BV(LED_GREEN));
+	LED_DDR |= LED_BITS(BOTH);
 	led_set(BOTH, ON);
 }
@@ -21,16 +21,9 @@
 #define LED_H
 
 #include <stdint.h>
-#include <avr/io.h>
-
-/*! the port where led are connected. */
-#define LED_PORT PORTB
-/*! the data direction register. */
-#define LED_DDR DDRB
-/*! red led pin */
-#define LED_RED PB2
-/*! green led pin */
-#define LED_GREEN PB3
+
+#include "board.h"
+
 /*! the delay function used in blink. */
 #define LED_DELAY _delay_ms(200)
 
@@ -45,7 +38,32 @@
 #define GREEN 2
 #define BOTH 3
 
-void led_set(const uint8_t led, const uint8_t status);
+/*! the pins of the leds, see board.h */
+#define LED_BITS(led) ((((led) & RED) ? _BV(LED_RED) : 0) | \
+		(((led) & GREEN) ? _BV(LED_GREEN) : 0))
+
+void led_blink(const uint8_t led);
 void led_init(void);
 
+/*! \brief turn on, off and blink a led or both.
+ *
+ * Inline, with constant arguments it is a single instruction.
+ * The leds are on with the pin low.
+ *
+ * \param led RED, GREEN, BOTH, NONE.
+ * \param status ON, OFF, BLINK */
+static inline void led_set(const uint8_t led, const uint8_t status)
+{
+	switch (status) {
+		case ON:
+			LED_PORT &= ~LED_BITS(led);
+			break;
+		case BLINK:
+			led_blink(led);
+			break;
+		default:
+			LED_PORT |= LED_BITS(led);
+	}
+}
+
 #endif
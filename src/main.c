@@ -28,10 +28,37 @@
  *
  * \ref txrxproto
  *
+ * \section secsim Channel simulator:
+ * The sim directory builds, on the host, a simulator of the radio
+ * channel with the real transmit.c, receive.c and htv.c code, see
+ * sim/sim.c. It measures the goodput, the latency and the crc8
+ * false accept rate with noise, burst, dropped chars and
+ * collisions between masters.
+ *
+ * \section sechost Host daemon:
+ * The host directory builds onewayd, a Linux daemon which owns
+ * the serial link to the master and serves many clients on a
+ * unix socket, the client library libowclient and owctl. The
+ * daemon sends only the changed states, the last one for every
+ * address and pin, paced to the radio capacity, see
+ * host/onewayd.c. host/fakemaster.c is a pty stand-in of the
+ * master to run it without the hardware.
+ *
+ * \section secboot Boot sequence:
+ * The slave restores its outputs and starts listening before
+ * printing anything, the time from reset to listening is
+ * measured with Timer1 and printed with the boot message.
+ *
+ * \note the time spent by the cpu in reset, set by the SUT fuses,
+ * is not included. With the BOD enabled the shortest start-up
+ * time can be used.
  */
 
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
 #include "led.h"
 #include "debug.h"
+#include "store.h"
 
 #ifdef SLAVE
 #include "receive.h"
@@ -46,8 +73,19 @@ int main(void)
 {
 	struct debug_t *debug;
 
+	/* the watchdog is still on after its reset, see set_boot() */
+	MCUSR = 0;
+	wdt_disable();
+
+#ifdef SLAVE
+	/* count the cpu cycles from reset, see slave() */
+	TCCR1B = _BV(CS10);
+#endif
+
 	/* Init sequence, turn on both led */
 	led_init();
+	store_init();
+	sei();
 	debug = debug_init();
 	led_set(BOTH, OFF);
 
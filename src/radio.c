@@ -0,0 +1,351 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file radio.c
+ * \brief The radio, the physical layer of master and slaves.
+ *
+ * The master sends the frames from the host and listens for the
+ * acks, a slave receives the frames and sends the acks and, in
+ * repeater mode, again the frames it hears. All of them see the
+ * radio as a stream of chars: a transmission is opened, the frames
+ * are sent with the RADIO_SYNC in between and it is closed, the
+ * chars received come out of radio_getchar().
+ *
+ * Two backends:
+ * - the AM module on the serial port 1, with the AU_TXRX and
+ *   AU_ENABLE pins of the transceiver (HTV_USE_RTX), the receiver
+ *   can be the Timer1 input capture (HTV_USE_ICP), see icp.c.
+ * - a packet radio on the SPI (HTV_USE_RFM), see rfm.c.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "radio.h"
+#include "icp.h"
+
+/*! tick_ms() when the transmitter was keyed up, or when the
+ * last frame ended while it is held. */
+static uint16_t radio_on;
+/*! ms on the air of the last transmission. */
+static uint16_t radio_air;
+/*! the transmitter is still keyed after radio_hold() */
+static uint8_t radio_held;
+
+/*! \brief set up the pins and the port of the radio, the receiver
+ * is off.
+ */
+void radio_init(void)
+{
+#ifdef HTV_USE_RFM
+	rfm_init();
+#else
+#ifdef HTV_USE_RTX
+	AU_DDR |= _BV(AU_ENABLE) | _BV(AU_TXRX);
+#endif
+	uart_init(1);
+#endif
+}
+
+/*! \brief turn the receiver on or off.
+ * \param state RADIO_RX or RADIO_OFF.
+ * \note with HTV_USE_ICP the chars are received by icp.c,
+ * which takes the Timer1.
+ */
+void radio_power(const uint8_t state)
+{
+#ifdef HTV_USE_RFM
+	rfm_mode((state == RADIO_RX) ? RFM_MODE_RX : RFM_MODE_SLEEP);
+#else
+	if (state == RADIO_OFF) {
+#ifdef HTV_USE_ICP
+		icp_stop();
+#else
+		uart_rx(1, 0);
+#endif
+		return;
+	}
+
+#ifdef HTV_USE_RTX
+	/* the rx sequence of the transceiver, see its datasheet */
+	AU_PORT |= _BV(AU_ENABLE);
+	_delay_us(20);
+	AU_PORT |= _BV(AU_TXRX);
+	_delay_us(200);
+	AU_PORT &= ~_BV(AU_TXRX);
+	_delay_us(40);
+	AU_PORT &= ~_BV(AU_ENABLE);
+	_delay_us(20);
+	AU_PORT |= _BV(AU_ENABLE);
+	_delay_us(200);
+#endif
+
+#ifdef HTV_USE_ICP
+	icp_init();
+#else
+	uart_rx(1, 1);
+#endif
+#endif
+}
+
+/*! \brief a char received.
+ * \param locked wait for a char, see uart_getchar().
+ * \return the char or 0.
+ */
+char radio_getchar(const uint8_t locked)
+{
+	/* every backend puts the chars in the rx buffer of the port 1 */
+	return(uart_getchar(1, locked));
+}
+
+/*! \brief drop the chars received. */
+void radio_flush(void)
+{
+	uart_flush(1);
+}
+
+#ifndef HTV_USE_RFM
+/*! \brief Enable TX signal. */
+static void radio_start_tx(void)
+{
+	/*! Enable the serial port */
+	uart_tx(1, 1);
+	/*! Enable the transmit pin on the rtx only module
+	as described in the datasheet with delay timing. */
+	AU_PORT |= _BV(AU_TXRX);
+	_delay_us(400);
+
+	/*! add another delay for opening the squelch in the receiver. */
+	_delay_ms(10);
+}
+
+/*! \brief Disable TX signal */
+static void radio_stop_tx(void)
+{
+	uart_tx(1, 0);
+	AU_PORT &= ~_BV(AU_TXRX);
+	_delay_us(400);
+}
+#endif
+
+/*! \brief ms on the air of the last transmission.
+ *
+ * The time between radio_open() and radio_close(), the
+ * squelch delay included, or radio_hold().
+ */
+uint16_t radio_airtime(void)
+{
+	return(radio_air);
+}
+
+/*! \brief estimate the ms on the air of a transmission.
+ * \param chars the chars sent after the header.
+ */
+uint16_t radio_airtime_est(const uint8_t chars)
+{
+	return(RADIO_KEY_MS + (sizeof(RADIO_HEAD) - 1 + chars) *
+			RADIO_CHAR_US / 1000);
+}
+
+#ifdef HTV_USE_RTX
+/*! \brief listen to the channel.
+ *
+ * Two consecutive chars which can be part of a frame mean that
+ * someone else is transmitting, the noise rarely does it. The
+ * packet radio measures the power on the channel.
+ *
+ * The chars are only looked at, they stay in the rx buffer for
+ * the receiver, ex. a repeater waiting to relay gets the frames
+ * heard meanwhile. A full buffer is flushed, the new chars
+ * would be lost and the channel would look free.
+ *
+ * \return true if the channel is busy.
+ */
+#ifdef HTV_USE_RFM
+static uint8_t radio_busy(void)
+{
+	uint16_t start;
+
+	start = tick_ms();
+
+	while (!tick_elapsed(start, RADIO_LBT_MS))
+		if (rfm_busy())
+			return(1);
+
+	return(0);
+}
+#else
+static uint8_t radio_busy(void)
+{
+	uint16_t start;
+	uint8_t n, i;
+	char c;
+
+	start = tick_ms();
+	i = uart_rx_head(1);
+	n = 0;
+
+	while (!tick_elapsed(start, RADIO_LBT_MS)) {
+		if (uart_rx_full(1)) {
+			uart_flush(1);
+			i = uart_rx_head(1);
+		}
+
+		if (i == uart_rx_head(1))
+			continue;
+
+		c = uart_rx_peek(1, i);
+		i = (i + 1) & UART_RXBUF_MASK;
+
+		if ((c == 'x') || (c == ':') || htv_frame_len(&c, 1))
+			n++;
+		else
+			n = 0;
+
+		if (n > 1)
+			return(1);
+	}
+
+	return(0);
+}
+#endif
+
+/*! \brief listen before talk.
+ *
+ * If the channel is busy wait a random time, longer for
+ * higher id, and listen again.
+ *
+ * \param id [0:f] the backoff of this unit.
+ * \note the tick must be running, see tick_init().
+ */
+void radio_lbt(const uint8_t id)
+{
+	uint16_t start;
+
+	while (radio_busy()) {
+		start = tick_ms();
+
+		while (!tick_elapsed(start, (id + 1) * RADIO_LBT_MS +
+					(start & 0x3f)));
+	}
+}
+#endif
+
+/*! \brief start a transmission and send the header.
+ *
+ * More frames can follow back to back, each one after the
+ * RADIO_SYNC, the channel must be already checked by the caller.
+ * If the transmitter is still keyed, see radio_hold(), only the
+ * RADIO_SYNC is sent and the time it was held is on the air of
+ * this transmission.
+ */
+void radio_open(void)
+{
+	if (radio_held) {
+		radio_held = 0;
+		uart_printstr(1, RADIO_SYNC);
+		return;
+	}
+
+	led_set(RED, ON);
+	radio_on = tick_ms();
+#ifdef HTV_USE_RFM
+	rfm_open();
+#else
+	radio_start_tx();
+	uart_printstr(1, RADIO_HEAD);
+#endif
+}
+
+/*! \brief send a frame or the RADIO_SYNC. */
+void radio_puts(const char *s)
+{
+#ifdef HTV_USE_RFM
+	rfm_puts(s);
+#else
+	uart_printstr(1, s);
+#endif
+}
+
+/*! \brief end the transmission. */
+void radio_close(void)
+{
+#ifdef HTV_USE_RFM
+	rfm_close();
+#else
+	_delay_ms(1);
+	radio_stop_tx();
+#endif
+	radio_air = tick_ms() - radio_on;
+	led_set(RED, OFF);
+}
+
+/*! \brief end the transmission but keep the transmitter keyed.
+ *
+ * The next radio_open() does not pay the key up, the squelch
+ * delay and the header again. The carrier stays on the air until
+ * radio_release(), the ms up to now are the airtime of this
+ * transmission, the rest goes to the next one. The packet radio
+ * has no squelch, it is closed.
+ */
+void radio_hold(void)
+{
+#ifdef HTV_USE_RFM
+	radio_close();
+#else
+	_delay_ms(1);
+	radio_air = tick_ms() - radio_on;
+	radio_on = tick_ms();
+	radio_held = 1;
+#endif
+}
+
+/*! \brief key down the transmitter held by radio_hold().
+ * \param hang ms it is held after the last frame, 0 key down now.
+ * \return true if it has been keyed down, its last ms on the air
+ * are in radio_airtime().
+ */
+uint8_t radio_release(const uint16_t hang)
+{
+	if (!radio_held || (hang && !tick_elapsed(radio_on, hang)))
+		return(0);
+
+	radio_held = 0;
+	radio_close();
+	return(1);
+}
+
+/*! \brief true if the transmitter is held keyed, see radio_hold(). */
+uint8_t radio_keyed(void)
+{
+	return(radio_held);
+}
+
+/*! \brief transmit a string on the air.
+ *
+ * The string is sent with the header, the channel must be
+ * already checked by the caller.
+ *
+ * \param str the string to be sent.
+ */
+void radio_send(const char *str)
+{
+	radio_open();
+	radio_puts(str);
+	radio_close();
+}
@@ -0,0 +1,81 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file radio.h
+  \brief The radio, the physical layer of master and slaves.
+  */
+
+#ifndef RADIO_H
+#define RADIO_H
+
+#include "led.h"
+#include "uart.h"
+#include "htv.h"
+#include "tick.h"
+#include "rfm.h"
+
+/*! listen before talk, ms of silence needed. */
+#define RADIO_LBT_MS 25
+#ifdef HTV_USE_RFM
+/*! time on the air of a char, us. */
+#define RADIO_CHAR_US (8000000UL / RFM_BITRATE)
+/*! time on the air of the mode changes, preamble, sync and crc, ms. */
+#define RADIO_KEY_MS 2
+#else
+/*! time on the air of a char, us, 8n2 is 11 bits. */
+#define RADIO_CHAR_US (11000000UL / UART_BAUD_1)
+/*! time on the air to key the transmitter up and down, ms. */
+#define RADIO_KEY_MS 12
+#endif
+
+/*! radio_power(): the receiver is off */
+#define RADIO_OFF 0
+/*! radio_power(): the receiver is on */
+#define RADIO_RX 1
+
+#if defined(HTV_USE_RFM) && defined(HTV_USE_ICP)
+#error HTV_USE_ICP is a receiver of the module on the USART1
+#endif
+
+#ifdef HTV_USE_ICP
+/*! the header of the packet to tx, the sync word only, see icp.c */
+#define RADIO_HEAD "xx"
+#else
+/*! the header of the packet to tx */
+#define RADIO_HEAD "xxxxxx"
+#endif
+/*! the sync between frames sent back to back */
+#define RADIO_SYNC "xx"
+
+void radio_init(void);
+void radio_power(const uint8_t state);
+char radio_getchar(const uint8_t locked);
+void radio_flush(void);
+#ifdef HTV_USE_RTX
+void radio_lbt(const uint8_t id);
+#endif
+void radio_open(void);
+void radio_puts(const char *s);
+void radio_close(void);
+void radio_hold(void);
+uint8_t radio_release(const uint16_t hang);
+uint8_t radio_keyed(void);
+void radio_send(const char *str);
+uint16_t radio_airtime(void);
+uint16_t radio_airtime_est(const uint8_t chars);
+
+#endif
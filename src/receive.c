@@ -23,20 +23,39 @@
  * from master tx -> slave rx:
  * - a serial string at 1200 bps, none parity, 8 bit, 1 bit stop.
  *
- * The module will display any char received on the console, connected
- * to the serial port 1, within the range ascii from 32 to 128.
+ * The frames for other addresses are dropped as soon as their
+ * address is received, without checking or printing them, only
+ * the frames which can be for us are received whole, checked,
+ * printed on the console and executed, see htv_addr_match().
  *
- * It is possible in this way to monitor constantly the whole network,
- * but only those messages directed to broadcast or to us will be
- * executed.
+ * With HTV_USE_MONITOR the module displays any char received on
+ * the console, connected to the serial port 0, within the range
+ * ascii from 32 to 128, and checks every frame. It is possible in
+ * this way to monitor constantly the whole network, but only those
+ * messages directed to broadcast or to us will be executed.
  *
  * \section secrxcmd Sections:
  * - \ref subrxacmd
+ * - \ref subrxhcmd
+ * - \ref subrxbcmd
+ * - \ref subrxrcmd
  * - \ref subrxpcmd
+ * - \ref subrxmcmd
+ * - \ref subrxncmd
+ * - \ref subrxtcmd
+ * - \ref subrxkcmd
+ * - \ref subrxwcmd
+ * - \ref subrxvcmd
+ * - \ref subrxkeycmd
+ * - \ref subrxycmd
+ *
+ * Console commands are terminated by '\\r' or '\\n', see cmd.c.
  *
  * \subsection subrxacmd a - change the address of the receiver.
  *
- * This command must be entered from the console.
+ * This command must be entered from the console. The frames are
+ * received and executed during the dialog, the new address is used
+ * from the first frame after the confirm.
  *
  * example:
  *
@@ -45,6 +64,41 @@
  * <- - the address is in HEX, use digit from 0 to f\n
  * <- - do not use 0000 or ffff as address\n
  * <- Enter the 4 digit address [0001 - fffe]:\n
+ * -> 012f\n
+ * <- New address: 0x12f\n
+ * <- confirm? (y/n)\n
+ * -> y\n
+ * <- Address changed and saved.\n
+ *
+ * \subsection subrxhcmd ? - help command.
+ *
+ * Print the console commands.
+ *
+ * \subsection subrxkeycmd k - key of the authenticated frames.
+ * k:KKKKKKKKKKKKKKKKKKKKKKKKKKKKKKKK
+ *
+ * where:
+ * - K are the 16 bytes of the key in hex, the same of the master,
+ *   see \ref subucmd. All ff removes the key.
+ *
+ * With a key only the authenticated frames are executed, see
+ * \ref subrxvcmd.
+ *
+ * \subsection subrxbcmd m - benchmark.
+ *
+ * Only with HTV_USE_BENCH, the same tests of the master 'M'
+ * command, see bench.c, without the build of the P frame.
+ *
+ * \subsection subrxrcmd r - repeater on off.
+ * r:X
+ *
+ * where:
+ * - X can be '0' or '1', 0 - normal receiver, 1 - repeater.
+ *
+ * Only with the transceiver (HTV_USE_RTX). A repeater sends again,
+ * after a random delay and listening before talking, every new
+ * frame in the envelope which has hops left. The setting is kept
+ * across a reset.
  *
  * \subsection subrxpcmd TxRx protocol definition.
  * The received string must be in the form:
@@ -52,17 +106,22 @@
  * xx[x..x]AAAAPPC:RR
  *
  * where
- * - at least 2 'x' sync char must be received.
+ * - at least 2 'x' sync char must be received, with HTV_USE_ICP
+ *   the master sends only 2, see icp.c.
  * - AAAA is the address ascii - hex from 0000 to FFFF where:
  *   - 0000 unconfigured device.
  *   - FFFF is broadcast address.
  * - PP is the pin number in Ascii/hex form from 00 to FF where:
  *   - 00 - i/o pin 0
  *   - 01 - i/o pin 1
- *   - FF - All pin
+ *   - FF - All pin, not with the commands 3 and 4.
+ *
+ *   With HTV_USE_XIO the pins are the outputs of a chain of
+ *   74HC595, from 00 to XIO_PINS - 1, see xio.c.
  * - C is the command in ascii/hex where:
  *   - 0 is off.
  *   - 1 is on.
+ *   - 2 is toggle.
  * - RR is an 8 bit checksum of the whole string.
  *
  * example
@@ -71,63 +130,194 @@
  * <- Received: 0123011 OK\n
  * <- Action: Pin1 enable
  *
- * \note any command on the air will be checked and displayed, but
- * only those for us will be executed.
+ * \subsection subrxmcmd Master envelope.
+ * Every frame can be sent in the envelope:
+ *
+ * xx[x..x]MIHSS<frame>:RR
+ *
+ * where
+ * - M is the char 'M'.
+ * - I is the id of the master which sent the frame [0:f].
+ * - H is the number of repeaters the frame can still go
+ *   through [0:f], every repeater decreases it.
+ * - SS is the sequence number of the frame from this master.
+ * - <frame> is any frame without its own :RR.
+ * - RR is an 8 bit checksum of the whole string.
+ *
+ * The master id and the sequence number identify the frame, the
+ * copies received in the next RX_SEEN_MS are printed as "copy"
+ * and not executed.
+ *
+ * example
+ *
+ * -> xxxM2107a0123011:?? (the value of RR unknown here)\n
+ *
+ * \subsection subrxncmd Change address frame.
+ * Sent by the master 'A' command, the string must be in the form:
+ *
+ * xx[x..x]NOOOONNNN:RR
+ *
+ * where
+ * - N is the char 'N'.
+ * - OOOO is the old address, only the receiver with this address
+ *   will change it.
+ * - NNNN is the new address, 0000 and FFFF are refused.
+ * - RR is an 8 bit checksum of the whole string.
+ *
+ * \subsection subrxtcmd Command with a duration.
+ * Sent by the master 'P:AAAA:PP:C:DDDD' command, the string must be
+ * in the form:
+ *
+ * xx[x..x]TAAAAPPCDDDD:RR
+ *
+ * where
+ * - T is the char 'T'.
+ * - AAAA and PP are the same of the AAAAPPC frame.
+ * - C is the command in ascii/hex where:
+ *   - 3 is a pulse, on for DDDD ms.
+ *   - 4 is on for DDDD minutes, then off.
+ *   - 0, 1 and 2 are the same of the AAAAPPC frame.
+ * - DDDD is the duration, hex.
+ * - RR is an 8 bit checksum of the whole string.
+ *
+ * The receiver switches the pin off by itself when the time is
+ * over, any other command to the pin cancels the timer. A pin on a
+ * timer is saved off, it does not stay on after a power loss. Up
+ * to IO_TIMERS pins can be on a timer, the command is refused
+ * when they are all in use.
+ *
+ * \subsection subrxkcmd Ack.
+ * With the transceiver (HTV_USE_RTX), a frame in the envelope
+ *
+ * xx[x..x]QIHSS<frame>:RR
+ *
+ * the same of MIHSS<frame>:RR, is acknowledged by the receiver with
+ * the address of the frame, not the broadcast, with:
+ *
+ * xx[x..x]KIAAAASS:RR
+ *
+ * where
+ * - K is the char 'K'.
+ * - I is the id of the master.
+ * - AAAA is the address of the frame.
+ * - SS is the sequence number of the frame.
+ * - RR is an 8 bit checksum of the whole string.
+ *
+ * The ack is sent RX_ACK_MS after the frame without listening
+ * to the channel. A copy of the frame is not executed but it is
+ * acknowledged again, the master repeats the frame when the ack
+ * is lost. The acks are not repeated, the receiver must hear
+ * the master directly.
+ *
+ * \subsection subrxwcmd State frame.
+ * Sent by the master in background, see \ref subwcmd, only in the
+ * envelope:
+ *
+ * xx[x..x]MIHSSSNAAAAV[AAAAV..]:RR
+ *
+ * where
+ * - S is the char 'S'.
+ * - N is the number of remotes in the frame [1:4].
+ * - AAAA is the address of a remote.
+ * - V is the state of its pins in hex, the bit 0 and 1 are the
+ *   state of the pin 0 and 1, the bit 2 and 3 tell which pins
+ *   the master knows.
+ *
+ * The receiver applies only the known pins of its own address,
+ * a pin on a timer is left alone. With more masters a pin takes
+ * the state only from the master of its last command, a pin
+ * never commanded since the reset or last commanded by a frame
+ * without the envelope takes it from any master.
+ *
+ * example
+ *
+ * -> xxxM0003S2012f50130c:?? (the value of RR unknown here)\n
+ *
+ * the pin 0 of 012f on, both pins of 0130 off.
  *
+ * \subsection subrxvcmd Authenticated frames.
+ * When the master has a key every frame is sent in the envelope:
+ *
+ * xx[x..x]VIHCCCCCC<frame>:MMMMMMMM
+ *
+ * where
+ * - V is the char 'V'.
+ * - I and H are the same of MIHSS.
+ * - CCCCCC is the 24 bit counter of the master, it grows with
+ *   every frame, its low byte is the sequence number.
+ * - <frame> is any frame without its own :RR.
+ * - MMMMMMMM is the MAC of the whole string before the ':',
+ *   with H as '0', see auth.c.
+ *
+ * A receiver with the same key executes only these frames, with a
+ * good MAC and a counter higher than the last one from the master
+ * id. The frames with an old counter are printed as " Error 20".
+ * The authenticated frames are not acknowledged.
+ *
+ * \subsection subrxycmd Firmware update.
+ * Sent by the master, see \ref subbcmd, the image in the envelope:
+ *
+ * xx[x..x]MIHSSYBBBCCCC:RR or, with a key,
+ * xx[x..x]VIHCCCCCCYBBBMMMMMMMM:MMMMMMMM
+ *
+ * and its blocks, never in the envelope:
+ *
+ * xx[x..x]ZBBBDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDCCCC
+ *
+ * where
+ * - Y and Z are the chars 'Y' and 'Z'.
+ * - BBB is the number of blocks of the image, or the block.
+ * - CCCC is the CRC-CCITT of the image, or of the block frame
+ *   before the CCCC.
+ * - MMMMMMMM after BBB is the MAC of the image with the key, see
+ *   auth_flash(), the boot loader checks it before the image
+ *   is run, a block sent by someone else can not pass. The
+ *   receiver computes the MAC of its own image a block per pass
+ *   of the main loop, the frames keep being received meanwhile,
+ *   and resets when it is done and different.
+ * - DD.. are the 16 bytes of the block.
+ *
+ * A receiver running a different image sets the boot loader to
+ * receive the update and resets, the blocks are received only by
+ * the boot loader, see boot.c. The outputs are off during the
+ * update.
+ *
+ * \note with HTV_USE_MONITOR any command on the air will be checked
+ * and displayed, but only those for us will be executed.
+ *
+ * The status of the i/o pins is saved in EEPROM and restored at
+ * power up, every output also with HTV_USE_XIO, see io_store().
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include <avr/io.h>
 #include <avr/eeprom.h>
+#include <avr/wdt.h>
 #include <util/delay.h>
 
 #include "receive.h"
 
-/*! \brief enable the RX module and related serial port.
- * \note if RTX moduled is used, then a more complicated
- * init sequence must be used.
- */
-void start_rx(void)
-{
-#ifdef HTV_USE_RTX
-	AU_PORT |= _BV(AU_ENABLE);
-	_delay_us(20);
-	AU_PORT |= _BV(AU_TXRX);
-	_delay_us(200);
-	AU_PORT &= ~_BV(AU_TXRX);
-	_delay_us(40);
-	AU_PORT &= ~_BV(AU_ENABLE);
-	_delay_us(20);
-	AU_PORT |= _BV(AU_ENABLE);
-	_delay_us(200);
-#endif
-
-	uart_rx(1, 1);
-}
-
-/*! \brief shutdown the receiver.
- *
- * \todo implement the pin sequence for rtx module.
- */
-void stop_rx(void)
-{
-	uart_rx(1, 0);
-}
+/*! cpu cycles from reset to the receiver listening. */
+uint16_t rx_boot_cycles;
 
 /*! \brief get a char from the RX and echo it on the console.
- * \return the received char.
- * \note only char from ascii 32 to 128 are printed back.
+ * \param locked wait for a char, see uart_getchar().
+ * \return the received char or 0.
+ * \note only char from ascii 32 to 128 are printed back, and only
+ * with HTV_USE_MONITOR.
  */
-char get_char_echo(void)
+char get_char_echo(const uint8_t locked)
 {
 	char c;
 
-	c = uart_getchar(1, 1);
+	c = radio_getchar(locked);
 
+#ifdef HTV_USE_MONITOR
 	/* print it if it is readable */
 	if ((c > 32) && (c < 128))
 		uart_putchar(0, c);
+#endif
 	/*
 	   else
 	   uart_putchar(0, '*');
@@ -136,25 +326,250 @@ char get_char_echo(void)
 	return(c);
 }
 
+#ifdef HTV_USE_XIO
+/*! \brief the state of an output, 1 on. */
+static uint8_t io_get(const uint8_t pin)
+{
+	return(xio_get(pin));
+}
+
+/*! \brief change an output, see io_commit(). */
+static void io_put(const uint8_t pin, const uint8_t on)
+{
+	xio_put(pin, on);
+}
+
+/*! \brief send the changed outputs to the chain, all together. */
+static void io_commit(void)
+{
+	xio_flush();
+}
+#else
+/*! \brief the IO_PORT bit of an output. */
+static uint8_t io_bit(const uint8_t pin)
+{
+	return(_BV(pin ? IO_PIN1 : IO_PIN0));
+}
+
+/*! \brief the state of an output, 1 on. */
+static uint8_t io_get(const uint8_t pin)
+{
+	return((IO_PORT & io_bit(pin)) ? 1 : 0);
+}
+
+/*! \brief change an output. */
+static void io_put(const uint8_t pin, const uint8_t on)
+{
+	if (on)
+		IO_PORT |= io_bit(pin);
+	else
+		IO_PORT &= ~io_bit(pin);
+}
+
+/*! \brief nothing, IO_PORT is already changed. */
+static void io_commit(void)
+{
+}
+#endif
+
+/*! the timers in use, a bit every timer */
+static uint8_t io_timed;
+/*! the output of the timer i */
+static uint8_t io_pin[IO_TIMERS];
+/*! tick_ms32() when the output of the timer i must go off. */
+static uint32_t io_off[IO_TIMERS];
+
+/*! \brief the timer of an output, IO_TIMERS if it has none. */
+static uint8_t io_timer(const uint8_t pin)
+{
+	uint8_t i;
+
+	for (i = 0; i < IO_TIMERS; i++)
+		if ((io_timed & _BV(i)) && (io_pin[i] == pin))
+			break;
+
+	return(i);
+}
+
+/*! \brief cancel the timer of an output, if any. */
+static void io_untime(const uint8_t pin)
+{
+	uint8_t i;
+
+	i = io_timer(pin);
+
+	if (i < IO_TIMERS)
+		io_timed &= ~_BV(i);
+}
+
+/*! \brief switch an output off at the tick_ms32() given.
+ * \return 0 if all the timers are in use.
+ */
+static uint8_t io_time(const uint8_t pin, const uint32_t off)
+{
+	uint8_t i;
+
+	io_untime(pin);
+
+	for (i = 0; i < IO_TIMERS; i++)
+		if (!(io_timed & _BV(i))) {
+			io_pin[i] = pin;
+			io_off[i] = off;
+			io_timed |= _BV(i);
+			return(1);
+		}
+
+	return(0);
+}
+
+/*! \brief save the outputs.
+ *
+ * The pins on a timer are saved off, after a power loss they
+ * are never left on. The record has a bit for every output,
+ * see STORE_IO_SIZE.
+ */
+static void io_store(void)
+{
+	uint8_t pin, io;
+
+	io = 0;
+
+	for (pin = 0; pin < IO_PINS; pin++) {
+		if (io_get(pin) && (io_timer(pin) == IO_TIMERS))
+			io |= _BV(pin & 7);
+
+		if (((pin & 7) == 7) || (pin == IO_PINS - 1)) {
+			store_set_io(pin >> 3, io);
+			io = 0;
+		}
+	}
+}
+
+/*! \brief restore the outputs of the last known status. */
+static void io_init(void)
+{
+	uint8_t pin, io;
+
+#ifdef HTV_USE_XIO
+	xio_init();
+#endif
+	io = 0;
+
+	for (pin = 0; pin < IO_PINS; pin++) {
+		if (!(pin & 7))
+			io = store_get_io(pin >> 3);
+
+		io_put(pin, io & _BV(pin & 7));
+	}
+
+	io_commit();
+#ifndef HTV_USE_XIO
+	IO_DDR |= IO_MASK;
+#endif
+}
+
+/*! \brief execute a command on an output.
+ * \return 0 if the command can not be executed.
+ */
+static uint8_t io_cmd(const uint8_t pin, struct htv_t *htv)
+{
+	switch (htv->cmd) {
+		case IO_CMD_ON:
+		case IO_CMD_OFF:
+			io_untime(pin);
+			io_put(pin, htv->cmd == IO_CMD_ON);
+			return(1);
+		case IO_CMD_TOGGLE:
+			io_untime(pin);
+			io_put(pin, !io_get(pin));
+			return(1);
+		case IO_CMD_PULSE:
+		case IO_CMD_TIMED:
+			if ((htv->type == HTV_TYPE_TIMED) &&
+					io_time(pin, tick_ms32() +
+						((htv->cmd == IO_CMD_PULSE) ?
+						 htv->value : htv->value * 60000UL))) {
+				io_put(pin, 1);
+				return(1);
+			}
+
+			/* no duration or no timer, no break */
+		default:
+			return(0);
+	}
+}
+
 /*! \brief execute command on a pin.
  *
- * \param pin which pin to enable or disable.
- * \param cmd 1 - enable, 0 - disable
+ * Any valid command cancels the timer of the pin. The pulse and
+ * the timed on need the duration, only the HTV_TYPE_TIMED frame
+ * has it, and a free timer, they are refused for all the pins.
+ * The pins changed go out together and are saved once.
+ *
+ * \param pin which pin to enable or disable, IO_PIN_ALL all.
+ * \param htv the received frame, cmd is one of IO_CMD_*.
  * \param debug the debug_t struct.
  */
-void set_cmd(const uint8_t pin, const uint8_t cmd, struct debug_t *debug)
+void set_cmd(const uint8_t pin, struct htv_t *htv, struct debug_t *debug)
 {
-	switch (cmd) {
-		case 1:
-			IO_PORT |= _BV(pin);
+	uint8_t i, done;
+
+	if (pin == IO_PIN_ALL) {
+		done = (htv->cmd <= IO_CMD_TOGGLE);
+
+		if (done)
+			for (i = 0; i < IO_PINS; i++)
+				io_cmd(i, htv);
+	} else {
+		done = io_cmd(pin, htv);
+	}
+
+	if (!done) {
+		debug_print_P(PSTR("none"), debug);
+		return;
+	}
+
+	switch (htv->cmd) {
+		case IO_CMD_ON:
 			debug_print_P(PSTR("on"), debug);
 			break;
-		case 0:
-			IO_PORT &= ~_BV(pin);
+		case IO_CMD_OFF:
 			debug_print_P(PSTR("off"), debug);
 			break;
+		case IO_CMD_TOGGLE:
+			debug_print_P(PSTR("toggle"), debug);
+			break;
 		default:
-			debug_print_P(PSTR("none"), debug);
+			debug_print_P(PSTR("on, timer"), debug);
+	}
+
+	io_commit();
+	/* remember the status across a power loss */
+	io_store();
+}
+
+/*! \brief switch off the pins whose timer is over. */
+static void io_run(struct debug_t *debug)
+{
+	uint8_t i, off;
+
+	if (!io_timed)
+		return;
+
+	off = 0;
+
+	for (i = 0; i < IO_TIMERS; i++)
+		if ((io_timed & _BV(i)) &&
+				((int32_t)(tick_ms32() - io_off[i]) >= 0)) {
+			io_timed &= ~_BV(i);
+			io_put(io_pin[i], 0);
+			debug_print_P(PSTR("Timer: off\n"), debug);
+			off = 1;
+		}
+
+	if (off) {
+		io_commit();
+		io_store();
 	}
 }
 
@@ -168,47 +583,355 @@ void set_pin(struct htv_t *htv, struct debug_t *debug)
 	if ((htv->address == 0xffff) || (htv->address == htv->ee_addr)) {
 		debug_print_P(PSTR("Action: "), debug);
 
-		switch (htv->pin) {
-			case 0:
-				debug_print_P(PSTR("Pin0 - "), debug);
-				set_cmd(IO_PIN0, htv->cmd, debug);
-				break;
-			case 1:
-				debug_print_P(PSTR("Pin1 - "), debug);
-				set_cmd(IO_PIN1, htv->cmd, debug);
-				break;
-			default:
-				debug_print_P(PSTR("Unsupported IO"), debug);
+		if (htv->pin == IO_PIN_ALL) {
+			debug_print_P(PSTR("All - "), debug);
+			set_cmd(IO_PIN_ALL, htv, debug);
+		} else if (htv->pin < IO_PINS) {
+			debug_print_P(PSTR("Pin"), debug);
+			utoa(htv->pin, debug->line, 10);
+			debug_print(debug);
+			debug_print_P(PSTR(" - "), debug);
+			set_cmd(htv->pin, htv, debug);
+		} else {
+			debug_print_P(PSTR("Unsupported IO"), debug);
 		}
 
 		debug_print_P(PSTR("\n"), debug);
 	}
 }
 
-/*! \brief receive the AAAAPPC:RR string */
-void look_for_cmd(struct htv_t *htv, struct debug_t *debug)
+/*! the blocks of the last firmware frame */
+static uint16_t boot_blocks;
+/*! the CRC or the MAC of the last firmware frame */
+static uint32_t boot_check;
+/*! with a key, the MAC of the application being computed */
+static struct auth_t boot_mac;
+/*! with a key, the next byte of the application for the MAC,
+ * boot_len when done */
+static uint16_t boot_addr;
+/*! with a key, the bytes of the application for the MAC */
+static uint16_t boot_len;
+
+/*! \brief reset in the boot loader, never returns. */
+static void boot_reset(struct debug_t *debug)
 {
-	uint8_t i = 0;
+	debug_print_P(PSTR("Update: reset in the boot loader\n"), debug);
+	uart_tx(0, 0);
 
-	while (i<10) {
-		*(htv->x10str + i) = get_char_echo();
+	while (store_busy());
 
-		/* ignore 'x' char.
-		 * In the beginning there can be more 'x'
-		 * before the command string.
-		 */
-		if (*htv->x10str != 'x')
-			i++;
+	eeprom_write_byte(BOOT_FLAG, BOOT_UPDATE);
+	eeprom_busy_wait();
+	wdt_enable(WDTO_15MS);
+
+	while (1);
+}
+
+/*! \brief reset in the boot loader if the firmware is a new one.
+ *
+ * The image is compared with the application in the flash, by
+ * its CRC or with a key by its MAC, see auth_flash(). The MAC
+ * takes seconds, it is computed a block per pass of the main
+ * loop by boot_run(). The result is kept for the next firmware
+ * frames of the carousel.
+ */
+static void set_boot(struct htv_t *htv, struct debug_t *debug)
+{
+	uint32_t image;
+
+	image = strtoul(htv->x10str + 4, 0, 16);
+
+	/* the same image, already checked or being checked */
+	if ((htv->value == boot_blocks) && (image == boot_check))
+		return;
+
+	boot_blocks = htv->value;
+	boot_check = image;
+	boot_len = 0;
+	boot_addr = 0;
+
+	if (htv->value > BOOT_BLOCKS_MAX) {
+		debug_print_P(PSTR("Update: not needed\n"), debug);
+		return;
+	}
+
+	if (htv->auth) {
+		auth_start(&boot_mac);
+		boot_len = htv->value * BOOT_BLOCK_SIZE;
+		return;
+	}
+
+	if (boot_image_crc(htv->value) == image) {
+		debug_print_P(PSTR("Update: not needed\n"), debug);
+		return;
+	}
+
+	boot_reset(debug);
+}
+
+/*! \brief add a block of the application to the MAC, see set_boot().
+ *
+ * About 4 ms at 1 MHz, a few chars of the radio at most.
+ */
+static void boot_run(struct debug_t *debug)
+{
+	if (boot_addr == boot_len)
+		return;
+
+	auth_flash(&boot_mac, boot_addr, BOOT_BLOCK_SIZE);
+	boot_addr += BOOT_BLOCK_SIZE;
+
+	if (boot_addr < boot_len)
+		return;
+
+	if (auth_end(&boot_mac) == boot_check)
+		debug_print_P(PSTR("Update: not needed\n"), debug);
+	else
+		boot_reset(debug);
+}
+
+/*! the master which last sent a command to the pins 0 and 1,
+ * IO_MASTER_ANY a frame without the envelope or none yet */
+static uint8_t io_master[2] = { IO_MASTER_ANY, IO_MASTER_ANY };
+
+/*! \brief remember the master of the pins of a command.
+ * \param master the id of the master, IO_MASTER_ANY unknown.
+ */
+static void io_owner(struct htv_t *htv, const uint8_t master)
+{
+	uint8_t pin;
+
+	if ((htv->address != 0xffff) && (htv->address != htv->ee_addr))
+		return;
+
+	for (pin = 0; pin < 2; pin++)
+		if ((htv->pin == IO_PIN_ALL) || (htv->pin == pin))
+			io_master[pin] = master;
+}
+
+/*! \brief apply the state of the remote from a state frame.
+ *
+ * Only the known pins which are not on a timer are changed, and
+ * only if this master sent the last command to the pin, else the
+ * old table of a master would undo the commands of the others.
+ */
+void set_sync(struct htv_t *htv, struct debug_t *debug)
+{
+	uint8_t i, n, v, pin, changed;
+	char *s;
+
+	n = *(htv->x10str + 1) - '0';
+
+	for (i = 0; i < n; i++) {
+		s = htv->x10str + 2 + i * 5;
+		strlcpy(htv->substr, s, 5);
+
+		if (strtoul(htv->substr, 0, 16) != htv->ee_addr)
+			continue;
+
+		strlcpy(htv->substr, s + 4, 2);
+		v = strtoul(htv->substr, 0, 16);
+		changed = 0;
+
+		/* the bit 2 and 3 tell the known pins 0 and 1 */
+		for (pin = 0; pin < 2; pin++)
+			if ((v & _BV(pin + 2)) && (io_timer(pin) == IO_TIMERS) &&
+					((io_master[pin] == IO_MASTER_ANY) ||
+					 (io_master[pin] == htv->master)) &&
+					(io_get(pin) != ((v >> pin) & 1))) {
+				io_put(pin, (v >> pin) & 1);
+				changed = 1;
+			}
+
+		if (changed) {
+			io_commit();
+			debug_print_P(PSTR("Sync: changed\n"), debug);
+			io_store();
+		}
+	}
+}
+
+/*! \brief change the address of the receiver.
+ *
+ * Only if the old address is our address, 0000 and FFFF can
+ * not be used as new address.
+ */
+void set_address(struct htv_t *htv, struct debug_t *debug)
+{
+	if ((htv->address == htv->ee_addr) && htv->value &&
+			(htv->value != 0xffff)) {
+		htv->ee_addr = htv->value;
+		htv_store_address(htv);
+		debug_print_address(htv, debug);
 	}
+}
+
+/*! \brief initialize the receiver status. */
+void rx_init(struct rx_t *rx)
+{
+	uint8_t i;
+
+	rx->state = RX_HUNT;
+	rx->relay = malloc(MAX_CMD_LENGHT);
+	rx->relay_pending = 0;
+
+	for (i = 0; i < RX_SEEN; i++)
+		rx->seen[i].master = 0xff;
+}
+
+/*! \brief check if the frame has already been received.
+ *
+ * A frame in the envelope is known by the master id and the
+ * sequence number, it arrives more times from the repeaters
+ * or when the master repeats it. The frames taken are remembered
+ * for RX_SEEN_MS, see rx_seen_add().
+ *
+ * \return true if the frame is a copy.
+ */
+static uint8_t rx_seen(struct rx_t *rx, struct htv_t *htv)
+{
+	uint8_t i;
+
+	for (i = 0; i < RX_SEEN; i++) {
+		if (tick_elapsed(rx->seen[i].time, RX_SEEN_MS))
+			rx->seen[i].master = 0xff;
+
+		if ((rx->seen[i].master == htv->master) &&
+				(rx->seen[i].seq == htv->seq))
+			return(1);
+	}
+
+	return(0);
+}
+
+/*! \brief remember a frame taken, replacing the oldest one.
+ *
+ * Only after the counter of an authenticated frame is taken, a
+ * replay must not hide the frame with the same sequence number.
+ */
+static void rx_seen_add(struct rx_t *rx, struct htv_t *htv)
+{
+	uint8_t i, old;
+
+	old = 0;
+
+	for (i = 0; i < RX_SEEN; i++)
+		if ((rx->seen[old].master != 0xff) && ((rx->seen[i].master == 0xff) ||
+				((int16_t)(rx->seen[i].time - rx->seen[old].time) < 0)))
+			old = i;
+
+	rx->seen[old].master = htv->master;
+	rx->seen[old].seq = htv->seq;
+	rx->seen[old].time = tick_ms();
+}
+
+#ifdef HTV_USE_RTX
+/*! \brief acknowledge the frame to the master, KIAAAASS:RR. */
+static void rx_ack(struct htv_t *htv)
+{
+	char ack[HTV_ACK_LEN + 1];
+
+	*ack = HTV_TYPE_ACK;
+	htv_hex(ack + 1, htv->master, 1);
+	htv_hex(ack + 2, htv->address, 4);
+	htv_hex(ack + 6, htv->seq, 2);
+	htv_crc_append(ack);
+	_delay_ms(RX_ACK_MS);
+	radio_send(ack);
+}
+
+/*! \brief queue the frame to be sent again by the repeater.
+ *
+ * The frame in rx->relay, a copy of the received string, is
+ * sent with one hop less and a new crc after a random delay,
+ * so that more repeaters which hear the same frame do not
+ * transmit at the same time. Only one frame is kept, if one is
+ * already waiting the new one is not repeated.
+ */
+static void rx_relay_queue(struct rx_t *rx, struct htv_t *htv)
+{
+	uint8_t len;
+	char c;
+
+	len = strlen(rx->relay);
+
+	/* remove the :RR, the MAC does not cover the hops */
+	if (!htv->auth)
+		*(rx->relay + len - 3) = 0;
+
+	/* htv_hex() terminates the string, keep the next char */
+	c = *(rx->relay + HTV_HOPS_IDX + 1);
+	htv_hex(rx->relay + HTV_HOPS_IDX, htv->hops - 1, 1);
+	*(rx->relay + HTV_HOPS_IDX + 1) = c;
+
+	if (!htv->auth)
+		htv_crc_append(rx->relay);
+	rx->relay_start = tick_ms();
+	rx->relay_delay = RX_RELAY_MS + ((htv->ee_addr ^ TCNT0) & RX_RELAY_JITTER);
+	rx->relay_pending = 1;
+}
+#endif
+
+/*! \brief check and execute the received string.
+ *
+ * The copies of a frame already received are not executed again,
+ * see rx_seen(). In repeater mode the new frames with hops left
+ * are queued to be sent again. The frames for this address which
+ * ask for an ack are acknowledged, also the copies.
+ * With a key only the authenticated frames with a new counter are
+ * executed, see auth.c.
+ *
+ * \return 0 if ok, else the htv_check_cmd() error.
+ */
+uint8_t rx_frame(struct rx_t *rx, struct htv_t *htv, struct debug_t *debug)
+{
+	uint8_t i, env;
+#ifdef HTV_USE_RTX
+	uint8_t ack;
+#endif
 
-	/* correctly terminate the string */
-	*(htv->x10str + 10) = 0;
 	/* print what has been received */
 	debug_print_P(PSTR("\nReceived: "), debug);
 	uart_printstr(0, htv->x10str);
+	env = ((*htv->x10str == HTV_TYPE_MASTER) ||
+			(*htv->x10str == HTV_TYPE_ACKREQ) ||
+			(*htv->x10str == HTV_TYPE_AUTH));
+
+#ifdef HTV_USE_RTX
+	if (env && !rx->relay_pending &&
+			(store_get_cfg(STORE_CFG_FLAGS) & STORE_FLAG_REPEATER))
+		strcpy(rx->relay, htv->x10str);
+#endif
+
 	/* check the command */
 	i = htv_check_cmd(htv);
 
+	/* with a key only the authenticated frames, and viceversa */
+	if (!i && (htv->auth != auth_key_valid()))
+		i = _BV(4);
+
+#ifdef HTV_USE_RTX
+	/* before set_address() changes ee_addr */
+	ack = (!i && htv->ack && (htv->type != HTV_TYPE_ACK) &&
+			(htv->address == htv->ee_addr));
+#endif
+
+	if (!i && env && rx_seen(rx, htv)) {
+		debug_print_P(PSTR(" copy\n"), debug);
+#ifdef HTV_USE_RTX
+		if (ack)
+			rx_ack(htv);
+#endif
+		return(0);
+	}
+
+	/* a new frame, not a replay */
+	if (!i && htv->auth && !auth_fresh(htv->master, htv->ctr))
+		i = _BV(5);
+
+	if (!i && env)
+		rx_seen_add(rx, htv);
+
 	/* if error */
 	if (i) {
 		debug_print_P(PSTR(" Error "), debug);
@@ -222,56 +945,348 @@ void look_for_cmd(struct htv_t *htv, struct debug_t *debug)
 		/* debug_print_htv(htv, debug); */
 	} else {
 		debug_print_P(PSTR(" OK\n"), debug);
+
 		/* execute the command */
-		set_pin(htv, debug);
+		switch (htv->type) {
+			case HTV_TYPE_ADDR:
+				set_address(htv, debug);
+				break;
+			case HTV_TYPE_ACK:
+				/* for the master */
+				break;
+			case HTV_TYPE_SYNC:
+				set_sync(htv, debug);
+				break;
+			case HTV_TYPE_BOOT:
+				set_boot(htv, debug);
+				break;
+			default:
+				set_pin(htv, debug);
+				io_owner(htv, env ? htv->master : IO_MASTER_ANY);
+		}
+
+#ifdef HTV_USE_RTX
+		if (ack)
+			rx_ack(htv);
+
+		if (env && htv->hops && !rx->relay_pending &&
+				(store_get_cfg(STORE_CFG_FLAGS) & STORE_FLAG_REPEATER))
+			rx_relay_queue(rx, htv);
+#endif
 	}
+
+	return(i);
 }
 
-/*! \brief the main RX program */
-void slave(struct debug_t *debug)
+#ifdef HTV_USE_RTX
+/*! \brief send the queued frame when its time has come.
+ *
+ * The repeater listens before talking, with a backoff given
+ * by its address.
+ */
+static void rx_relay(struct rx_t *rx, struct htv_t *htv)
 {
-	struct htv_t *htv;
-	char c;
+	if (!rx->relay_pending ||
+			!tick_elapsed(rx->relay_start, rx->relay_delay))
+		return;
 
-	htv = NULL;
-	htv = htv_init(htv);
+	radio_lbt(htv->ee_addr & 0x0f);
+	radio_send(rx->relay);
+	rx->relay_pending = 0;
+}
+#endif
 
+#ifndef HTV_USE_MONITOR
+/*! \brief true if the frame must be received whole, also when it
+ * is for someone else: a repeater sends again the frames in the
+ * envelope with hops left.
+ */
+static uint8_t rx_relayable(struct htv_t *htv)
+{
 #ifdef HTV_USE_RTX
-	AU_DDR |= _BV(AU_ENABLE) | _BV(AU_TXRX);
+	return(((*htv->x10str == HTV_TYPE_MASTER) ||
+				(*htv->x10str == HTV_TYPE_ACKREQ) ||
+				(*htv->x10str == HTV_TYPE_AUTH)) &&
+			(*(htv->x10str + HTV_HOPS_IDX) != '0') &&
+			(store_get_cfg(STORE_CFG_FLAGS) & STORE_FLAG_REPEATER));
+#else
+	return(0);
 #endif
+}
+#endif
+
+/*! \brief receive the AAAAPPC:RR string, a char at a time.
+ *
+ * At least 2 'x' are needed to start, the following 'x' are
+ * ignored. The lenght of the string depends on its first chars,
+ * see htv_frame_len(), when complete the string is checked and
+ * executed. A string for someone else is dropped as soon as its
+ * address is received, see htv_addr_match().
+ *
+ * \param rx the status of the receiver.
+ * \param c the received char.
+ * \return RX_BUSY while receiving, RX_DONE or RX_ERROR when
+ * a string has been received, RX_FOREIGN when it is dropped.
+ */
+uint8_t rx_char(struct rx_t *rx, struct htv_t *htv, const char c,
+		struct debug_t *debug)
+{
+	switch (rx->state) {
+		case RX_HUNT:
+			/* look for the 1st 'x' */
+			if (c == 'x')
+				rx->state = RX_SYNC;
+
+			break;
+		case RX_SYNC:
+			/* look for the mandatory 2nd 'x' */
+			if (c == 'x')
+				rx->state = RX_HEAD;
+			else
+				rx->state = RX_HUNT;
+
+			break;
+		case RX_HEAD:
+			/* ignore 'x' char.
+			 * In the beginning there can be more 'x'
+			 * before the command string.
+			 */
+			if (c == 'x')
+				break;
+
+			rx->idx = 0;
+			rx->state = RX_DATA;
+			rx->match = HTV_ADDR_WAIT;
+			rx->mac = 0;
+			auth_start(&rx->auth);
+			/* no break, c is the first char of the string */
+		case RX_DATA:
+			/* never in a frame, a new header after a lost end */
+			if (c == 'x') {
+				rx->state = RX_SYNC;
+				break;
+			}
 
-	/* Init IO port */
-	IO_PORT &= ~(_BV(IO_PIN0) | _BV(IO_PIN1));
-	IO_DDR |= _BV(IO_PIN0) | _BV(IO_PIN1);
-	uart_init(1);
+			*(htv->x10str + rx->idx) = c;
+			rx->len = htv_frame_len(htv->x10str, rx->idx + 1);
+
+			/* the MAC a block at a time of every char before its
+			 * ':', like auth_append(), the lenght can still
+			 * change here; the hops are not in */
+			if ((*htv->x10str == HTV_TYPE_AUTH) && !rx->mac) {
+				if ((c == ':') && (rx->idx >= HTV_AUTH_LEN))
+					rx->mac = 1;
+				else
+					auth_byte(&rx->auth,
+							(rx->idx == HTV_HOPS_IDX) ? '0' : c);
+			}
+
+			rx->idx++;
+
+			if ((rx->idx >= rx->len) || (rx->idx >= MAX_CMD_LENGHT - 1)) {
+				/* correctly terminate the string */
+				*(htv->x10str + rx->idx) = 0;
+				rx->state = RX_HUNT;
+
+				if (*htv->x10str == HTV_TYPE_AUTH)
+					htv->mac = auth_end(&rx->auth);
+
+				/* the blocks are for the boot loader */
+				if (*htv->x10str == HTV_TYPE_BLOCK)
+					return(RX_DONE);
+
+				if (rx_frame(rx, htv, debug))
+					return(RX_ERROR);
+				else
+					return(RX_DONE);
+			}
+
+#ifndef HTV_USE_MONITOR
+			/* the rest of a frame for someone else is never
+			 * stored, the frames have no 'x' and the hunt drops it */
+			if (rx->match == HTV_ADDR_WAIT) {
+				rx->match = htv_addr_match(htv->x10str, rx->idx,
+						htv->ee_addr);
+
+				if ((rx->match == HTV_ADDR_FOREIGN) && !rx_relayable(htv)) {
+					rx->state = RX_HUNT;
+					return(RX_FOREIGN);
+				}
+			}
+#endif
+
+			break;
+		default:
+			rx->state = RX_HUNT;
+	}
+
+	return(RX_BUSY);
+}
+
+/*! \brief change the address from the console.
+ *
+ * The dialog runs with the next console lines, the receiver
+ * keeps working, see debug_address_line().
+ */
+uint8_t a_console(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	debug_address_start(htv, debug);
+	return(CMD_DONE);
+}
+
+/*! \brief set the key
+ * in the form:
+ * k:KKKKKKKKKKKKKKKKKKKKKKKKKKKKKKKK
+ */
+uint8_t k_console(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	auth_set_key(line + 2);
+	return(CMD_OK);
+}
+
+#ifdef HTV_USE_RTX
+/*! \brief repeater mode on or off
+ * in the form:
+ * r:X
+ */
+uint8_t r_console(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	if (*(line + 2) == '1')
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) | STORE_FLAG_REPEATER);
+	else
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) & ~STORE_FLAG_REPEATER);
+
+	return(CMD_OK);
+}
+#endif
+
+#ifdef HTV_USE_BENCH
+/*! \brief run the benchmark, see bench.c. */
+uint8_t m_console(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	bench_begin();
+	bench_run(htv, debug);
+	bench_end();
+	return(CMD_OK);
+}
+#endif
+
+uint8_t help_console(char *line, struct htv_t *htv, struct debug_t *debug);
+
+/*! pattern and help of the console commands */
+static const char a_args[] PROGMEM = "a";
+static const char a_help[] PROGMEM = "a change the address of the receiver.\n";
+#ifdef HTV_USE_RTX
+static const char r_args[] PROGMEM = "r:b";
+static const char r_help[] PROGMEM = "r:x where x 1 or 0, enable or disable the repeater.\n";
+#endif
+static const char k_args[] PROGMEM = "k:hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh";
+static const char k_help[] PROGMEM = "k:K set the 16 byte key, all ff no key.\n";
+#ifdef HTV_USE_BENCH
+static const char m_args[] PROGMEM = "m";
+static const char m_help[] PROGMEM = "m run the benchmark, cpu cycles min:avg:max.\n";
+#endif
+static const char h_args[] PROGMEM = "?";
+static const char h_help[] PROGMEM = "? this help.\n";
+
+/*! the console commands */
+static const struct cmd_t slave_cmd[] PROGMEM = {
+	{ 'a', a_args, a_console, a_help },
+	{ 'k', k_args, k_console, k_help },
+#ifdef HTV_USE_BENCH
+	{ 'm', m_args, m_console, m_help },
+#endif
+#ifdef HTV_USE_RTX
+	{ 'r', r_args, r_console, r_help },
+#endif
+	{ '?', h_args, help_console, h_help },
+	{ 0, NULL, NULL, NULL }
+};
+
+/*! \brief print the help. */
+uint8_t help_console(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	cmd_help(slave_cmd, debug);
+	return(CMD_DONE);
+}
+
+/*! \brief print the module banner. */
+static void print_banner(struct htv_t *htv, struct debug_t *debug)
+{
 	debug_print_P(PSTR("Receive module.\n"), debug);
 	debug_print_address(htv, debug);
+	debug_print_P(PSTR("Listening after "), debug);
+	utoa(rx_boot_cycles / (F_CPU / 1000000UL), debug->line, 10);
+	debug_print(debug);
+	debug_print_P(PSTR(" us from reset.\n"), debug);
+}
 
-	start_rx();
+/*! \brief the main RX program.
+ *
+ * The outputs are restored and the receiver is started before
+ * anything else, the boot message is printed in background
+ * while the radio is already listening.
+ *
+ * \note Timer1 must be started at reset to measure the boot
+ * time, see main().
+ */
+void slave(struct debug_t *debug)
+{
+	struct htv_t *htv;
+	struct cmd_line_t line;
+	struct rx_t rx;
+	uint8_t banner;
+	char c;
 
-	while (1) {
-		c = get_char_echo();
-		
-		/* look for the 1st 'x' */
-		if (c == 'x') {
-			c = get_char_echo();
+	/* Init IO port, restore the last known status */
+	io_init();
 
-			/* look for the mandatory 2nd 'x' */
-			if (c == 'x')
-			       look_for_cmd(htv, debug);
-		}
+	radio_init();
+#ifdef HTV_USE_ICP
+	/* the Timer1 becomes the receiver */
+	rx_boot_cycles = TCNT1;
+	radio_power(RADIO_RX);
+#else
+	radio_power(RADIO_RX);
+	rx_boot_cycles = TCNT1;
+	TCCR1B = 0;
+#endif
 
-		/* also read a char from the serial port, unlocked */
-		c = uart_getchar(0, 0);
+	htv = NULL;
+	htv = htv_init(htv);
+	tick_init();
+	auth_init();
+	rx_init(&rx);
+	line.buf = malloc(MAX_CMD_LENGHT);
+	line.idx = 0;
+	banner = 1;
 
-		/* change the running address */
-		if (c == 'a') {
-			stop_rx();
-			uart_flush(0);
-			uart_flush(1);
-			debug_setup_address(htv, debug);
-			start_rx();
+	while (1) {
+		/* print the boot message in background */
+		if (banner && !debug_hello(debug)) {
+			print_banner(htv, debug);
+			banner = 0;
 		}
+
+		c = get_char_echo(0);
+
+		if (c)
+			rx_char(&rx, htv, c, debug);
+
+		io_run(debug);
+		boot_run(debug);
+
+#ifdef HTV_USE_RTX
+		rx_relay(&rx, htv);
+#endif
+
+		/* also read the console, unlocked, the lines go to the
+		 * address dialog while it runs */
+		if (cmd_getline(&line, 0, 1) &&
+				!debug_address_line(line.buf, htv, debug))
+			cmd_exec(slave_cmd, line.buf, htv, debug);
 	}
 
 	htv_free(htv);
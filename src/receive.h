@@ -26,14 +26,104 @@
 #include "uart.h"
 #include "debug.h"
 #include "htv.h"
+#include "store.h"
+#include "cmd.h"
+#include "tick.h"
+#include "radio.h"
+#include "auth.h"
+#include "icp.h"
+#include "boot.h"
+#include "bench.h"
+#include "xio.h"
 
-/*! port where the IO pin are connected in the rx module. */
-#define IO_PORT PORTA
-/*! data direction register */
-#define IO_DDR DDRA
-#define IO_PIN0 PA0
-#define IO_PIN1 PA1
+/*! the state frames of every master are applied, see set_sync() */
+#define IO_MASTER_ANY 0xff
+#ifdef HTV_USE_XIO
+/*! number of pins, the outputs of the 74HC595 chain */
+#define IO_PINS XIO_PINS
+/*! number of pins on a timer at the same time, max 8 */
+#define IO_TIMERS 8
+#else
+/*! number of pins, IO_PIN0 and IO_PIN1 */
+#define IO_PINS 2
+/*! number of pins on a timer at the same time, max 8 */
+#define IO_TIMERS 2
+#endif
+
+/*! receiver status: waiting for the 1st 'x' */
+#define RX_HUNT 0
+/*! receiver status: waiting for the 2nd 'x' */
+#define RX_SYNC 1
+/*! receiver status: skipping the 'x', waiting for the string */
+#define RX_HEAD 2
+/*! receiver status: receiving the string */
+#define RX_DATA 3
+
+/*! rx_char(): the string is not complete */
+#define RX_BUSY 0
+/*! rx_char(): a string has been received and executed */
+#define RX_DONE 1
+/*! rx_char(): a string has been received with errors */
+#define RX_ERROR 2
+/*! rx_char(): a string for someone else, the rest is skipped */
+#define RX_FOREIGN 3
+
+/*! number of frames remembered to drop the copies */
+#define RX_SEEN 8
+/*! ms a frame is remembered */
+#define RX_SEEN_MS 4000
+/*! repeater: min ms before sending a frame again */
+#define RX_RELAY_MS 20
+/*! repeater: random ms added, a mask */
+#define RX_RELAY_JITTER 0x7f
+/*! ms before the ack, the master turns to receive */
+#define RX_ACK_MS 5
+
+/*! \struct rx_seen_t
+ * A frame already received, from its envelope.
+ */
+struct rx_seen_t {
+	/*! id of the master, 0xff free */
+	uint8_t master;
+	/*! sequence number of the frame */
+	uint8_t seq;
+	/*! tick_ms() when received */
+	uint16_t time;
+};
+
+/*! \struct rx_t
+ * The status of the receiver while a string is coming.
+ */
+struct rx_t {
+	/*! RX_HUNT, RX_SYNC, RX_HEAD or RX_DATA */
+	uint8_t state;
+	/*! chars of the string received */
+	uint8_t idx;
+	/*! lenght of the string */
+	uint8_t len;
+	/*! the address of the string, see htv_addr_match() */
+	uint8_t match;
+	/*! the MAC of the string, see auth.c */
+	struct auth_t auth;
+	/*! the ':' of the MAC has been received */
+	uint8_t mac;
+	/*! the frames already received */
+	struct rx_seen_t seen[RX_SEEN];
+	/*! repeater: the frame to send again, MAX_CMD_LENGHT chars */
+	char *relay;
+	/*! repeater: a frame is waiting in relay */
+	uint8_t relay_pending;
+	/*! repeater: tick_ms() when the frame was received */
+	uint16_t relay_start;
+	/*! repeater: ms to wait before sending it */
+	uint8_t relay_delay;
+};
+
+extern uint16_t rx_boot_cycles;
 
+void rx_init(struct rx_t *rx);
+uint8_t rx_char(struct rx_t *rx, struct htv_t *htv, const char c,
+		struct debug_t *debug);
 void slave(struct debug_t *debug);
 
 #endif
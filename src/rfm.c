@@ -0,0 +1,322 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file rfm.c
+ * \brief Packet radio backend, an RFM69 (SX1231) on the SPI.
+ *
+ * An alternative to the AM module on the USART1, see HTV_USE_RFM.
+ * The module adds the preamble, the sync word and a CRC-16 to
+ * every packet and drops the packets with a wrong CRC, FSK at
+ * RFM_BITRATE instead of 1200 bps.
+ *
+ * The frames are the same, a transmission of radio_open() and
+ * radio_puts() is a packet, a longer one is cut in more packets
+ * between the frames. A packet received is put in the rx buffer
+ * of the port 1 after the RADIO_SYNC, as if the USART had
+ * received it, like icp.c does, and the frames are decoded by the
+ * same code.
+ *
+ * The module tells the end of a transmission and a packet
+ * received on DIO0, wired to INT0. The packets go to and from the
+ * FIFO in the SPI IRQ, a byte at a time, the registers are
+ * written polling the SPI outside of a transfer.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "rfm.h"
+#include "uart.h"
+#include "radio.h"
+#include "tick.h"
+
+/*! the packet, the length and the payload */
+static uint8_t pkt[RFM_PAYLOAD + 1];
+/*! bytes of the packet, the length included */
+static uint8_t pkt_len;
+/*! payload bytes of the packet received */
+static volatile uint8_t rx_len;
+/*! next byte of the transfer */
+static volatile uint8_t spi_idx;
+/*! the transfer in the SPI IRQ, RFM_SPI_* */
+static volatile uint8_t spi_state;
+/*! the mode of the module */
+static volatile uint8_t mode;
+/*! the end of the transmission on DIO0 */
+static volatile uint8_t sent;
+
+/*! \brief a byte on the SPI, polling. */
+static uint8_t rfm_spi(const uint8_t b)
+{
+	SPDR = b;
+	loop_until_bit_is_set(SPSR, SPIF);
+	return(SPDR);
+}
+
+/*! \brief wait for the SPI IRQ, then select the module. */
+static void rfm_select(void)
+{
+	uint8_t busy;
+
+	/* no packet read can start in between */
+	do {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			busy = (spi_state != RFM_SPI_IDLE);
+
+			if (!busy)
+				EIMSK &= ~_BV(INT0);
+		}
+	} while (busy);
+
+	SPCR &= ~_BV(SPIE);
+	RFM_SPI_PORT &= ~_BV(RFM_NSS);
+}
+
+/*! \brief end of a polled access. */
+static void rfm_deselect(void)
+{
+	RFM_SPI_PORT |= _BV(RFM_NSS);
+	EIMSK |= _BV(INT0);
+}
+
+/*! \brief write a register. */
+static void rfm_write(const uint8_t reg, const uint8_t value)
+{
+	rfm_select();
+	rfm_spi(reg | RFM_WRITE);
+	rfm_spi(value);
+	rfm_deselect();
+}
+
+/*! \brief read a register. */
+static uint8_t rfm_read(const uint8_t reg)
+{
+	uint8_t value;
+
+	rfm_select();
+	rfm_spi(reg);
+	value = rfm_spi(0);
+	rfm_deselect();
+	return(value);
+}
+
+/*! \brief change the mode, DIO0 follows it.
+ * \param m RFM_MODE_*.
+ * \note the wait for the module ends after RFM_TIMEOUT_MS only
+ * once the tick is running, see tick_init().
+ */
+void rfm_mode(const uint8_t m)
+{
+	uint16_t start;
+
+	rfm_write(RFM_REG_DIOMAP1, (m == RFM_MODE_TX) ?
+			RFM_DIO0_TX : RFM_DIO0_RX);
+	mode = m;
+	rfm_write(RFM_REG_OPMODE, m);
+	start = tick_ms();
+
+	if (m != RFM_MODE_SLEEP)
+		while (!(rfm_read(RFM_REG_IRQ1) & RFM_IRQ1_MODEREADY) &&
+				!tick_elapsed(start, RFM_TIMEOUT_MS));
+}
+
+/*! \brief set up the SPI and the module, in standby.
+ * \return 0 if the module does not answer.
+ */
+uint8_t rfm_init(void)
+{
+	RFM_SPI_PORT |= _BV(RFM_NSS);
+	RFM_SPI_DDR |= _BV(RFM_NSS) | _BV(RFM_MOSI) | _BV(RFM_SCK);
+	RFM_SPI_DDR &= ~_BV(RFM_MISO);
+	DDRD &= ~_BV(RFM_DIO0);
+	/* master, mode 0, clk/2 */
+	SPCR = _BV(SPE) | _BV(MSTR);
+	SPSR = _BV(SPI2X);
+	spi_state = RFM_SPI_IDLE;
+
+	/* DIO0 rising edge */
+	EICRA = (EICRA & ~(_BV(ISC01) | _BV(ISC00))) | _BV(ISC01) | _BV(ISC00);
+	EIFR = _BV(INTF0);
+
+	if (rfm_read(RFM_REG_VERSION) != 0x24)
+		return(0);
+
+	rfm_mode(RFM_MODE_STDBY);
+	/* packet mode, FSK */
+	rfm_write(RFM_REG_DATAMODUL, 0);
+	rfm_write(RFM_REG_BITRATE, (RFM_FXOSC / RFM_BITRATE) >> 8);
+	rfm_write(RFM_REG_BITRATE + 1, (RFM_FXOSC / RFM_BITRATE) & 0xff);
+	rfm_write(RFM_REG_FDEV, RFM_FDEV >> 8);
+	rfm_write(RFM_REG_FDEV + 1, RFM_FDEV & 0xff);
+	rfm_write(RFM_REG_FRF, RFM_FRF >> 16);
+	rfm_write(RFM_REG_FRF + 1, (RFM_FRF >> 8) & 0xff);
+	rfm_write(RFM_REG_FRF + 2, RFM_FRF & 0xff);
+	/* 125 kHz */
+	rfm_write(RFM_REG_RXBW, 0x42);
+	rfm_write(RFM_REG_PREAMBLE, 4);
+	/* 2 bytes of sync word */
+	rfm_write(RFM_REG_SYNCCONFIG, 0x88);
+	rfm_write(RFM_REG_SYNC, 0x2d);
+	rfm_write(RFM_REG_SYNC + 1, 0xd4);
+	/* variable length, whitening, CRC on */
+	rfm_write(RFM_REG_PKTCONFIG1, 0xd0);
+	rfm_write(RFM_REG_PAYLOADLEN, RFM_PAYLOAD);
+	/* tx as soon as the FIFO is not empty */
+	rfm_write(RFM_REG_FIFOTHRESH, 0x8f);
+	/* restart the rx after a packet */
+	rfm_write(RFM_REG_PKTCONFIG2, 0x02);
+	rfm_write(RFM_REG_TESTDAGC, 0x30);
+	return(1);
+}
+
+/*! \brief start a packet. */
+void rfm_open(void)
+{
+	pkt_len = 1;
+}
+
+/*! \brief send the packet and wait for its end, then go back
+ * to the mode before.
+ *
+ * Without the PacketSent on DIO0 in RFM_TIMEOUT_MS, ex. a module
+ * reset by a glitch, the packet is lost and the module is set up
+ * again.
+ */
+static void rfm_flush(void)
+{
+	uint16_t start;
+	uint8_t m;
+
+	if (pkt_len < 2)
+		return;
+
+	m = mode;
+	pkt[0] = pkt_len - 1;
+	rfm_mode(RFM_MODE_STDBY);
+
+	/* the FIFO in the IRQ */
+	rfm_select();
+	spi_idx = 0;
+	spi_state = RFM_SPI_WRITE;
+	SPCR |= _BV(SPIE);
+	SPDR = RFM_REG_FIFO | RFM_WRITE;
+
+	while (spi_state != RFM_SPI_IDLE);
+
+	sent = 0;
+	rfm_mode(RFM_MODE_TX);
+	start = tick_ms();
+
+	while (!sent && !tick_elapsed(start, RFM_TIMEOUT_MS));
+
+	if (!sent)
+		rfm_init();
+
+	rfm_mode((m == RFM_MODE_SLEEP) ? RFM_MODE_STDBY : m);
+	pkt_len = 1;
+}
+
+/*! \brief add a string to the packet.
+ *
+ * The string is a frame or the RADIO_SYNC, if it does not fit
+ * the packet is sent and the string starts the next one.
+ */
+void rfm_puts(const char *s)
+{
+	const char *p;
+
+	for (p = s; *p; p++);
+
+	if (pkt_len + (p - s) > RFM_PAYLOAD + 1)
+		rfm_flush();
+
+	while (*s && (pkt_len <= RFM_PAYLOAD))
+		pkt[pkt_len++] = *s++;
+}
+
+/*! \brief send the last packet. */
+void rfm_close(void)
+{
+	rfm_flush();
+}
+
+/*! \brief true if someone else is on the air.
+ * \note the module must be in rx.
+ */
+uint8_t rfm_busy(void)
+{
+	return(rfm_read(RFM_REG_RSSI) < RFM_RSSI_BUSY);
+}
+
+/* with HTV_USE_XIO the SPI IRQ is the one of xio.c */
+#ifndef HTV_USE_XIO
+/*! \brief a byte of the packet is gone or arrived. */
+ISR(SPI_STC_vect)
+{
+	uint8_t b;
+
+	b = SPDR;
+
+	if (spi_state == RFM_SPI_WRITE) {
+		if (spi_idx < pkt_len) {
+			SPDR = pkt[spi_idx++];
+			return;
+		}
+	} else {
+		/* the first byte is the length */
+		if (!spi_idx) {
+			rx_len = 0;
+		} else if (spi_idx == 1) {
+			rx_len = (b > RFM_PAYLOAD) ? RFM_PAYLOAD : b;
+			uart_rx_put(1, RADIO_SYNC[0]);
+			uart_rx_put(1, RADIO_SYNC[1]);
+		} else {
+			uart_rx_put(1, b);
+		}
+
+		if (spi_idx++ < rx_len + 1) {
+			SPDR = 0;
+			return;
+		}
+	}
+
+	/* end of the transfer */
+	RFM_SPI_PORT |= _BV(RFM_NSS);
+	SPCR &= ~_BV(SPIE);
+	spi_state = RFM_SPI_IDLE;
+	EIMSK |= _BV(INT0);
+}
+#endif
+
+/*! \brief DIO0, a packet received or sent. */
+ISR(INT0_vect)
+{
+	if (mode == RFM_MODE_TX) {
+		sent = 1;
+		return;
+	}
+
+	/* read the FIFO, no polled access until the end */
+	EIMSK &= ~_BV(INT0);
+	RFM_SPI_PORT &= ~_BV(RFM_NSS);
+	spi_idx = 0;
+	spi_state = RFM_SPI_READ;
+	SPCR |= _BV(SPIE);
+	SPDR = RFM_REG_FIFO;
+}
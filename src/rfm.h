@@ -0,0 +1,132 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file rfm.h
+  \brief Packet radio backend, an RFM69 (SX1231) on the SPI.
+  */
+
+#ifndef RFM_H
+#define RFM_H
+
+#include <stdint.h>
+
+/*! port of the SPI */
+#define RFM_SPI_PORT PORTB
+/*! data direction register */
+#define RFM_SPI_DDR DDRB
+/*! chip select of the module */
+#define RFM_NSS PB4
+/*! SPI MOSI */
+#define RFM_MOSI PB5
+/*! SPI MISO */
+#define RFM_MISO PB6
+/*! SPI SCK */
+#define RFM_SCK PB7
+/*! DIO0 of the module on INT0, the RXD1 pin is free */
+#define RFM_DIO0 PD2
+
+/*! bit rate on the air */
+#define RFM_BITRATE 38400UL
+/*! crystal of the module */
+#define RFM_FXOSC 32000000UL
+/*! carrier, 868.0 MHz in 61.035 Hz steps */
+#define RFM_FRF 0xd90000UL
+/*! deviation, 40 kHz in 61.035 Hz steps */
+#define RFM_FDEV 655
+/*! max payload, the rx buffer of the port 1 takes it with the sync */
+#define RFM_PAYLOAD 48
+/*! channel busy above this RSSI, -dBm * 2 */
+#define RFM_RSSI_BUSY 180
+/*! ms to wait for a change of mode or the end of a packet, the
+ * longest one is about 13 ms, then the module is set up again */
+#define RFM_TIMEOUT_MS 50
+
+/*! register: the FIFO */
+#define RFM_REG_FIFO 0x00
+/*! register: operating mode */
+#define RFM_REG_OPMODE 0x01
+/*! register: modulation */
+#define RFM_REG_DATAMODUL 0x02
+/*! register: bit rate, 2 bytes */
+#define RFM_REG_BITRATE 0x03
+/*! register: deviation, 2 bytes */
+#define RFM_REG_FDEV 0x05
+/*! register: carrier, 3 bytes */
+#define RFM_REG_FRF 0x07
+/*! register: chip version */
+#define RFM_REG_VERSION 0x10
+/*! register: rx bandwidth */
+#define RFM_REG_RXBW 0x19
+/*! register: RSSI, -dBm * 2 */
+#define RFM_REG_RSSI 0x24
+/*! register: function of the DIO pins */
+#define RFM_REG_DIOMAP1 0x25
+/*! register: IRQ flags 1 */
+#define RFM_REG_IRQ1 0x27
+/*! register: IRQ flags 2 */
+#define RFM_REG_IRQ2 0x28
+/*! register: preamble length, lsb */
+#define RFM_REG_PREAMBLE 0x2d
+/*! register: sync word config */
+#define RFM_REG_SYNCCONFIG 0x2e
+/*! register: sync word, 2 bytes */
+#define RFM_REG_SYNC 0x2f
+/*! register: packet config 1 */
+#define RFM_REG_PKTCONFIG1 0x37
+/*! register: max rx payload */
+#define RFM_REG_PAYLOADLEN 0x38
+/*! register: FIFO threshold and tx start */
+#define RFM_REG_FIFOTHRESH 0x3c
+/*! register: packet config 2 */
+#define RFM_REG_PKTCONFIG2 0x3d
+/*! register: fading margin */
+#define RFM_REG_TESTDAGC 0x6f
+/*! write access, or-ed to the register */
+#define RFM_WRITE 0x80
+
+/*! opmode: sleep */
+#define RFM_MODE_SLEEP 0x00
+/*! opmode: standby */
+#define RFM_MODE_STDBY 0x04
+/*! opmode: transmit */
+#define RFM_MODE_TX 0x0c
+/*! opmode: receive */
+#define RFM_MODE_RX 0x10
+/*! IRQ flags 1: the mode is ready */
+#define RFM_IRQ1_MODEREADY 0x80
+/*! IRQ flags 2: the packet is sent */
+#define RFM_IRQ2_SENT 0x08
+/*! DIO0 in rx: PayloadReady */
+#define RFM_DIO0_RX 0x40
+/*! DIO0 in tx: PacketSent */
+#define RFM_DIO0_TX 0x00
+
+/*! SPI IRQ: no transfer */
+#define RFM_SPI_IDLE 0
+/*! SPI IRQ: reading a packet from the FIFO */
+#define RFM_SPI_READ 1
+/*! SPI IRQ: writing a packet to the FIFO */
+#define RFM_SPI_WRITE 2
+
+uint8_t rfm_init(void);
+void rfm_mode(const uint8_t mode);
+void rfm_open(void);
+void rfm_puts(const char *s);
+void rfm_close(void);
+uint8_t rfm_busy(void);
+
+#endif
@@ -0,0 +1,139 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file scene.c
+ * \brief Scenes, lists of commands kept in EEPROM.
+ *
+ * The commands of every scene share a single table of
+ * SCENE_ENTRIES in EEPROM, an erased entry is free. The table
+ * is written only when the host changes a scene, the reads and
+ * the writes wait for the store to be idle, see store.h, because
+ * both use the EEPROM registers.
+ *
+ * The 512 bytes of the EEPROM are all in use: 192 by the 4 bytes
+ * entries of the scenes, 176 by the store ring (144 with
+ * HTV_USE_XIO), 88 by the schedule, 38 by the addresses and the
+ * counters, 16 by the key and 1 by BOOT_FLAG, see EEPROM_MAX in
+ * the Makefile. A routine of 120 commands would take 480 bytes
+ * alone, it is kept on the host and sent as P commands, see
+ * onewayd.c, which batches and folds them.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "scene.h"
+#include "store.h"
+
+/*! the commands of the scenes */
+struct scene_t EEMEM EE_scene[SCENE_ENTRIES];
+
+/*! \brief read an entry. */
+static void scene_read(const uint8_t i, struct scene_t *entry)
+{
+	while (store_busy());
+
+	eeprom_read_block(entry, &EE_scene[i], sizeof(struct scene_t));
+}
+
+/*! \brief write an entry. */
+static void scene_write(const uint8_t i, struct scene_t *entry)
+{
+	while (store_busy());
+
+	eeprom_update_block(entry, &EE_scene[i], sizeof(struct scene_t));
+}
+
+/*! \brief add a command to a scene.
+ *
+ * If the scene already has a command for the same address and
+ * pin, the command is replaced.
+ *
+ * \param scene [0:e] the scene.
+ * \return 0 if ok, 1 if the table is full.
+ */
+uint8_t scene_add(const uint8_t scene, const uint16_t address,
+		const uint8_t pin, const uint8_t cmd)
+{
+	struct scene_t entry;
+	uint8_t i, free;
+
+	free = SCENE_ENTRIES;
+
+	for (i = 0; i < SCENE_ENTRIES; i++) {
+		scene_read(i, &entry);
+
+		if ((entry.id == SCENE_FREE) && (free == SCENE_ENTRIES))
+			free = i;
+
+		if (((entry.id >> 4) == scene) && (entry.address == address) &&
+				(entry.pin == pin))
+			break;
+	}
+
+	if (i == SCENE_ENTRIES)
+		i = free;
+
+	if (i == SCENE_ENTRIES)
+		return(1);
+
+	entry.address = address;
+	entry.pin = pin;
+	entry.id = (scene << 4) | (cmd & 0x0f);
+	scene_write(i, &entry);
+	return(0);
+}
+
+/*! \brief remove every command of a scene. */
+void scene_clear(const uint8_t scene)
+{
+	struct scene_t entry;
+	uint8_t i;
+
+	for (i = 0; i < SCENE_ENTRIES; i++) {
+		scene_read(i, &entry);
+
+		if ((entry.id >> 4) == scene) {
+			entry.address = 0xffff;
+			entry.pin = 0xff;
+			entry.id = SCENE_FREE;
+			scene_write(i, &entry);
+		}
+	}
+}
+
+/*! \brief get the next command of a scene.
+ *
+ * \param idx the entry where to start, 0 the first time, it is
+ * moved after the returned one.
+ * \param scene [0:e] the scene.
+ * \param entry the command found.
+ * \return true if a command has been found.
+ */
+uint8_t scene_get(uint8_t *idx, const uint8_t scene, struct scene_t *entry)
+{
+	while (*idx < SCENE_ENTRIES) {
+		scene_read(*idx, entry);
+		(*idx)++;
+
+		if ((entry->id >> 4) == scene)
+			return(1);
+	}
+
+	return(0);
+}
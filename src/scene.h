@@ -0,0 +1,52 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file scene.h
+  \brief Scenes, lists of commands kept in EEPROM.
+  */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+
+/*! number of commands of all the scenes together, the EEPROM
+ * has no room for more, see scene.c. */
+#define SCENE_ENTRIES 48
+/*! number of scenes, the id 0xf marks a free entry. */
+#define SCENE_MAX 0xf
+/*! an erased entry */
+#define SCENE_FREE 0xff
+
+/*! \struct scene_t
+ * A command of a scene.
+ */
+struct scene_t {
+	/*! the address of the remote */
+	uint16_t address;
+	/*! the pin */
+	uint8_t pin;
+	/*! the scene in the high nibble, the command in the low */
+	uint8_t id;
+};
+
+uint8_t scene_add(const uint8_t scene, const uint16_t address,
+		const uint8_t pin, const uint8_t cmd);
+void scene_clear(const uint8_t scene);
+uint8_t scene_get(uint8_t *idx, const uint8_t scene, struct scene_t *entry);
+
+#endif
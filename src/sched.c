@@ -0,0 +1,164 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sched.c
+ * \brief Clock and schedule of the master.
+ *
+ * The clock counts the seconds from a value set by the host, the
+ * meaning of the value, ex. unix time or seconds of the week, is
+ * up to the host. It runs on the tick, see tick.c, and it is lost
+ * at reset: nothing is scheduled until the host sets it again.
+ *
+ * The entries are kept in EEPROM, the time of the next run of
+ * every entry is kept in RAM and computed again when the clock
+ * or the entry change. An entry which is late, ex. the master was
+ * busy transmitting, runs once and then follows its period.
+ *
+ * \note the clock is as good as the cpu oscillator, with the
+ * internal RC the host should set it again every few hours.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "sched.h"
+#include "store.h"
+#include "tick.h"
+
+/*! the entries */
+struct sched_t EEMEM EE_sched[SCHED_ENTRIES];
+
+/*! the clock when it was set */
+static uint32_t clock_base;
+/*! the tick_ms32() when the clock was set */
+static uint32_t clock_tick;
+/*! the clock has been set */
+static uint8_t clock_valid;
+/*! next run of every entry */
+static uint32_t next[SCHED_ENTRIES];
+/*! bit i: the entry i has a next run */
+static uint8_t armed;
+
+/*! \brief the clock in s. */
+uint32_t sched_clock(void)
+{
+	return(clock_base + (tick_ms32() - clock_tick) / 1000UL);
+}
+
+/*! \brief true if the host has set the clock. */
+uint8_t sched_clock_valid(void)
+{
+	return(clock_valid);
+}
+
+/*! \brief read the entry i.
+ *
+ * The read waits for the store to be idle, see store.h.
+ */
+void sched_get(const uint8_t i, struct sched_t *entry)
+{
+	while (store_busy());
+
+	eeprom_read_block(entry, &EE_sched[i], sizeof(struct sched_t));
+}
+
+/*! \brief compute the next run of the entry i.
+ * \param now the clock.
+ */
+static void sched_arm(const uint8_t i, const uint32_t now)
+{
+	struct sched_t entry;
+	uint32_t period;
+
+	sched_get(i, &entry);
+	period = entry.every * 60UL;
+	armed &= ~_BV(i);
+
+	if (entry.type == SCHED_FREE)
+		return;
+
+	if (entry.at >= now)
+		next[i] = entry.at;
+	else if (period)
+		next[i] = entry.at + (now - entry.at + period - 1) / period * period;
+	else
+		return;
+
+	armed |= _BV(i);
+}
+
+/*! \brief set the clock and compute every next run.
+ * \param now the clock in s.
+ */
+void sched_set_clock(const uint32_t now)
+{
+	uint8_t i;
+
+	clock_base = now;
+	clock_tick = tick_ms32();
+	clock_valid = 1;
+
+	for (i = 0; i < SCHED_ENTRIES; i++)
+		sched_arm(i, now);
+}
+
+/*! \brief change the entry i.
+ *
+ * The write waits for the store to be idle, see store.h.
+ */
+void sched_set(const uint8_t i, struct sched_t *entry)
+{
+	while (store_busy());
+
+	eeprom_update_block(entry, &EE_sched[i], sizeof(struct sched_t));
+	sched_arm(i, sched_clock());
+}
+
+/*! \brief find an entry which must run now.
+ *
+ * The next run of the entry is moved to the first one after
+ * the clock.
+ *
+ * \param entry the entry to run.
+ * \return true if an entry must run.
+ */
+uint8_t sched_due(struct sched_t *entry)
+{
+	uint32_t now, period;
+	uint8_t i;
+
+	if (!clock_valid || !armed)
+		return(0);
+
+	now = sched_clock();
+
+	for (i = 0; i < SCHED_ENTRIES; i++)
+		if ((armed & _BV(i)) && (next[i] <= now)) {
+			sched_get(i, entry);
+			period = entry->every * 60UL;
+
+			if (period)
+				next[i] += (now - next[i]) / period * period + period;
+			else
+				armed &= ~_BV(i);
+
+			return(1);
+		}
+
+	return(0);
+}
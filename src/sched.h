@@ -0,0 +1,61 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sched.h
+  \brief Clock and schedule of the master.
+  */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/*! number of entries of the schedule. */
+#define SCHED_ENTRIES 8
+/*! entry type: send a command */
+#define SCHED_PIN 'P'
+/*! entry type: send a scene */
+#define SCHED_SCENE 'S'
+/*! entry type: free, an erased entry */
+#define SCHED_FREE 0xff
+
+/*! \struct sched_t
+ * An entry of the schedule.
+ */
+struct sched_t {
+	/*! clock of the first time, in s */
+	uint32_t at;
+	/*! period in minutes, 0 only once */
+	uint16_t every;
+	/*! SCHED_PIN, SCHED_SCENE or SCHED_FREE */
+	uint8_t type;
+	/*! the address of the remote or the scene */
+	uint16_t address;
+	/*! the pin */
+	uint8_t pin;
+	/*! the command */
+	uint8_t cmd;
+};
+
+void sched_set_clock(const uint32_t now);
+uint8_t sched_clock_valid(void);
+uint32_t sched_clock(void);
+void sched_set(const uint8_t i, struct sched_t *entry);
+void sched_get(const uint8_t i, struct sched_t *entry);
+uint8_t sched_due(struct sched_t *entry);
+
+#endif
@@ -0,0 +1,239 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file store.c
+ * \brief Asynchronous, wear-levelled EEPROM storage.
+ *
+ * The address, the configuration and the output status are kept
+ * in RAM and written in background to a ring of STORE_SLOTS records
+ * in EEPROM, one byte every EE_READY interrupt, the cpu never
+ * waits for the EEPROM.
+ *
+ * Every change marks the RAM copy as pending, changes that arrive
+ * while a record is being written are coalesced in the next one.
+ * Every record goes to the next slot of the ring with an increased
+ * sequence number, the seq byte is written last so an interrupted
+ * write leaves the previous record as the newest valid one.
+ *
+ * \note enable the brown-out detector fuse, the EEPROM can be
+ * corrupted if written while the power is falling.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
+
+#include "store.h"
+
+/*! the ring of records in EEPROM */
+struct store_t EEMEM EE_ring[STORE_SLOTS];
+
+/*! the live copy of the data. */
+static struct store_t store;
+/*! the copy of the record being written. */
+static struct store_t wbuf;
+/*! the RAM copy has changed and must be written. */
+static volatile uint8_t pending;
+/*! the slot in use, last written or being written. */
+static volatile uint8_t slot;
+/*! the next byte of wbuf to write, 0 if idle. */
+static volatile uint8_t widx;
+
+/*! \brief crc8 of a record, the crc field is skipped. */
+static uint8_t store_crc(struct store_t *rec)
+{
+	uint8_t i, crc;
+	uint8_t *p;
+
+	p = (uint8_t *)rec;
+	crc = 0;
+
+	for (i = 0; i < sizeof(struct store_t); i++)
+		if (p + i != &rec->crc)
+			crc = _crc_ibutton_update(crc, *(p + i));
+
+	return(crc);
+}
+
+/*! \brief read the slot i and check it.
+ * \return true if the record is valid.
+ */
+static uint8_t store_read(struct store_t *rec, const uint8_t i)
+{
+	eeprom_read_block(rec, &EE_ring[i], sizeof(struct store_t));
+	return(rec->crc == store_crc(rec));
+}
+
+/*! \brief load the newest valid record from the ring.
+ *
+ * The newest record is the one which is not followed by its
+ * seq + 1, only the seq bytes are read to find it.
+ * If it is damaged, every valid record is checked and
+ * the newest one is taken.
+ * If the ring is empty the store is cleared.
+ */
+void store_init(void)
+{
+	struct store_t rec;
+	uint8_t i, seq, next, found;
+
+	seq = eeprom_read_byte(&EE_ring[0].seq);
+
+	for (i = 0; i < STORE_SLOTS; i++) {
+		next = eeprom_read_byte(&EE_ring[(i + 1) & STORE_SLOTS_MASK].seq);
+
+		if (next != (uint8_t)(seq + 1))
+			break;
+
+		seq = next;
+	}
+
+	slot = i & STORE_SLOTS_MASK;
+	found = store_read(&store, slot);
+
+	/* slow path, look at every record */
+	for (i = 0; (i < STORE_SLOTS) && !found; i++)
+		if (store_read(&rec, i) && (!found ||
+					((int8_t)(rec.seq - store.seq) > 0))) {
+			store = rec;
+			slot = i;
+			found = 1;
+		}
+
+	if (!found) {
+		for (i = 0; i < sizeof(struct store_t); i++)
+			*((uint8_t *)&store + i) = 0;
+
+		slot = STORE_SLOTS_MASK;
+	}
+
+	pending = 0;
+	widx = 0;
+}
+
+/*! \brief queue the RAM copy to be written. */
+static void store_kick(void)
+{
+	pending = 1;
+	EECR |= _BV(EERIE);
+}
+
+/*! \brief the stored address. */
+uint16_t store_get_address(void)
+{
+	return(store.address);
+}
+
+/*! \brief a configuration byte.
+ * \param idx one of STORE_CFG_*.
+ */
+uint8_t store_get_cfg(const uint8_t idx)
+{
+	return(store.cfg[idx]);
+}
+
+/*! \brief a byte of the stored output status.
+ * \param idx [0:STORE_IO_SIZE - 1], the outputs 8 * idx to 8 * idx + 7.
+ */
+uint8_t store_get_io(const uint8_t idx)
+{
+	return(store.io[idx]);
+}
+
+/*! \brief change the address, the write is done in background. */
+void store_set_address(const uint16_t address)
+{
+	if (store.address != address)
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			store.address = address;
+			store_kick();
+		}
+}
+
+/*! \brief change a configuration byte.
+ * \param idx one of STORE_CFG_*.
+ * \param value the new value.
+ */
+void store_set_cfg(const uint8_t idx, const uint8_t value)
+{
+	if (store.cfg[idx] != value) {
+		store.cfg[idx] = value;
+		store_kick();
+	}
+}
+
+/*! \brief change a byte of the output status.
+ * \param idx [0:STORE_IO_SIZE - 1], see store_get_io().
+ * \param io the new value.
+ */
+void store_set_io(const uint8_t idx, const uint8_t io)
+{
+	if (store.io[idx] != io) {
+		store.io[idx] = io;
+		store_kick();
+	}
+}
+
+/*! \brief true while there is something not yet in EEPROM. */
+uint8_t store_busy(void)
+{
+	return(pending || widx || bit_is_set(EECR, EEPE));
+}
+
+/*! \brief write the next byte of the record.
+ *
+ * Bytes equal to the ones already in the slot are skipped,
+ * in this case the EEPROM is still ready and the IRQ is
+ * called again.
+ */
+ISR(EE_READY_vect)
+{
+	uint8_t *p;
+	uint16_t addr;
+
+	if (!widx) {
+		/* nothing left to do */
+		if (!pending) {
+			EECR &= ~_BV(EERIE);
+			return;
+		}
+
+		wbuf = store;
+		wbuf.seq = store.seq + 1;
+		wbuf.crc = store_crc(&wbuf);
+		store.seq = wbuf.seq;
+		slot = (slot + 1) & STORE_SLOTS_MASK;
+		pending = 0;
+	}
+
+	p = (uint8_t *)&wbuf;
+	addr = (uint16_t)(uintptr_t)&EE_ring[slot] + widx;
+	EEAR = addr;
+	EECR |= _BV(EERE);
+
+	if (EEDR != *(p + widx)) {
+		EEDR = *(p + widx);
+		EECR |= _BV(EEMPE);
+		EECR |= _BV(EEPE);
+	}
+
+	if (++widx == sizeof(struct store_t))
+		widx = 0;
+}
@@ -0,0 +1,103 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file store.h
+  \brief Asynchronous, wear-levelled EEPROM storage.
+
+  The EE_READY interrupt writes the EEPROM registers, every other
+  module must wait for store_busy() to be false before a read or
+  a write of the EEPROM after store_init(), or both the access
+  and the record being written are corrupted.
+  */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "xio.h"
+
+#ifdef HTV_USE_XIO
+/*! number of records in the EEPROM ring, must be a power of 2,
+ * fewer for the bigger records of HTV_USE_XIO. */
+#define STORE_SLOTS 8
+/*! bytes of the output status, a bit for every output. */
+#define STORE_IO_SIZE (XIO_PINS / 8)
+#else
+/*! number of records in the EEPROM ring, must be a power of 2. */
+#define STORE_SLOTS 16
+/*! bytes of the output status, a bit for every output. */
+#define STORE_IO_SIZE 1
+#endif
+/*! mask used to wrap the ring index. */
+#define STORE_SLOTS_MASK (STORE_SLOTS - 1)
+#if (STORE_SLOTS & STORE_SLOTS_MASK)
+#error STORE_SLOTS is not a power of 2
+#endif
+
+/*! number of configuration bytes in a record. */
+#define STORE_CFG_SIZE 6
+/*! configuration byte: generic flags. */
+#define STORE_CFG_FLAGS 0
+/*! configuration byte: id of the master [0:f]. */
+#define STORE_CFG_ID 1
+/*! configuration byte: number of tx slots, 0 or 1 no slots. */
+#define STORE_CFG_SLOTS 2
+/*! configuration byte: master, number of repeaters [0:f]. */
+#define STORE_CFG_HOPS 3
+/*! configuration byte: master, duty-cycle in 0.1% units, see duty.h. */
+#define STORE_CFG_DUTY 4
+/*! configuration byte: master, s between state frames, see sync.h. */
+#define STORE_CFG_SYNC 5
+
+/*! flag: echo disabled on the host link. */
+#define STORE_FLAG_NOECHO _BV(0)
+/*! flag: the slave repeats the frames it receives. */
+#define STORE_FLAG_REPEATER _BV(1)
+/*! flag: the master asks the receivers for an ack. */
+#define STORE_FLAG_ACK _BV(2)
+
+/*! \struct store_t
+ * A single record of the ring.
+ *
+ * \note the seq must be the last field, it is the last byte
+ * written and marks the record as complete.
+ */
+struct store_t {
+	/*! the htv network address */
+	uint16_t address;
+	/*! configuration bytes */
+	uint8_t cfg[STORE_CFG_SIZE];
+	/*! the output pins status */
+	uint8_t io[STORE_IO_SIZE];
+	/*! crc8 of the record, crc excluded */
+	uint8_t crc;
+	/*! sequence number of the record */
+	uint8_t seq;
+};
+
+void store_init(void);
+uint16_t store_get_address(void);
+uint8_t store_get_cfg(const uint8_t idx);
+uint8_t store_get_io(const uint8_t idx);
+void store_set_address(const uint16_t address);
+void store_set_cfg(const uint8_t idx, const uint8_t value);
+void store_set_io(const uint8_t idx, const uint8_t io);
+uint8_t store_busy(void);
+
+#endif
@@ -0,0 +1,275 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file suart.c
+ * \brief Second radio channel of the master on a software UART.
+ *
+ * USART0 is the host and USART1 the radio, a second radio module,
+ * on another frequency or for another zone, is driven by Timer2
+ * and a pin change IRQ, see HTV_USE_SUART. The master routes the
+ * frames to the modules by address, see tx_channel().
+ *
+ * The transmission runs in the Timer2 IRQ, a bit at every compare
+ * match, from a buffer filled by suart_printstr(), so the master
+ * sends a frame on the USART1 while this one is on the air.
+ * Keying up and the squelch delay are idle bits sent before the
+ * first char, like radio_start_tx() does with the delays.
+ *
+ * The module is half duplex, between the transmissions the data
+ * out of the module is received for the listen before talk: the
+ * falling edge of the start bit wakes the pin change IRQ and the
+ * bits are sampled in the middle by Timer2. The chars are not
+ * kept, two in a row which can be part of a frame mean that the
+ * channel is in use, as in radio_busy().
+ *
+ * At 1200 bps a bit is 833 cpu cycles, the IRQ is called once per
+ * bit only when the line is busy.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "suart.h"
+#include "uart.h"
+#include "radio.h"
+#include "tick.h"
+
+/*! the chars to send */
+static char buf[SUART_BUF_SIZE];
+/*! where the next char is put and where the IRQ takes it */
+static volatile uint8_t head, tail;
+/*! a transmission is open or still on the air */
+static volatile uint8_t tx_on;
+/*! no more chars, key down when the buffer is empty */
+static volatile uint8_t closing;
+/*! idle bits left to send */
+static uint8_t idle;
+/*! bit of the char on the air, 0 start, 1..8 data, 9..10 stop */
+static uint8_t bit;
+/*! the char on the air or being received */
+static uint8_t c;
+/*! chars in a row which can be part of a frame */
+static uint8_t heard_n;
+/*! tick_ms() when the channel was last heard busy */
+static volatile uint16_t heard;
+
+/*! \brief start Timer2, the first match after t cycles. */
+static void suart_timer(const uint8_t t)
+{
+	TCNT2 = SUART_BIT - t;
+	TIFR2 = _BV(OCF2A);
+	TIMSK2 = _BV(OCIE2A);
+	TCCR2B = _BV(CS21);
+}
+
+/*! \brief stop Timer2 and wait for a start bit. */
+static void suart_listen(void)
+{
+	TCCR2B = 0;
+	TIMSK2 = 0;
+	PCIFR = _BV(PCIF2);
+	PCMSK2 |= _BV(PCINT17);
+}
+
+/*! \brief set up the pins and Timer2, and listen.
+ * \note the tick must be running, see tick_init().
+ */
+void suart_init(void)
+{
+	uint8_t mcucr;
+
+	/* PC2 and PC3 are the JTAG TCK and TMS, not i/o pins while the
+	 * fuse JTAGEN is programmed, as from the factory and with
+	 * HFUSE 0x98 or 0x99: JTD off, written twice in 4 cycles */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		mcucr = MCUCR | _BV(JTD);
+		MCUCR = mcucr;
+		MCUCR = mcucr;
+	}
+
+	SUART_DDR |= _BV(SUART_TXD) | _BV(SUART_TXRX) | _BV(SUART_ENABLE);
+	SUART_DDR &= ~_BV(SUART_RXD);
+	/* idle line, module enabled in rx */
+	SUART_PORT |= _BV(SUART_TXD) | _BV(SUART_ENABLE);
+	SUART_PORT &= ~_BV(SUART_TXRX);
+
+	/* CTC, a match every bit */
+	TCCR2A = _BV(WGM21);
+	OCR2A = SUART_BIT - 1;
+	heard = tick_ms() - RADIO_LBT_MS;
+	PCICR |= _BV(PCIE2);
+	suart_listen();
+}
+
+/*! \brief key up the module, the chars follow.
+ * \note the previous transmission must be over, see suart_busy().
+ */
+void suart_open(void)
+{
+	PCMSK2 &= ~_BV(PCINT17);
+	TCCR2B = 0;
+	head = 0;
+	tail = 0;
+	closing = 0;
+	idle = SUART_LEAD_BITS;
+	bit = 0;
+	tx_on = 1;
+	SUART_PORT |= _BV(SUART_TXD) | _BV(SUART_TXRX);
+	suart_timer(SUART_BIT);
+}
+
+/*! \brief queue a string, wait only if the buffer is full. */
+void suart_printstr(const char *s)
+{
+	uint8_t i;
+
+	while (*s) {
+		i = (head + 1) & SUART_BUF_MASK;
+
+		/* wait for room in the buffer */
+		while (i == tail);
+
+		buf[head] = *s++;
+		head = i;
+	}
+}
+
+/*! \brief key down after the chars queued, in the IRQ. */
+void suart_close(void)
+{
+	closing = 1;
+}
+
+/*! \brief true if a transmission is still on the air. */
+uint8_t suart_busy(void)
+{
+	return(tx_on);
+}
+
+/*! \brief true if the channel has been in use in the last
+ * RADIO_LBT_MS.
+ */
+uint8_t suart_heard(void)
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		t = heard;
+
+	return(!tick_elapsed(t, RADIO_LBT_MS));
+}
+
+/*! \brief the next bit of the transmission. */
+static void suart_tx_bit(void)
+{
+	if (!bit) {
+		if (idle) {
+			idle--;
+			return;
+		}
+
+		if (head == tail) {
+			if (!closing)
+				return;
+
+			/* all sent, the tail and then key down */
+			idle = SUART_TAIL_BITS;
+			bit = 11;
+			return;
+		}
+
+		c = buf[tail];
+		tail = (tail + 1) & SUART_BUF_MASK;
+		SUART_PORT &= ~_BV(SUART_TXD);
+	} else if (bit < 9) {
+		if (c & 1)
+			SUART_PORT |= _BV(SUART_TXD);
+		else
+			SUART_PORT &= ~_BV(SUART_TXD);
+
+		c >>= 1;
+	} else if (bit < 11) {
+		SUART_PORT |= _BV(SUART_TXD);
+	} else if (idle) {
+		idle--;
+		return;
+	} else {
+		SUART_PORT &= ~_BV(SUART_TXRX);
+		tx_on = 0;
+		suart_listen();
+		return;
+	}
+
+	bit = (bit == 10) ? 0 : bit + 1;
+}
+
+/*! \brief the next bit of the char being received. */
+static void suart_rx_bit(void)
+{
+	uint8_t b;
+
+	b = bit_is_set(SUART_PIN, SUART_RXD);
+
+	if (!bit) {
+		/* a glitch, not a start bit */
+		if (b) {
+			suart_listen();
+			return;
+		}
+	} else if (bit < 9) {
+		c = (c >> 1) | (b ? 0x80 : 0);
+	} else {
+		if (b && ((c == 'x') || (c == ':') ||
+					((c >= '0') && (c <= '9')) ||
+					((c >= 'a') && (c <= 'f')) ||
+					((c >= 'K') && (c <= 'Z')))) {
+			if (++heard_n > 1)
+				heard = tick_ms();
+		} else {
+			heard_n = 0;
+		}
+
+		suart_listen();
+		return;
+	}
+
+	bit++;
+}
+
+/*! \brief a bit time. */
+ISR(TIMER2_COMPA_vect)
+{
+	if (tx_on)
+		suart_tx_bit();
+	else
+		suart_rx_bit();
+}
+
+/*! \brief an edge of the data out of the module. */
+ISR(PCINT2_vect)
+{
+	/* only the falling edge of a start bit */
+	if (bit_is_set(SUART_PIN, SUART_RXD))
+		return;
+
+	PCMSK2 &= ~_BV(PCINT17);
+	bit = 0;
+	/* sample in the middle of the bit */
+	suart_timer(SUART_BIT / 2);
+}
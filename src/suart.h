@@ -0,0 +1,63 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file suart.h
+  \brief Second radio channel of the master on a software UART.
+  */
+
+#ifndef SUART_H
+#define SUART_H
+
+#include <stdint.h>
+
+/*! port of the second radio module */
+#define SUART_PORT PORTC
+/*! data direction register */
+#define SUART_DDR DDRC
+/*! input register */
+#define SUART_PIN PINC
+/*! data to the module */
+#define SUART_TXD PC0
+/*! data from the module, PCINT17 */
+#define SUART_RXD PC1
+/*! switch tx/rx of the module, also the JTAG TCK, see suart_init() */
+#define SUART_TXRX PC2
+/*! enable of the module, also the JTAG TMS */
+#define SUART_ENABLE PC3
+
+/*! Timer2 cycles of a bit at clk/8, 1201.9 bps */
+#define SUART_BIT ((F_CPU / 8 + UART_BAUD_1 / 2) / UART_BAUD_1)
+/*! idle bits after keying up, the squelch of the receivers */
+#define SUART_LEAD_BITS 13
+/*! idle bits before keying down */
+#define SUART_TAIL_BITS 2
+/*! chars buffered for the transmission, power of 2 */
+#define SUART_BUF_SIZE 64
+/*! mask used to wrap the buffer index */
+#define SUART_BUF_MASK (SUART_BUF_SIZE - 1)
+#if (SUART_BUF_SIZE & SUART_BUF_MASK)
+#error SUART_BUF_SIZE is not a power of 2
+#endif
+
+void suart_init(void);
+void suart_open(void);
+void suart_printstr(const char *s);
+void suart_close(void);
+uint8_t suart_busy(void);
+uint8_t suart_heard(void);
+
+#endif
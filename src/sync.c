@@ -0,0 +1,201 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sync.c
+ * \brief Desired state of the remotes, sent again in background.
+ *
+ * Every command sent by the master changes the state it wants
+ * for the pins of the remote, or makes it unknown. The state of
+ * the last SYNC_ENTRIES remotes which got a command is kept in
+ * RAM, a few at a time it goes
+ * on the air in a state frame, see \ref subrxwcmd, so a remote
+ * which has lost a frame or the power gets the state back.
+ *
+ * Only those remotes converge: on a ward with more of them the
+ * remote which got a command longest ago is forgotten, and only
+ * the pins 0 and 1 are kept, the other outputs of a receiver
+ * with HTV_USE_XIO never converge. The table takes 5 bytes of the
+ * 1 KiB of RAM for every remote, the default 16 leaves the master
+ * its stack, see SYNC_ENTRIES.
+ *
+ * \note the table is not saved, after a reset of the master it
+ * is filled again by the new commands.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "sync.h"
+#include "htv.h"
+
+/*! the state of the remotes */
+static struct sync_t sync[SYNC_ENTRIES];
+/*! the first entry of the next state frame */
+static uint8_t sync_next;
+/*! the commands sent, the time of the entries, see sync_set() */
+static uint16_t sync_clock;
+
+/*! \brief forget every remote. */
+void sync_init(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < SYNC_ENTRIES; i++)
+		sync[i].address = SYNC_FREE;
+
+	sync_next = 0;
+}
+
+/*! \brief apply a command to the state of an entry.
+ * \param mask the pins, one bit for every pin.
+ */
+static void sync_cmd(struct sync_t *entry, const uint8_t mask,
+		const uint8_t cmd)
+{
+	switch (cmd) {
+		case 0:
+			entry->io = (entry->io & ~mask) | (mask << SYNC_PINS);
+			break;
+		case 1:
+			entry->io |= mask | (mask << SYNC_PINS);
+			break;
+		case 2:
+			/* toggle, only the known pins */
+			entry->io ^= mask & (entry->io >> SYNC_PINS);
+			break;
+		default:
+			/* on a timer, the remote switches it off by itself */
+			entry->io &= ~(mask << SYNC_PINS);
+	}
+}
+
+/*! \brief a command has been sent.
+ *
+ * The broadcast address changes every remote already known, a
+ * new remote takes a free entry, if there is none it takes the
+ * entry of the remote without commands for the longest time.
+ *
+ * \param pin the pin or 0xff every pin.
+ * \param cmd the command, one of IO_CMD_*.
+ */
+void sync_set(const uint16_t address, const uint8_t pin, const uint8_t cmd)
+{
+	uint8_t i, free, mask;
+	uint16_t age;
+
+	if (pin == 0xff)
+		mask = _BV(SYNC_PINS) - 1;
+	else if (pin < SYNC_PINS)
+		mask = _BV(pin);
+	else
+		return;
+
+	sync_clock++;
+	free = 0;
+	age = 0;
+
+	for (i = 0; i < SYNC_ENTRIES; i++) {
+		/* a free entry is older than any other */
+		if (sync[i].address == SYNC_FREE) {
+			if (age != 0xffff) {
+				free = i;
+				age = 0xffff;
+			}
+
+			continue;
+		}
+
+		if ((address == 0xffff) || (sync[i].address == address)) {
+			sync_cmd(&sync[i], mask, cmd);
+
+			if (address != 0xffff) {
+				sync[i].used = sync_clock;
+				return;
+			}
+		}
+
+		if ((uint16_t)(sync_clock - sync[i].used) > age) {
+			free = i;
+			age = sync_clock - sync[i].used;
+		}
+	}
+
+	if (address == 0xffff)
+		return;
+
+	sync[free].address = address;
+	sync[free].io = 0;
+	sync[free].used = sync_clock;
+	sync_cmd(&sync[free], mask, cmd);
+}
+
+/*! \brief the remote has changed its address. */
+void sync_move(const uint16_t old, const uint16_t address)
+{
+	uint8_t i;
+
+	for (i = 0; i < SYNC_ENTRIES; i++)
+		if (sync[i].address == address)
+			sync[i].address = SYNC_FREE;
+
+	for (i = 0; i < SYNC_ENTRIES; i++)
+		if (sync[i].address == old)
+			sync[i].address = address;
+}
+
+/*! \brief an entry of the table.
+ * \return true if the entry is used.
+ */
+uint8_t sync_get(const uint8_t i, struct sync_t *entry)
+{
+	*entry = sync[i];
+	return(entry->address != SYNC_FREE);
+}
+
+/*! \brief the next state frame, SNAAAAV..AAAAV.
+ *
+ * Up to HTV_SYNC_MAX remotes with a known pin, the next frame
+ * goes on from the last one.
+ *
+ * \param s the frame, HTV_SYNC_MAX * 5 + 3 chars.
+ * \return the number of remotes in the frame, 0 none.
+ */
+uint8_t sync_frame(char *s)
+{
+	uint8_t i, n;
+
+	n = 0;
+
+	for (i = 0; (i < SYNC_ENTRIES) && (n < HTV_SYNC_MAX); i++) {
+		if ((sync[sync_next].address != SYNC_FREE) &&
+				(sync[sync_next].io >> SYNC_PINS)) {
+			htv_hex(s + 2 + n * 5, sync[sync_next].address, 4);
+			htv_hex(s + 6 + n * 5, sync[sync_next].io, 1);
+			n++;
+		}
+
+		sync_next = (sync_next + 1) % SYNC_ENTRIES;
+	}
+
+	*s = HTV_TYPE_SYNC;
+	*(s + 1) = '0' + n;
+
+	if (!n)
+		*(s + 2) = 0;
+
+	return(n);
+}
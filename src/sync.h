@@ -0,0 +1,62 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file sync.h
+  \brief Desired state of the remotes, sent again in background.
+  */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdint.h>
+
+/*! number of remotes whose state is kept, 5 bytes of RAM each.
+ * The RAM of the master is nearly all in use, a bigger table must
+ * be checked on the board. */
+#ifndef SYNC_ENTRIES
+#define SYNC_ENTRIES 16
+#endif
+/*! pins of a remote, see IO_PIN0 and IO_PIN1, the outputs over
+ * them of HTV_USE_XIO are not kept. */
+#define SYNC_PINS 2
+/*! a free entry */
+#define SYNC_FREE 0xffff
+/*! s between two state frames when not configured. */
+#define SYNC_DEFAULT_S 30
+/*! STORE_CFG_SYNC value: no state frames */
+#define SYNC_OFF 0xff
+
+/*! \struct sync_t
+ * The state of a remote.
+ */
+struct sync_t {
+	/*! the address of the remote or SYNC_FREE */
+	uint16_t address;
+	/*! the state of the pins in the bits 0-1, the known pins in
+	 * the bits 2-3, as in the state frame */
+	uint8_t io;
+	/*! the sync_clock of the last command */
+	uint16_t used;
+};
+
+void sync_init(void);
+void sync_set(const uint16_t address, const uint8_t pin, const uint8_t cmd);
+void sync_move(const uint16_t old, const uint16_t address);
+uint8_t sync_get(const uint8_t i, struct sync_t *entry);
+uint8_t sync_frame(char *s);
+
+#endif
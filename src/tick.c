@@ -0,0 +1,84 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file tick.c
+ * \brief Millisecond clock.
+ *
+ * Timer0 in CTC mode interrupts every ms. The counter is 32 bit,
+ * tick_ms() gives the lower 16 bit which are enough for intervals
+ * shorter than 32 s.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "tick.h"
+
+/*! ms from tick_init() */
+static volatile uint32_t tick;
+
+/*! \brief start the Timer0 */
+void tick_init(void)
+{
+	tick = 0;
+	OCR0A = TICK_OCR;
+	/* CTC mode */
+	TCCR0A = _BV(WGM01);
+	/* clk/8 */
+	TCCR0B = _BV(CS01);
+	TIMSK0 |= _BV(OCIE0A);
+}
+
+/*! \brief the ms counter, lower 16 bit. */
+uint16_t tick_ms(void)
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		t = tick;
+
+	return(t);
+}
+
+/*! \brief the ms counter, wraps after 49 days. */
+uint32_t tick_ms32(void)
+{
+	uint32_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		t = tick;
+
+	return(t);
+}
+
+/*! \brief check if ms have passed.
+ * \param since a tick_ms() value.
+ * \param ms the interval, max 32767.
+ * \return true if the interval is over.
+ */
+uint8_t tick_elapsed(const uint16_t since, const uint16_t ms)
+{
+	return((uint16_t)(tick_ms() - since) >= ms);
+}
+
+/*! \brief the clock IRQ */
+ISR(TIMER0_COMPA_vect)
+{
+	tick++;
+}
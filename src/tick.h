@@ -0,0 +1,37 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file tick.h
+  \brief Millisecond clock.
+  */
+
+#ifndef TICK_H
+#define TICK_H
+
+#include <stdint.h>
+
+/*! Timer0 prescaler */
+#define TICK_PRESCALER 8UL
+/*! Timer0 compare value for 1 ms */
+#define TICK_OCR ((F_CPU / TICK_PRESCALER / 1000UL) - 1)
+
+void tick_init(void);
+uint16_t tick_ms(void);
+uint32_t tick_ms32(void);
+uint8_t tick_elapsed(const uint16_t since, const uint16_t ms);
+
+#endif
@@ -24,10 +24,19 @@
  *
  * \section seccmd Possible command:
  * - \ref subacmd
+ * - \ref subbcmd
  * - \ref subccmd
+ * - \ref subdcmd
  * - \ref subecmd
  * - \ref sublcmd
+ * - \ref submcmd
  * - \ref subpcmd
+ * - \ref subqcmd
+ * - \ref subrcmd
+ * - \ref subscmd
+ * - \ref subtcmd
+ * - \ref subucmd
+ * - \ref subwcmd
  * - \ref subhcmd
  *
  * \subsection subacmd A - change the address of a remote.
@@ -47,12 +56,50 @@
  * <- OK
  *
  * will change the device address 0x0123 to 0x1CDF.
+ * The OOOO and NNNN must be repeated equal, NNNN can not be
+ * 0000 or FFFF.
+ *
+ * \subsection subbcmd B - firmware update of the receivers.
+ * B:BBB:CCCC, B:BBB:MMMMMMMM or B:BBB:DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD
+ *
+ * where:
+ * - BBB is the number of blocks of the image, or the block.
+ * - CCCC is the CRC-CCITT of the image, see boot.h.
+ * - MMMMMMMM is the MAC of the image in place of its CRC, only
+ *   and always with a key, see \ref subucmd and auth_flash().
+ * - DD.. are the 16 bytes of the block.
+ *
+ * The first form sends the image frame, the receivers with
+ * another firmware reset in the boot loader. The second sends a
+ * block, the master adds its CRC, see \ref subrxycmd. The master
+ * does not keep the image, the host sends all the blocks again
+ * and again with the image frame every few blocks, until all the
+ * receivers run the new firmware, see host/owflash.c.
+ *
+ * reply to the 'B' command can be:
+ * - "OK" the frame is queued.
+ * - "ko" the queue is full, try later, or the image frame has
+ *   the CRC with a key or the MAC without.
+ *
+ * example:
+ *
+ * -> B:2c0:5a3e\n
+ * <- OK
+ * -> B:000:0c9434000c9451000c9451000c945100\n
+ * <- OK
  *
  * \subsection subccmd C - change the id of the master.
- * C:N
+ * C:N or C:N:S
  *
  * where:
  * - N is the new address [0:f]
+ * - S is the number of tx slots [0:f], 0 or 1 no slots.
+ *
+ * The id is sent in every frame. When more masters share the
+ * channel, each one transmits only in the slot N modulo S of
+ * TX_SLOT_MS, the slots restart when this command is received.
+ * A master with the transceiver (HTV_USE_RTX) listens before
+ * talking instead and does not use the slots.
  *
  * reply to the 'C' command can be:
  * - "OK" the address has changed.
@@ -65,6 +112,31 @@
  *
  * will change the master address 0x0 to 0xD.
  *
+ * \subsection subdcmd D - airtime duty-cycle.
+ * D print the airtime.\n
+ * D:hh set the duty-cycle.
+ *
+ * where:
+ * - hh is the duty-cycle in 0.1% units, 00 is the default 1%,
+ *   ff no limit.
+ *
+ * The time on the air of every transmission is measured and taken
+ * from a bucket which holds the duty-cycle of an hour, ex. 36 s
+ * at 1%, and refills at the same rate, see duty.c. A transmission
+ * waits in a queue of TXQ_SIZE until the bucket has its time, the
+ * commands which send frames reply "OK" when the frame is queued
+ * and "ko" when the queue is full.
+ * The reply to 'D' is the ms left, the size of the bucket in ms
+ * and the number of transmissions queued. With the second radio
+ * channel, see HTV_USE_SUART, the ms left on it follow.
+ *
+ * example:
+ *
+ * -> D\n
+ * <- 00008c3a:00008ca0:0
+ *
+ * 35898 ms left of 36000, nothing queued.
+ *
  * \subsection subecmd E - echo on off.
  * E:X
  *
@@ -76,7 +148,7 @@
  * -> E:0\n
  * <- OK
  *
- * echo disabled.
+ * echo disabled, the setting is kept across a reset.
  *
  * \subsection sublcmd L - print the TX id.
  * example (id = 2):
@@ -84,6 +156,20 @@
  * -> L\n
  * <- 2
  *
+ * \subsection submcmd M - benchmark.
+ * Only with HTV_USE_BENCH, the tests of bench.c and the build of
+ * a P frame, the cpu cycles of each as NAME:MMMM:AAAA:XXXX, the
+ * min, the average and the max of the runs, hex. With a key the
+ * P frame is built with its counter and MAC.
+ *
+ * example (the numbers depend on the board):
+ *
+ * -> M\n
+ * <- crc8:..:..:..\n
+ * <- ...\n
+ * <- p:..:..:..\n
+ * <- OK
+ *
  * \subsection subpcmd P - send a command to a remote.
  * P:AAAA:PP:C\n
  *
@@ -94,14 +180,17 @@
  * - PP is the pin number in Ascii/hex form from 00 to FF where:
  *   - 00 - i/o pin 0
  *   - 01 - i/o pin 1
+ *   - 02 to XIO_PINS - 1, the receivers with HTV_USE_XIO
  *   - FF - All pin
  * - C is the command in ascii/hex where:
  *   - 0 is off.
  *   - 1 is on.
+ *   - 2 is toggle.
  *
  * reply to the 'P' command can be:
  * - "OK" the command is received and forwarded to the clients.
- * - "ko" some error occured.
+ * - "ko" some error occured, or the pin or the command is not
+ *   one of the above.
  *
  * example
  *
@@ -112,197 +201,1616 @@
  * \note address "0000" is used by unconfigurd devices and
  * should not be used in normal condition.
  *
+ * P:AAAA:PP:C:DDDD\n
+ *
+ * sends a command with a duration, where C is:
+ * - 3 pulse, on for DDDD ms.
+ * - 4 on for DDDD minutes, then off.
+ *
+ * The receiver switches the pin off by itself, see \ref subrxtcmd.
+ *
+ * With the second radio channel, see HTV_USE_SUART, the commands
+ * for the addresses from TX_SUART_FROM up are sent on it, the
+ * broadcast on both, and the two channels transmit at the same
+ * time. The commands on the second channel are never acked.
+ *
+ * A command waits TX_HOLD_MS in the queue before it is sent, a
+ * newer command for the same remote and pin in the meantime
+ * replaces it and only the last one goes on the air. A toggle is
+ * folded with the queued command instead, two toggles cancel each
+ * other, a toggle after an on becomes an off and so on. The commands
+ * for different remotes or pins are sent in the order of their
+ * last change, the wait is from the first command replaced, so a
+ * pin changed again and again is not delayed forever.
+ *
+ * example
+ *
+ * -> P:012F:00:3:07d0\n
+ * <- OK
+ *
+ * a 2 s pulse on the pin 0 of 012F.
+ *
+ * \subsection subqcmd Q - ack mode.
+ * Q:X
+ *
+ * where:
+ * - X can be '0' or '1', 0 - no acks, 1 - ack mode.
+ *
+ * Only with the transceiver (HTV_USE_RTX). In ack mode the frames
+ * for a single address, not the broadcast nor the scenes, ask the
+ * receiver for an ack, see \ref subrxkcmd. A frame not
+ * acknowledged in TX_ACK_MS is sent again, up to TX_TRIES times,
+ * then the result is printed on a line of its own:
+ *
+ * - "!<frame> OK" the receiver has acknowledged the frame.
+ * - "!<frame> ko" no ack.
+ *
+ * where <frame> is the frame without the envelope, ex. 012f011.
+ * The setting is kept across a reset.
+ *
+ * example:
+ *
+ * -> Q:1\n
+ * <- OK
+ * -> P:012F:01:1\n
+ * <- OK
+ * <- !012f011 OK
+ *
+ * \subsection subrcmd R - number of repeaters.
+ * R:H
+ *
+ * where:
+ * - H is the max number of repeaters a frame can go through [0:f].
+ *
+ * Every frame carries H, a repeater which receives it sends it
+ * again with H - 1, the frames with H = 0 are not repeated.
+ * The setting is kept across a reset, the default 0 means
+ * no repeaters.
+ *
+ * example:
+ *
+ * -> R:2\n
+ * <- OK
+ *
+ * \subsection subscmd S, V, X - scenes.
+ * S:N:AAAA:PP:C add a command to a scene.\n
+ * S:N send the scene.\n
+ * V:N print the commands of the scene.\n
+ * X:N delete the scene.
+ *
+ * where:
+ * - N is the scene [0:e].
+ * - AAAA, PP and C are the same of the 'P' command.
+ *
+ * The scenes are kept in EEPROM, SCENE_ENTRIES (48) commands for
+ * all of them together, the EEPROM is full, see scene.c. A
+ * command for an address and pin already in the scene replaces
+ * the old one.
+ * The scene is sent with a single host line, the frames go out
+ * back to back, TX_BURST for every transmission, or one at a
+ * time if the tx slots are in use.
+ *
+ * reply to the 'S' command can be:
+ * - "OK" the scene is changed or sent.
+ * - "ko" wrong scene, pin or command, or no space left.
+ *
+ * example:
+ *
+ * -> S:1:012F:01:0\n
+ * <- OK
+ * -> S:1:0130:ff:0\n
+ * <- OK
+ * -> S:1\n
+ * <- OK
+ *
+ * will turn off the pin 1 of 012F and every pin of 0130.
+ *
+ * \subsection subtcmd K, T, Y - clock and schedule.
+ * K:TTTTTTTT set the clock.\n
+ * K print the clock.\n
+ * T:I:TTTTTTTT:MMMM:AAAA:PP:C send a command at a time.\n
+ * T:I:TTTTTTTT:MMMM:S:N send a scene at a time.\n
+ * T print the schedule.\n
+ * Y:I delete an entry.
+ *
+ * where:
+ * - TTTTTTTT is the clock in s, hex. In the T command +TTTTTTT
+ *   is the time from now.
+ * - I is the entry of the schedule [0:7].
+ * - MMMM is the period in minutes, 0000 only once.
+ * - AAAA, PP and C are the same of the 'P' command, the entry has
+ *   no duration so the C 3 and 4 are not taken.
+ * - N is the scene, see \ref subscmd.
+ *
+ * The master sends the entries by itself, also when the host
+ * is not there. The schedule is kept in EEPROM, the clock is not:
+ * after a reset nothing is sent until the clock is set again,
+ * see sched.c.
+ *
+ * example:
+ *
+ * -> K:00010000\n
+ * <- OK
+ * -> T:0:+000003c:0000:012F:01:1\n
+ * <- OK
+ * -> T:1:00010000:003c:S:2\n
+ * <- OK
+ *
+ * turn on the pin 1 of 012F in a minute, send the scene 2 every
+ * hour.
+ *
+ * \subsection subucmd U - authenticated frames.
+ * U:KKKKKKKKKKKKKKKKKKKKKKKKKKKKKKKK
+ *
+ * where:
+ * - K are the 16 bytes of the key in hex, all ff removes the key.
+ *
+ * With a key every frame is sent with a counter and a MAC, see
+ * \ref subrxvcmd, the receivers need the same key. The key is
+ * kept in EEPROM and it can not be read back. The authenticated
+ * frames do not ask for an ack, see \ref subqcmd.
+ *
+ * example:
+ *
+ * -> U:000102030405060708090a0b0c0d0e0f\n
+ * <- OK
+ *
+ * \subsection subwcmd W - state of the remotes.
+ * W print the state.\n
+ * W:hh set the period.
+ *
+ * where:
+ * - hh is the time between two state frames in s, 00 is the
+ *   default 30 s, ff no state frames.
+ *
+ * The master keeps the state it wants for the pins 0 and 1 of the
+ * last SYNC_ENTRIES (16) remotes it has sent a command to, see
+ * sync.c, the others and the outputs over the pin 1 of
+ * HTV_USE_XIO do not converge by themselves. When
+ * nothing else is queued and more than half of the airtime is left,
+ * it sends the state of a few remotes in a state frame, see
+ * \ref subrxwcmd, so a remote which has missed a command or has
+ * been off converges by itself. The pins on a timer and the
+ * toggles of an unknown pin are not in the state.
+ * 'W' prints a line AAAA:V for every remote, V as in the frame.
+ *
+ * example:
+ *
+ * -> W\n
+ * <- 012f:5\n
+ * <- 0130:c\n
+ * <- OK
+ *
  * \subsection subhcmd ? - help command.
  * example:
  *
  * -> ?\n
  * <- the brief commands descrption.
  *
- * \todo the A command is not implemented yet.
- * \todo the C command is not implemented yet.
+ * Every command is checked against the table in flash, see
+ * cmd.c, an unknown command or a wrong argument is replied
+ * with "ko".
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include <avr/io.h>
+#include <util/crc16.h>
 #include <util/delay.h>
 #include "transmit.h"
 
-/*! \brief Enable TX signal. */
-void start_tx(void)
+/*! start of the tx slots, see tx_wait_channel(). */
+static uint32_t slot_origin;
+/*! sequence number of the next frame, see tx_frame(). */
+static uint8_t tx_seq;
+/*! tick_ms32() of the last state frame, see tx_sync(). */
+static uint32_t sync_last;
+/*! the transmissions waiting for airtime, see tx_run(). */
+static struct txq_t txq[TXQ_SIZE];
+/*! next free and first queued entry of txq, free running. */
+static uint8_t txq_head, txq_tail;
+#ifdef HTV_USE_RTX
+/*! the ack being received, see tx_ack(). */
+static char tx_ack_buf[HTV_ACK_LEN + 1];
+/*! 'x' received before the ack and chars of the ack. */
+static uint8_t tx_ack_sync, tx_ack_idx;
+#endif
+
+/*! \brief wait until this master can transmit.
+ *
+ * With the transceiver (HTV_USE_RTX) listen before talk, if the
+ * channel is busy wait a random time, longer for higher id.
+ *
+ * Else, if the tx slots are configured, wait for the slot of
+ * this id. The slots restart when the 'C' command is received,
+ * send it to every master at the same time to align them.
+ */
+static void tx_wait_channel(void)
+{
+	uint8_t id;
+#ifndef HTV_USE_RTX
+	uint8_t slots;
+#endif
+
+	id = store_get_cfg(STORE_CFG_ID);
+
+#ifdef HTV_USE_RTX
+	/* the master does not receive frames, only what comes now */
+	radio_flush();
+	radio_lbt(id);
+#else
+	slots = store_get_cfg(STORE_CFG_SLOTS);
+
+	if (slots > 1)
+		while (((tick_ms32() - slot_origin) / TX_SLOT_MS % slots != id % slots) ||
+				((tick_ms32() - slot_origin) % TX_SLOT_MS > TX_SLOT_GUARD));
+#endif
+}
+
+/*! \brief the frames which can be sent back to back.
+ *
+ * A burst longer than a frame does not fit in a tx slot.
+ */
+static uint8_t tx_burst(void)
+{
+#ifndef HTV_USE_RTX
+	if (store_get_cfg(STORE_CFG_SLOTS) > 1)
+		return(1);
+#endif
+
+	return(TX_BURST);
+}
+
+/*! \brief add the envelope and the crc.
+ *
+ * The frame in htv->x10str, ex. AAAAPPC, becomes MIHSSAAAAPPC:RR
+ * where I is the id of this master, H the number of repeaters
+ * allowed and SS the sequence number of the frame, htv->seq.
+ * If htv->ack the envelope is QIHSS, the receiver acks the frame.
+ *
+ * With a key the frame becomes VIHCCCCCCAAAAPPC:MMMMMMMM, with
+ * the counter and the MAC, see auth.c.
+ */
+static void tx_envelope(struct htv_t *htv)
+{
+	uint8_t len, env;
+
+	htv_hex(htv->substr + 1, store_get_cfg(STORE_CFG_ID), 1);
+	htv_hex(htv->substr + 2, store_get_cfg(STORE_CFG_HOPS), 1);
+
+	if (auth_key_valid()) {
+		htv->ctr = auth_next();
+		htv->seq = htv->ctr;
+		*htv->substr = HTV_TYPE_AUTH;
+		htv_hex(htv->substr + 3, htv->ctr >> 8, 4);
+		htv_hex(htv->substr + 7, htv->ctr, 2);
+		env = HTV_AUTH_LEN;
+	} else {
+		htv->seq = tx_seq++;
+		*htv->substr = htv->ack ? HTV_TYPE_ACKREQ : HTV_TYPE_MASTER;
+		htv_hex(htv->substr + 3, htv->seq, 2);
+		env = HTV_MASTER_LEN;
+	}
+
+	len = strlen(htv->x10str);
+	memmove(htv->x10str + env, htv->x10str, len + 1);
+	memcpy(htv->x10str, htv->substr, env);
+
+	if (auth_key_valid())
+		auth_append(htv->x10str);
+	else
+		htv_crc_append(htv->x10str);
+}
+
+/*! \brief chars added by tx_envelope(). */
+static uint8_t tx_envelope_len(void)
+{
+	if (auth_key_valid())
+		return(HTV_AUTH_LEN + HTV_MAC_LEN);
+
+	return(HTV_MASTER_LEN + 3);
+}
+
+/*! \brief the channels of an address.
+ *
+ * The second radio channel, see HTV_USE_SUART, has the addresses
+ * from TX_SUART_FROM up, the broadcast goes on both.
+ */
+static uint8_t tx_channel(const uint16_t address)
+{
+#ifdef HTV_USE_SUART
+	if (address == 0xffff)
+		return(TX_CH_RADIO | TX_CH_SUART);
+
+	if (address >= TX_SUART_FROM)
+		return(TX_CH_SUART);
+#endif
+
+	return(TX_CH_RADIO);
+}
+
+/*! \brief true if chars after the header fit in the airtime and
+ * the channel can start a transmission now.
+ * \param ch the channel, DUTY_RADIO or DUTY_SUART.
+ * \param open the transmission on the channel is already open.
+ */
+static uint8_t tx_fits(const uint8_t ch, const uint8_t open,
+		const uint8_t chars)
+{
+#ifdef HTV_USE_SUART
+	/* the previous transmission is still on the air */
+	if ((ch == DUTY_SUART) && !open && suart_busy())
+		return(0);
+
+#ifdef HTV_USE_RTX
+	/* listen before talk */
+	if ((ch == DUTY_SUART) && !open && suart_heard())
+		return(0);
+#endif
+#endif
+
+	return(duty_ok(ch, radio_airtime_est(chars)));
+}
+
+/*! \brief key up the channel and send the header. */
+static void tx_open(const uint8_t ch)
+{
+#ifdef HTV_USE_SUART
+	if (ch == DUTY_SUART) {
+		suart_open();
+		suart_printstr(RADIO_HEAD);
+		return;
+	}
+#endif
+
+	/* still keyed, the channel is ours */
+	if (!radio_keyed())
+		tx_wait_channel();
+
+	radio_open();
+}
+
+/*! \brief send chars on the channel. */
+static void tx_puts(const uint8_t ch, const char *s)
+{
+#ifdef HTV_USE_SUART
+	if (ch == DUTY_SUART) {
+		suart_printstr(s);
+		return;
+	}
+#endif
+
+	radio_puts(s);
+}
+
+/*! \brief end the transmission and take its airtime.
+ * \param chars sent after the header.
+ */
+static void tx_close(const uint8_t ch, const uint8_t chars)
 {
-	/*! Enable the serial port */
-	uart_tx(1, 1);
-	/*! Enable the transmit pin on the rtx only module
-	as described in the datasheet with delay timing. */
-	AU_PORT |= _BV(AU_TXRX);
-	_delay_us(400);
+#ifdef HTV_USE_SUART
+	/* still on the air, the airtime is the estimate */
+	if (ch == DUTY_SUART) {
+		suart_close();
+		duty_spend(DUTY_SUART, radio_airtime_est(chars));
+		return;
+	}
+#endif
 
-	/*! add another delay for opening the squelch in the receiver. */
-	_delay_ms(10);
+	/* keyed for the next frame, but not in the tx slots, and not
+	 * with repeaters: they relay RX_RELAY_MS and more after the
+	 * frame, and can not hear a carrier without data */
+	if (TX_HANG_MS && (tx_burst() > 1) && !store_get_cfg(STORE_CFG_HOPS))
+		radio_hold();
+	else
+		radio_close();
+
+	duty_spend(DUTY_RADIO, radio_airtime());
+}
+
+/*! \brief key down the radio held after the last frame.
+ * \param now also before TX_HANG_MS, ex. to listen for an ack.
+ */
+static void tx_release(const uint8_t now)
+{
+	if (radio_release(now ? 0 : TX_HANG_MS))
+		duty_spend(DUTY_RADIO, radio_airtime());
 }
 
-/*! \brief Disable TX signal */
-void stop_tx(void)
+/*! \brief send a frame on its channels.
+ *
+ * The software UART starts first, its IRQ sends the frame while
+ * the USART1 sends it too.
+ * \param ch the channels, TX_CH_*.
+ */
+static void tx_send(const char *frame, const uint8_t ch)
 {
-	uart_tx(1, 0);
-	AU_PORT &= ~_BV(AU_TXRX);
-	_delay_us(400);
+	uint8_t i;
+
+	for (i = DUTY_CHANNELS; i--; ) {
+		if (!(ch & _BV(i)))
+			continue;
+
+		tx_open(i);
+		tx_puts(i, frame);
+		tx_close(i, strlen(frame));
+	}
 }
 
-/*! \brief transmit a string on the air
+/*! \brief true if the queued frame can be sent now.
  *
- * Send the string with the header to the air.
- * \param str the string to be sent.
- * \param port the serial port.
+ * A pin command waits TX_HOLD_MS, see tx_frame(), and every
+ * channel of the frame must have the airtime for it.
+ */
+static uint8_t tx_ready(struct txq_t *job)
+{
+	uint8_t i;
+
+	if (job->lww && !tick_elapsed(job->queued, TX_HOLD_MS))
+		return(0);
+
+	for (i = 0; i < DUTY_CHANNELS; i++)
+		if ((job->ch & _BV(i)) && !tx_fits(i, 0, strlen(job->frame)))
+			return(0);
+
+	return(1);
+}
+
+/*! \brief true if no transmission can be queued. */
+static uint8_t tx_full(void)
+{
+	return((uint8_t)(txq_head - txq_tail) == TXQ_SIZE);
+}
+
+/*! \brief queue a transmission.
+ * \param frame the frame, NULL for a scene.
+ * \param scene the scene or TXQ_FRAME.
+ * \return the queued entry, NULL if the queue is full.
+ */
+static struct txq_t *tx_push(const char *frame, const uint8_t scene)
+{
+	struct txq_t *job;
+
+	if (tx_full())
+		return(NULL);
+
+	job = &txq[txq_head & TXQ_MASK];
+
+	if (frame)
+		strcpy(job->frame, frame);
+
+	job->scene = scene;
+	job->idx = 0;
+	job->tries = 0;
+	job->ack = 0;
+	job->lww = 0;
+	job->queued = tick_ms();
+	job->ch = tx_channel(0xffff);
+	txq_head++;
+	return(job);
+}
+
+/*! \brief remove a queued transmission, the ones after it move up.
+ * \param i the index of the entry, free running.
  */
-void tx_str(const char *str, const uint8_t port)
+static void tx_drop(uint8_t i)
 {
-	led_set(RED, ON);
-	start_tx();
-	uart_printstr(port, TX_HEAD);
-	uart_printstr(port, str);
-	_delay_ms(1);
-	stop_tx();
-	led_set(RED, OFF);
+	for (; (uint8_t)(i + 1) != txq_head; i++)
+		txq[i & TXQ_MASK] = txq[(i + 1) & TXQ_MASK];
+
+	txq_head--;
 }
 
-/*! \brief wait until a command is entered.
+/*! \brief replace the command for the same remote and pin, if it
+ * is still queued and not yet on the air.
  *
- * Wait for a char from serial port and echo it if
- * echo is '1'. The command is terminated by a '\\r'.
+ * An off, on or timed command replaces the queued one. A toggle
+ * is folded with it, so the remote ends in the state of both:
+ * toggle and toggle cancel each other, off and toggle become on,
+ * on or a timed on and toggle become off.
  *
- * \sa host_check_command()
- * \param cmd pre-allocated space for the returned string.
- * \param echo 1: echo the chars while typing.
- * \note A maximum of MAX_CMD_LENGHT number of char can be
- * entered.
- * The last '\\r' is substituted by a '\0' or, if the maximum
- * number of char is reached, the last one is changed.
+ * \param htv the new command, it can become a plain pin frame.
+ * \param queued tick_ms() when the command replaced was queued,
+ * or now.
+ * \return 1 if nothing is left to send.
  */
-void host_get_command(char *cmd, const uint8_t echo)
+static uint8_t tx_supersede(struct htv_t *htv, uint16_t *queued)
 {
-	uint8_t i = 0;
+	struct txq_t *job;
+	uint8_t i, old;
+
+	*queued = tick_ms();
+
+	for (i = txq_tail; i != txq_head; i++) {
+		job = &txq[i & TXQ_MASK];
+
+		if ((job->scene == TXQ_FRAME) && job->lww && !job->tries &&
+				(job->address == htv->address) &&
+				(job->pin == htv->pin)) {
+			*queued = job->queued;
+			old = job->cmd;
+			tx_drop(i);
 
-	do {
-		*(cmd + i) = uart_getchar(0, 1);
+			if (htv->cmd != IO_CMD_TOGGLE)
+				return(0);
 
-		/* echo the char */
-		if (echo)
-			uart_putchar(0, *(cmd + i));
+			if (old == IO_CMD_TOGGLE)
+				return(1);
 
-		i++;
-	} while ((i<MAX_CMD_LENGHT) && (*(cmd + i - 1) != '\r') && (*(cmd + i - 1) != '\n'));
+			/* AAAAPPC with the state of both */
+			htv->cmd = (old == IO_CMD_OFF) ? IO_CMD_ON : IO_CMD_OFF;
+			htv->type = HTV_TYPE_PIN;
+			htv_hex(htv->x10str, htv->address, 4);
+			htv_hex(htv->x10str + 4, htv->pin, 2);
+			htv_hex(htv->x10str + 6, htv->cmd, 1);
+			*(htv->x10str + 7) = 0;
+			return(0);
+		}
+	}
 
-	/* Substitute '\n' with a \0 to terminate the string or
-	 put a \0 at cmd[19] */
-	i--;
-	*(cmd + i) = 0;
+	return(0);
 }
 
-/*! \brief pin related command
- * in the form:
- * P:AAAA:PP:C
+/*! \brief add the envelope and queue the frame.
+ *
+ * In ack mode the frames for a single address wait for the ack,
+ * see tx_run().
+ * A pin command replaces the queued one for the same address and
+ * pin, or is folded with it, see tx_supersede(), and goes at the
+ * end of the queue, so the envelope of the
+ * frames in the queue stays in the order of the sequence numbers.
+ * \param htv the frame in x10str, its address and pin.
+ * \param lww true for a pin command.
+ * \return 1 if the queue is full.
  */
-void p_cmd(struct htv_t *htv, struct debug_t *debug)
+static uint8_t tx_frame(struct htv_t *htv, const uint8_t lww)
 {
-	char *crc8s;
+	struct txq_t *job;
+	uint16_t queued;
+
+	queued = tick_ms();
+
+	/* folded with the queued command, nothing to send */
+	if (lww && tx_supersede(htv, &queued))
+		return(0);
+
+	/* do not waste a sequence number */
+	if (tx_full())
+		return(1);
+
+#ifdef HTV_USE_RTX
+	htv->ack = ((store_get_cfg(STORE_CFG_FLAGS) & STORE_FLAG_ACK) &&
+			(tx_channel(htv->address) == TX_CH_RADIO) &&
+			(htv->address != 0xffff) && !auth_key_valid());
+#else
+	htv->ack = 0;
+#endif
 
-	/* Re-use pre-allocated space */
-	crc8s = debug->string;
+	tx_envelope(htv);
+	job = tx_push(htv->x10str, TXQ_FRAME);
+	job->ch = tx_channel(htv->address);
+	job->ack = htv->ack;
+	job->address = htv->address;
+	job->seq = htv->seq;
+	job->pin = htv->pin;
+	job->cmd = htv->cmd;
+	job->lww = lww;
+	job->queued = queued;
+	return(0);
+}
+
+/*! \brief P:AAAA:PP:C to the frame AAAAPPC in x10str. */
+static void p_frame(char *line, struct htv_t *htv)
+{
 	/* transform to AAAAaa:PP:C */
-	memmove(htv->x10str, htv->x10str + 2, 4);
+	memmove(htv->x10str, line + 2, 4);
 	/* to AAAAPP:PP:C */
-	memmove(htv->x10str + 4, htv->x10str + 7, 2);
+	memmove(htv->x10str + 4, line + 7, 2);
 	/* to AAAAPPC */
-	memmove(htv->x10str + 6, htv->x10str + 10, 1);
+	memmove(htv->x10str + 6, line + 10, 1);
 	*(htv->x10str + 7) = 0;
+}
+
+/*! \brief check a frame AAAAPPC in x10str.
+ *
+ * The pin must be one of the largest receiver, XIO_PINS, or
+ * IO_PIN_ALL, the command one without a duration.
+ * \return 0 if ok, else the htv_check_cmd() error or 1.
+ */
+static uint8_t tx_check_pin(struct htv_t *htv)
+{
+	uint8_t err;
+
+	err = htv_check_cmd(htv);
+
+	if (!err && (((htv->pin >= XIO_PINS) && (htv->pin != IO_PIN_ALL)) ||
+				(htv->cmd > IO_CMD_TOGGLE)))
+		err = 1;
+
+	return(err);
+}
+
+/*! \brief pin related command
+ * in the form:
+ * P:AAAA:PP:C
+ */
+uint8_t p_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	p_frame(line, htv);
 
 	/* check the command */
-	if (!htv_check_cmd(htv)) {
-		/* calculate crc8 */
-		htv->crc = crc8_str(htv->x10str);
-
-		/* if crc is a single digit, prepend a '0' */
-		if (htv->crc < 0x10) {
-			strcpy_P(crc8s, PSTR("0"));
-			strcat(crc8s, utoa(htv->crc, htv->substr, 16));
-		} else {
-			crc8s = utoa(htv->crc, crc8s, 16);
-		}
+	if (tx_check_pin(htv) || tx_frame(htv, 1))
+		return(CMD_KO);
 
-		/* Convert AAAAPPC to AAAAPPC:RR */
-		*(htv->x10str + 7) = ':';
-		*(htv->x10str + 8) = 0;
-		htv->x10str = strcat(htv->x10str, crc8s);
-		tx_str(htv->x10str, 1);
-		debug_print_P(PSTR("OK\n"), debug);
-	} else {
-		debug_print_P(PSTR("ko\n"), debug);
-	}
+	sync_set(htv->address, htv->pin, htv->cmd);
+	return(CMD_OK);
 }
 
-/*! \brief main TX loop */
-void master(struct debug_t *debug)
+/*! \brief pin related command with a duration
+ * in the form:
+ * P:AAAA:PP:C:DDDD
+ */
+uint8_t pt_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
 {
-	struct htv_t *htv;
-	uint8_t echo = 1;
+	/* TAAAAPPCDDDD */
+	*htv->x10str = HTV_TYPE_TIMED;
+	memcpy(htv->x10str + 1, line + 2, 4);
+	memcpy(htv->x10str + 5, line + 7, 2);
+	*(htv->x10str + 7) = *(line + 10);
+	memcpy(htv->x10str + 8, line + 12, 4);
+	*(htv->x10str + 12) = 0;
 
-	htv = NULL;
-	htv = htv_init(htv);
+	/* check the command */
+	if (htv_check_cmd(htv) || tx_frame(htv, 1))
+		return(CMD_KO);
 
-#ifdef HTV_USE_RTX
-	AU_DDR |= _BV(AU_ENABLE) | _BV(AU_TXRX);
-	AU_PORT |= _BV(AU_ENABLE);
-	_delay_us(20);
-#endif
+	sync_set(htv->address, htv->pin, htv->cmd);
+	return(CMD_OK);
+}
 
-	uart_init(1);
-	led_set(GREEN, ON);
-	debug_print_P(PSTR("Master module.\n"), debug);
+/*! \brief change the address of a remote
+ * in the form:
+ * A:OOOO:NNNN:OOOO:NNNN
+ */
+uint8_t a_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	/* both copies must be equal */
+	if (strncmp(line + 2, line + 12, 9))
+		return(CMD_KO);
 
-	while (1) {
-		host_get_command(htv->x10str, echo);
+	*(line + 6) = 0;
+	*(line + 11) = 0;
+	htv->address = strtoul(line + 2, 0, 16);
+	htv->value = strtoul(line + 7, 0, 16);
 
-		switch (*(htv->x10str)) {
-			case 'A':
-				debug_print_P(PSTR("ko\n"), debug);
-				break;
-			case 'C':
-				debug_print_P(PSTR("ko\n"), debug);
-				break;
-			case 'E':
-				switch (*(htv->x10str + 2)) {
-					case '0':
-						echo = 0;
-						debug_print_P(PSTR("OK\n"), debug);
-						break;
-					case '1':
-						echo = 1;
-						debug_print_P(PSTR("OK\n"), debug);
-						break;
-					default:
-						debug_print_P(PSTR("ko\n"), debug);
-				}
-				break;
-			case 'L':
-				debug_print_P(PSTR(TX_ID), debug);
-				debug_print_P(PSTR("\n"), debug);
-				break;
-			case 'P':
-				p_cmd(htv, debug);
-				break;
-			case '?':
-				debug_print_P(PSTR("Help:\n"), debug);
-				debug_print_P(PSTR("A:OOOO:NNNN:OOOO:NNNN change the remote device's address from OOOO to NNNN.\n"), debug);
-				debug_print_P(PSTR("P:AAAA:PP:C send a command.\n"), debug);
-				debug_print_P(PSTR("L print the TX id.\n"), debug);
-				debug_print_P(PSTR("E:x where x 1 or 0, enable or disable echo.\n"), debug);
-				debug_print_P(PSTR("? this help.\n"), debug);
-				break;
-			default:
-				debug_print_P(PSTR("ko\n"), debug);
-		}
+	if ((!htv->value) || (htv->value == 0xffff) ||
+			(htv->address == 0xffff))
+		return(CMD_KO);
+
+	/* NOOOONNNN */
+	*htv->x10str = HTV_TYPE_ADDR;
+	htv_hex(htv->x10str + 1, htv->address, 4);
+	htv_hex(htv->x10str + 5, htv->value, 4);
+
+	if (tx_frame(htv, 0))
+		return(CMD_KO);
+
+	sync_move(htv->address, htv->value);
+	return(CMD_OK);
+}
+
+/*! \brief echo on or off
+ * in the form:
+ * E:X
+ */
+uint8_t e_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	if (*(line + 2) == '1')
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) & ~STORE_FLAG_NOECHO);
+	else
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) | STORE_FLAG_NOECHO);
+
+	return(CMD_OK);
+}
+
+/*! \brief print the TX id. */
+uint8_t l_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	htv_hex(debug->line, store_get_cfg(STORE_CFG_ID), 1);
+	debug_print(debug);
+	debug_print_P(PSTR("\n"), debug);
+	return(CMD_DONE);
+}
+
+/*! \brief change the id of the master and the number of slots
+ * in the form:
+ * C:N or C:N:S
+ */
+uint8_t c_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	store_set_cfg(STORE_CFG_ID, strtoul(line + 2, 0, 16));
+
+	if (*(line + 3) == ':')
+		store_set_cfg(STORE_CFG_SLOTS, strtoul(line + 4, 0, 16));
+
+	/* align the slots */
+	slot_origin = tick_ms32();
+	return(CMD_OK);
+}
+
+/*! \brief firmware update
+ * in the form:
+ * B:BBB:CCCC the image, B:BBB:MMMMMMMM with a key, or
+ * B:BBB:DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD a block.
+ */
+uint8_t b_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	uint16_t crc;
+	uint8_t i, len;
+	char *s;
+
+	/* the boot loader reads only lower case hex */
+	for (s = line + 2; *s; s++)
+		*s |= 0x20;
+
+	len = strlen(line);
+
+	if (len < HTV_BLOCK_LEN) {
+		/* the CRC without a key, the MAC with a key */
+		if (len - 6 != (auth_key_valid() ? 8 : 4))
+			return(CMD_KO);
+
+		/* YBBBCCCC or YBBBMMMMMMMM in the envelope */
+		*htv->x10str = HTV_TYPE_BOOT;
+		memcpy(htv->x10str + 1, line + 2, 3);
+		memcpy(htv->x10str + 4, line + 6, len - 6);
+		*(htv->x10str + len - 2) = 0;
+		htv->address = 0xffff;
+		return(tx_frame(htv, 0) ? CMD_KO : CMD_OK);
+	}
+
+	if (tx_full())
+		return(CMD_KO);
+
+	/* ZBBBDD..DDCCCC as it is */
+	*htv->x10str = HTV_TYPE_BLOCK;
+	memcpy(htv->x10str + 1, line + 2, 3);
+	memcpy(htv->x10str + 4, line + 6, HTV_BLOCK_LEN - 8);
+	crc = 0xffff;
+
+	for (i = 0; i < HTV_BLOCK_LEN - 4; i++)
+		crc = _crc_xmodem_update(crc, *(htv->x10str + i));
+
+	htv_hex(htv->x10str + HTV_BLOCK_LEN - 4, crc, 4);
+	tx_push(htv->x10str, TXQ_FRAME);
+	return(CMD_OK);
+}
+
+/*! \brief set the key
+ * in the form:
+ * U:KKKKKKKKKKKKKKKKKKKKKKKKKKKKKKKK
+ */
+uint8_t u_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	auth_set_key(line + 2);
+	return(CMD_OK);
+}
+
+#ifdef HTV_USE_RTX
+/*! \brief ack mode on or off
+ * in the form:
+ * Q:X
+ */
+uint8_t q_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	if (*(line + 2) == '1')
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) | STORE_FLAG_ACK);
+	else
+		store_set_cfg(STORE_CFG_FLAGS,
+				store_get_cfg(STORE_CFG_FLAGS) & ~STORE_FLAG_ACK);
+
+	return(CMD_OK);
+}
+#endif
+
+/*! \brief number of repeaters a frame can go through
+ * in the form:
+ * R:H
+ */
+uint8_t r_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	store_set_cfg(STORE_CFG_HOPS, strtoul(line + 2, 0, 16));
+	return(CMD_OK);
+}
+
+/*! \brief add a command to a scene
+ * in the form:
+ * S:N:AAAA:PP:C
+ */
+uint8_t sa_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	uint8_t scene;
+
+	scene = strtoul(line + 2, 0, 16);
+	/* N:AAAA:PP:C is in the place of P:AAAA:PP:C */
+	p_frame(line + 2, htv);
+
+	if ((scene >= SCENE_MAX) || tx_check_pin(htv) ||
+			scene_add(scene, htv->address, htv->pin, htv->cmd))
+		return(CMD_KO);
+
+	return(CMD_OK);
+}
+
+/*! \brief send a burst of a scene.
+ *
+ * The frames are sent back to back, up to TX_BURST and while
+ * the airtime is enough for the whole burst. Every frame goes on
+ * the channels of its address, see tx_channel(), a burst on each.
+ * \return 1 if the whole scene is sent.
+ */
+static uint8_t tx_scene(struct htv_t *htv, struct txq_t *job)
+{
+	struct scene_t entry;
+	uint8_t i, k, n, len, ch, open, done;
+	uint8_t chars[DUTY_CHANNELS];
+
+	i = job->idx;
+	n = 0;
+	open = 0;
+	memset(chars, 0, sizeof(chars));
+	done = 1;
+	/* too many frames to wait for the acks */
+	htv->ack = 0;
+
+	while (scene_get(&i, job->scene, &entry)) {
+		/* AAAAPPC */
+		htv_hex(htv->x10str, entry.address, 4);
+		htv_hex(htv->x10str + 4, entry.pin, 2);
+		htv_hex(htv->x10str + 6, entry.id & 0x0f, 1);
+		ch = tx_channel(entry.address);
+		/* envelope and crc, the sync is added below */
+		len = strlen(htv->x10str) + tx_envelope_len();
+
+		for (k = 0; k < DUTY_CHANNELS; k++)
+			if ((ch & _BV(k)) && !tx_fits(k, open & _BV(k), chars[k] +
+						len + ((open & _BV(k)) ?
+							sizeof(RADIO_SYNC) - 1 : 0)))
+				break;
+
+		if ((n == tx_burst()) || (k < DUTY_CHANNELS)) {
+			done = 0;
+			break;
+		}
+
+		tx_envelope(htv);
+
+		for (k = DUTY_CHANNELS; k--; ) {
+			if (!(ch & _BV(k)))
+				continue;
+
+			if (open & _BV(k)) {
+				tx_puts(k, RADIO_SYNC);
+				chars[k] += sizeof(RADIO_SYNC) - 1;
+			} else {
+				tx_open(k);
+				open |= _BV(k);
+			}
+
+			tx_puts(k, htv->x10str);
+			chars[k] += len;
+		}
+
+		sync_set(entry.address, entry.pin, entry.id & 0x0f);
+		job->idx = i;
+		n++;
+	}
+
+	for (k = DUTY_CHANNELS; k--; )
+		if (open & _BV(k))
+			tx_close(k, chars[k]);
+
+	return(done);
+}
+
+/*! \brief send every command of a scene
+ * in the form:
+ * S:N
+ */
+uint8_t s_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	uint8_t scene;
+
+	scene = strtoul(line + 2, 0, 16);
+
+	if ((scene >= SCENE_MAX) || !tx_push(NULL, scene))
+		return(CMD_KO);
+
+	return(CMD_OK);
+}
+
+/*! \brief print the commands of a scene
+ * in the form:
+ * V:N
+ */
+uint8_t v_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct scene_t entry;
+	uint8_t i;
+
+	i = 0;
+
+	while (scene_get(&i, strtoul(line + 2, 0, 16), &entry)) {
+		/* AAAA:PP:C */
+		htv_hex(debug->line, entry.address, 4);
+		*(debug->line + 4) = ':';
+		htv_hex(debug->line + 5, entry.pin, 2);
+		*(debug->line + 7) = ':';
+		htv_hex(debug->line + 8, entry.id & 0x0f, 1);
+		debug_print(debug);
+		debug_print_P(PSTR("\n"), debug);
+	}
+
+	return(CMD_OK);
+}
+
+/*! \brief remove every command of a scene
+ * in the form:
+ * X:N
+ */
+uint8_t x_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	uint8_t scene;
+
+	scene = strtoul(line + 2, 0, 16);
+
+	if (scene >= SCENE_MAX)
+		return(CMD_KO);
+
+	scene_clear(scene);
+	return(CMD_OK);
+}
+
+/*! \brief print a 32 bit value in hex. */
+static void print_hex32(const uint32_t value, struct debug_t *debug)
+{
+	htv_hex(debug->line, value >> 16, 4);
+	htv_hex(debug->line + 4, value, 4);
+	debug_print(debug);
+}
+
+/*! \brief print or set the clock
+ * in the form:
+ * K or K:TTTTTTTT
+ */
+uint8_t k_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	if (*(line + 1) == ':') {
+		sched_set_clock(strtoul(line + 2, 0, 16));
+		return(CMD_OK);
+	}
+
+	if (!sched_clock_valid())
+		return(CMD_KO);
+
+	print_hex32(sched_clock(), debug);
+	debug_print_P(PSTR("\n"), debug);
+	return(CMD_DONE);
+}
+
+/*! \brief print the state of the remotes or set the period
+ * in the form:
+ * W or W:hh
+ */
+uint8_t w_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct sync_t entry;
+	uint8_t i;
+
+	if (*(line + 1) == ':') {
+		store_set_cfg(STORE_CFG_SYNC, strtoul(line + 2, 0, 16));
+		return(CMD_OK);
+	}
+
+	for (i = 0; i < SYNC_ENTRIES; i++) {
+		if (!sync_get(i, &entry))
+			continue;
+
+		/* AAAA:V */
+		htv_hex(debug->line, entry.address, 4);
+		*(debug->line + 4) = ':';
+		htv_hex(debug->line + 5, entry.io, 1);
+		debug_print(debug);
+		debug_print_P(PSTR("\n"), debug);
+	}
+
+	return(CMD_OK);
+}
+
+/*! \brief print the airtime or set the duty-cycle
+ * in the form:
+ * D or D:hh
+ */
+uint8_t d_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	if (*(line + 1) == ':') {
+		store_set_cfg(STORE_CFG_DUTY, strtoul(line + 2, 0, 16));
+		return(CMD_OK);
+	}
+
+	/* LLLLLLLL:CCCCCCCC:Q */
+	print_hex32(duty_left(DUTY_RADIO), debug);
+	debug_print_P(PSTR(":"), debug);
+	print_hex32(duty_capacity(), debug);
+	debug_print_P(PSTR(":"), debug);
+	htv_hex(debug->line, txq_head - txq_tail, 1);
+	debug_print(debug);
+#ifdef HTV_USE_SUART
+	/* :LLLLLLLL of the second channel */
+	debug_print_P(PSTR(":"), debug);
+	print_hex32(duty_left(DUTY_SUART), debug);
+#endif
+	debug_print_P(PSTR("\n"), debug);
+	return(CMD_DONE);
+}
+
+#ifdef HTV_USE_BENCH
+/*! \brief the benchmark, see bench.c.
+ *
+ * The P frame is built, checked and put in the envelope as by
+ * p_cmd(), but it is not queued and the sequence number is given
+ * back. With a key the counter of every run is the same, see
+ * auth_swap(), so no counter is used and the EEPROM is not
+ * written, then the counter is given back too.
+ */
+uint8_t m_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct bench_t b;
+	uint32_t ctr;
+	uint8_t i, seq;
+
+	bench_begin();
+	bench_run(htv, debug);
+	bench_clear(&b);
+	seq = tx_seq;
+	ctr = auth_swap(1);
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		strcpy_P(debug->string, PSTR("P:0123:01:1"));
+		auth_swap(1);
+		bench_start();
+		p_frame(debug->string, htv);
+		htv_check_cmd(htv);
+		htv->ack = 0;
+		tx_envelope(htv);
+		bench_add(&b, bench_stop());
+		tx_seq = seq;
+	}
+
+	auth_swap(ctr);
+	bench_end();
+
+	if (b.n)
+		bench_print(PSTR("p"), &b, debug);
+
+	return(CMD_OK);
+}
+#endif
+
+/*! \brief run a schedule entry.
+ *
+ * A pin entry is checked again, see tx_check_pin(), an entry
+ * written by an older firmware may be wrong.
+ * \note the entry is lost if the queue is full.
+ */
+static void tx_sched(struct htv_t *htv, struct sched_t *entry)
+{
+	if (entry->type == SCHED_SCENE) {
+		tx_push(NULL, entry->address);
+	} else {
+		/* AAAAPPC */
+		htv_hex(htv->x10str, entry->address, 4);
+		htv_hex(htv->x10str + 4, entry->pin, 2);
+		htv_hex(htv->x10str + 6, entry->cmd, 1);
+
+		/* a single digit is sent, look at the whole byte */
+		if ((entry->cmd <= IO_CMD_TOGGLE) && !tx_check_pin(htv) &&
+				!tx_frame(htv, 1))
+			sync_set(htv->address, htv->pin, htv->cmd);
+	}
+}
+
+/*! \brief add a schedule entry
+ * in the form:
+ * T:I:TTTTTTTT:MMMM:AAAA:PP:C or T:I:TTTTTTTT:MMMM:S:N
+ *
+ * With +TTTTTTT in place of TTTTTTTT the time is from now.
+ */
+uint8_t t_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct sched_t entry;
+	uint8_t i;
+
+	i = strtoul(line + 2, 0, 16);
+
+	if (i >= SCHED_ENTRIES)
+		return(CMD_KO);
+
+	if (*(line + 4) == '+') {
+		/* from now, only if the clock is valid */
+		if (!sched_clock_valid())
+			return(CMD_KO);
+
+		entry.at = sched_clock() + strtoul(line + 5, 0, 16);
+	} else {
+		entry.at = strtoul(line + 4, 0, 16);
+	}
+
+	entry.every = strtoul(line + 13, 0, 16);
+
+	if (*(line + 18) == SCHED_SCENE) {
+		entry.type = SCHED_SCENE;
+		entry.address = strtoul(line + 20, 0, 16);
+
+		if (entry.address >= SCENE_MAX)
+			return(CMD_KO);
+	} else {
+		/* :AAAA:PP:C is in the place of P:AAAA:PP:C */
+		p_frame(line + 16, htv);
+
+		if (tx_check_pin(htv))
+			return(CMD_KO);
+
+		entry.type = SCHED_PIN;
+		entry.address = htv->address;
+		entry.pin = htv->pin;
+		entry.cmd = htv->cmd;
+	}
+
+	sched_set(i, &entry);
+	return(CMD_OK);
+}
+
+/*! \brief print the schedule
+ * in the form:
+ * T
+ */
+uint8_t tl_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct sched_t entry;
+	uint8_t i;
+
+	for (i = 0; i < SCHED_ENTRIES; i++) {
+		sched_get(i, &entry);
+
+		if (entry.type == SCHED_FREE)
+			continue;
+
+		/* I:TTTTTTTT:MMMM: */
+		htv_hex(debug->line, i, 1);
+		debug_print(debug);
+		debug_print_P(PSTR(":"), debug);
+		print_hex32(entry.at, debug);
+		debug_print_P(PSTR(":"), debug);
+		htv_hex(debug->line, entry.every, 4);
+		*(debug->line + 4) = ':';
+
+		if (entry.type == SCHED_SCENE) {
+			/* S:N */
+			*(debug->line + 5) = SCHED_SCENE;
+			*(debug->line + 6) = ':';
+			htv_hex(debug->line + 7, entry.address, 1);
+		} else {
+			/* AAAA:PP:C */
+			htv_hex(debug->line + 5, entry.address, 4);
+			*(debug->line + 9) = ':';
+			htv_hex(debug->line + 10, entry.pin, 2);
+			*(debug->line + 12) = ':';
+			htv_hex(debug->line + 13, entry.cmd, 1);
+		}
+
+		debug_print(debug);
+		debug_print_P(PSTR("\n"), debug);
+	}
+
+	return(CMD_OK);
+}
+
+/*! \brief delete a schedule entry
+ * in the form:
+ * Y:I
+ */
+uint8_t y_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	struct sched_t entry;
+	uint8_t i;
+
+	i = strtoul(line + 2, 0, 16);
+
+	if (i >= SCHED_ENTRIES)
+		return(CMD_KO);
+
+	entry.at = 0xffffffff;
+	entry.every = 0xffff;
+	entry.type = SCHED_FREE;
+	entry.address = 0xffff;
+	entry.pin = 0xff;
+	entry.cmd = 0xff;
+	sched_set(i, &entry);
+	return(CMD_OK);
+}
+
+#ifdef HTV_USE_RTX
+/*! \brief look for the ack of the frame on the air.
+ *
+ * The chars from the radio after at least 2 'x' are collected
+ * in tx_ack_buf, see \ref subrxkcmd.
+ * \return true if the ack of the job has been received.
+ */
+static uint8_t tx_ack(struct htv_t *htv, struct txq_t *job)
+{
+	char c;
+
+	while ((c = radio_getchar(0))) {
+		if (c == 'x') {
+			if (tx_ack_sync < 2)
+				tx_ack_sync++;
+
+			tx_ack_idx = 0;
+			continue;
+		}
+
+		/* not an ack */
+		if ((tx_ack_sync < 2) || (!tx_ack_idx && (c != HTV_TYPE_ACK))) {
+			tx_ack_sync = 0;
+			continue;
+		}
+
+		tx_ack_buf[tx_ack_idx++] = c;
+
+		if (tx_ack_idx < HTV_ACK_LEN)
+			continue;
+
+		tx_ack_buf[tx_ack_idx] = 0;
+		tx_ack_sync = 0;
+		tx_ack_idx = 0;
+		strcpy(htv->x10str, tx_ack_buf);
+
+		if (!htv_check_cmd(htv) && (htv->type == HTV_TYPE_ACK) &&
+				(htv->master == store_get_cfg(STORE_CFG_ID)) &&
+				(htv->address == job->address) &&
+				(htv->seq == job->seq))
+			return(1);
+	}
+
+	return(0);
+}
+
+/*! \brief tell the host if the frame has been acknowledged.
+ *
+ * The line is the frame without envelope and crc, ex.
+ * "!012f011 OK" or "!012f011 ko".
+ */
+static void tx_report(struct txq_t *job, const uint8_t ok,
+		struct debug_t *debug)
+{
+	uint8_t len;
+
+	len = strlen(job->frame) - HTV_MASTER_LEN - 3;
+	memcpy(debug->line, job->frame + HTV_MASTER_LEN, len);
+	*(debug->line + len) = 0;
+	debug_print_P(PSTR("!"), debug);
+	debug_print(debug);
+
+	if (ok)
+		debug_print_P(PSTR(" OK\n"), debug);
+	else
+		debug_print_P(PSTR(" ko\n"), debug);
+}
+#endif
+
+/*! \brief send the state of the next remotes.
+ *
+ * Only when nothing else is queued, every STORE_CFG_SYNC s and
+ * if more than half of the airtime is left for the commands.
+ */
+static void tx_sync(struct htv_t *htv)
+{
+	uint8_t period, ch;
+
+	period = store_get_cfg(STORE_CFG_SYNC);
+
+	if (period == SYNC_OFF)
+		return;
+
+	if (!period)
+		period = SYNC_DEFAULT_S;
+
+	if ((tick_ms32() - sync_last < period * 1000UL) ||
+			((duty_get() != DUTY_OFF) &&
+			 (duty_left(DUTY_RADIO) < duty_capacity() / 2)))
+		return;
+
+	sync_last = tick_ms32();
+
+	if (!sync_frame(htv->x10str))
+		return;
+
+	htv->ack = 0;
+	tx_envelope(htv);
+	ch = tx_channel(0xffff);
+
+#ifdef HTV_USE_SUART
+	/* the second channel only if it is free */
+	if (!tx_fits(DUTY_SUART, 0, strlen(htv->x10str)) ||
+			((duty_get() != DUTY_OFF) &&
+			 (duty_left(DUTY_SUART) < duty_capacity() / 2)))
+		ch &= ~TX_CH_SUART;
+#endif
+
+	tx_send(htv->x10str, ch);
+}
+
+#ifdef HTV_USE_SUART
+/*! \brief send the first frame for the second channel only.
+ *
+ * It can pass the frames for the USART1 only, not a transmission
+ * for both channels, so the frames keep their order on each
+ * channel, and it is on the air while tx_run() sends the others.
+ */
+static void tx_run_suart(void)
+{
+	struct txq_t *job;
+	uint8_t i;
+
+	for (i = txq_tail; i != txq_head; i++) {
+		job = &txq[i & TXQ_MASK];
+
+		if (job->ch == TX_CH_RADIO)
+			continue;
+
+		if ((job->ch == TX_CH_SUART) && tx_ready(job)) {
+			tx_send(job->frame, TX_CH_SUART);
+			tx_drop(i);
+		}
+
+		return;
+	}
+}
+#endif
+
+/*! \brief send the first queued transmission if there is the
+ * airtime for it.
+ *
+ * A scene is sent a burst at a time, one for every call.
+ * In ack mode a frame stays in the queue until its ack, or it is
+ * sent again after TX_ACK_MS, up to TX_TRIES times.
+ * A pin command is sent after TX_HOLD_MS, see tx_frame().
+ * The frames for the second channel only are sent by
+ * tx_run_suart().
+ * When the queue is empty the state of the remotes is sent, see
+ * tx_sync().
+ * The radio is keyed down TX_HANG_MS after the last frame, see
+ * tx_close().
+ * \return 1 if something is still queued.
+ */
+uint8_t tx_run(struct htv_t *htv, struct debug_t *debug)
+{
+	struct txq_t *job;
+
+	tx_release(0);
+
+	if (txq_head == txq_tail) {
+		tx_sync(htv);
+		return(0);
+	}
+
+#ifdef HTV_USE_SUART
+	tx_run_suart();
+
+	if (txq_head == txq_tail)
+		return(0);
+#endif
+
+	job = &txq[txq_tail & TXQ_MASK];
+
+	if (job->scene != TXQ_FRAME) {
+		if (tx_scene(htv, job))
+			txq_tail++;
+#ifdef HTV_USE_SUART
+	} else if (job->ch == TX_CH_SUART) {
+		/* see tx_run_suart() */
+#endif
+#ifdef HTV_USE_RTX
+	} else if (job->tries && !tick_elapsed(job->sent, TX_ACK_MS)) {
+		/* on the air, waiting for the ack */
+		if (tx_ack(htv, job)) {
+			tx_report(job, 1, debug);
+			txq_tail++;
+		}
+	} else if (job->tries == TX_TRIES) {
+		tx_report(job, 0, debug);
+		txq_tail++;
+#endif
+	} else if (tx_ready(job)) {
+		tx_send(job->frame, job->ch);
+
+		if (job->ack) {
+			job->tries++;
+			job->sent = tick_ms();
+#ifdef HTV_USE_RTX
+			/* listen for the ack from now */
+			tx_release(1);
+			radio_flush();
+			tx_ack_sync = 0;
+#endif
+		} else {
+			txq_tail++;
+		}
+	}
+
+	return(txq_head != txq_tail);
+}
+
+uint8_t help_cmd(char *line, struct htv_t *htv, struct debug_t *debug);
+
+/*! pattern and help of the host commands */
+static const char a_args[] PROGMEM = "A:hhhh:hhhh:hhhh:hhhh";
+static const char a_help[] PROGMEM = "A:OOOO:NNNN:OOOO:NNNN change the remote device's address from OOOO to NNNN.\n";
+static const char p_args[] PROGMEM = "P:hhhh:hh:h";
+static const char p_help[] PROGMEM = "P:AAAA:PP:C send a command.\n";
+static const char pt_args[] PROGMEM = "P:hhhh:hh:h:hhhh";
+static const char pt_help[] PROGMEM = "P:AAAA:PP:C:DDDD send a command with a duration.\n";
+static const char b_args[] PROGMEM = "B:hhh:hhhh";
+static const char b_help[] PROGMEM = "B:BBB:CCCC update the receivers to the image of BBB blocks.\n";
+static const char bm_args[] PROGMEM = "B:hhh:hhhhhhhh";
+static const char bm_help[] PROGMEM = "B:BBB:MMMMMMMM the same with a key, MMMMMMMM the MAC of the image.\n";
+static const char bb_args[] PROGMEM = "B:hhh:hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh";
+static const char bb_help[] PROGMEM = "B:BBB:DD..DD send the block BBB of the image, 16 bytes.\n";
+static const char c_args[] PROGMEM = "C:h";
+static const char c_help[] PROGMEM = "C:N change the id of the master [0:f].\n";
+static const char cs_args[] PROGMEM = "C:h:h";
+static const char cs_help[] PROGMEM = "C:N:S change the id and use S tx slots.\n";
+static const char l_args[] PROGMEM = "L";
+static const char l_help[] PROGMEM = "L print the TX id.\n";
+#ifdef HTV_USE_BENCH
+static const char m_args[] PROGMEM = "M";
+static const char m_help[] PROGMEM = "M run the benchmark, cpu cycles min:avg:max.\n";
+#endif
+#ifdef HTV_USE_RTX
+static const char q_args[] PROGMEM = "Q:b";
+static const char q_help[] PROGMEM = "Q:x where x 1 or 0, enable or disable the acks.\n";
+#endif
+static const char u_args[] PROGMEM = "U:hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh";
+static const char u_help[] PROGMEM = "U:K set the 16 byte key of the authenticated frames, all ff no key.\n";
+static const char r_args[] PROGMEM = "R:h";
+static const char r_help[] PROGMEM = "R:H frames go through max H repeaters [0:f].\n";
+static const char s_args[] PROGMEM = "S:h";
+static const char s_help[] PROGMEM = "S:N send the scene N [0:e].\n";
+static const char sa_args[] PROGMEM = "S:h:hhhh:hh:h";
+static const char sa_help[] PROGMEM = "S:N:AAAA:PP:C add a command to the scene N.\n";
+static const char v_args[] PROGMEM = "V:h";
+static const char v_help[] PROGMEM = "V:N print the scene N.\n";
+static const char x_args[] PROGMEM = "X:h";
+static const char x_help[] PROGMEM = "X:N delete the scene N.\n";
+static const char k_args[] PROGMEM = "K";
+static const char k_help[] PROGMEM = "K print the clock.\n";
+static const char ks_args[] PROGMEM = "K:hhhhhhhh";
+static const char ks_help[] PROGMEM = "K:TTTTTTTT set the clock, s.\n";
+static const char d_args[] PROGMEM = "D";
+static const char d_help[] PROGMEM = "D print the airtime left, the bucket in ms and the frames queued.\n";
+static const char ds_args[] PROGMEM = "D:hh";
+static const char ds_help[] PROGMEM = "D:hh duty-cycle in 0.1% units, 00 default 1%, ff no limit.\n";
+static const char w_args[] PROGMEM = "W";
+static const char w_help[] PROGMEM = "W print the state of the last " QUOTEME(SYNC_ENTRIES) " remotes, pins 0 and 1.\n";
+static const char ws_args[] PROGMEM = "W:hh";
+static const char ws_help[] PROGMEM = "W:hh s between state frames, 00 default 30 s, ff none.\n";
+static const char tl_args[] PROGMEM = "T";
+static const char tl_help[] PROGMEM = "T print the schedule.\n";
+static const char t_args[] PROGMEM = "T:h:hhhhhhhh:hhhh:hhhh:hh:h";
+static const char t_help[] PROGMEM = "T:I:TTTTTTTT:MMMM:AAAA:PP:C at T and every M min send the command.\n";
+static const char tr_args[] PROGMEM = "T:h:+hhhhhhh:hhhh:hhhh:hh:h";
+static const char tr_help[] PROGMEM = "T:I:+TTTTTTT:MMMM:AAAA:PP:C same, T s from now.\n";
+static const char ts_args[] PROGMEM = "T:h:hhhhhhhh:hhhh:S:h";
+static const char ts_help[] PROGMEM = "T:I:TTTTTTTT:MMMM:S:N at T and every M min send the scene.\n";
+static const char tsr_args[] PROGMEM = "T:h:+hhhhhhh:hhhh:S:h";
+static const char tsr_help[] PROGMEM = "T:I:+TTTTTTT:MMMM:S:N same, T s from now.\n";
+static const char y_args[] PROGMEM = "Y:h";
+static const char y_help[] PROGMEM = "Y:I delete the schedule entry I [0:7].\n";
+static const char e_args[] PROGMEM = "E:b";
+static const char e_help[] PROGMEM = "E:x where x 1 or 0, enable or disable echo.\n";
+static const char h_args[] PROGMEM = "?";
+static const char h_help[] PROGMEM = "? this help.\n";
+
+/*! the host commands */
+static const struct cmd_t master_cmd[] PROGMEM = {
+	{ 'A', a_args, a_cmd, a_help },
+	{ 'P', p_args, p_cmd, p_help },
+	{ 'P', pt_args, pt_cmd, pt_help },
+	{ 'B', b_args, b_cmd, b_help },
+	{ 'B', bm_args, b_cmd, bm_help },
+	{ 'B', bb_args, b_cmd, bb_help },
+	{ 'C', c_args, c_cmd, c_help },
+	{ 'C', cs_args, c_cmd, cs_help },
+	{ 'L', l_args, l_cmd, l_help },
+#ifdef HTV_USE_BENCH
+	{ 'M', m_args, m_cmd, m_help },
+#endif
+#ifdef HTV_USE_RTX
+	{ 'Q', q_args, q_cmd, q_help },
+#endif
+	{ 'R', r_args, r_cmd, r_help },
+	{ 'U', u_args, u_cmd, u_help },
+	{ 'S', s_args, s_cmd, s_help },
+	{ 'S', sa_args, sa_cmd, sa_help },
+	{ 'V', v_args, v_cmd, v_help },
+	{ 'X', x_args, x_cmd, x_help },
+	{ 'K', k_args, k_cmd, k_help },
+	{ 'K', ks_args, k_cmd, ks_help },
+	{ 'D', d_args, d_cmd, d_help },
+	{ 'D', ds_args, d_cmd, ds_help },
+	{ 'W', w_args, w_cmd, w_help },
+	{ 'W', ws_args, w_cmd, ws_help },
+	{ 'T', tl_args, tl_cmd, tl_help },
+	{ 'T', t_args, t_cmd, t_help },
+	{ 'T', tr_args, t_cmd, tr_help },
+	{ 'T', ts_args, t_cmd, ts_help },
+	{ 'T', tsr_args, t_cmd, tsr_help },
+	{ 'Y', y_args, y_cmd, y_help },
+	{ 'E', e_args, e_cmd, e_help },
+	{ '?', h_args, help_cmd, h_help },
+	{ 0, NULL, NULL, NULL }
+};
+
+/*! \brief print the help. */
+uint8_t help_cmd(char *line, struct htv_t *htv, struct debug_t *debug)
+{
+	cmd_help(master_cmd, debug);
+	return(CMD_DONE);
+}
+
+/*! \brief main TX loop */
+void master(struct debug_t *debug)
+{
+	struct htv_t *htv;
+	struct cmd_line_t line;
+	struct sched_t entry;
+
+	htv = NULL;
+	htv = htv_init(htv);
+	line.buf = malloc(MAX_CMD_LENGHT);
+	line.idx = 0;
+
+	radio_init();
+#ifdef HTV_USE_RTX
+	/* listen to the channel between the transmissions */
+	radio_power(RADIO_RX);
+#endif
+	tick_init();
+#ifdef HTV_USE_SUART
+	suart_init();
+#endif
+	duty_init();
+	sync_init();
+	auth_init();
+	led_set(GREEN, ON);
+
+	while (debug_hello(debug));
+
+	debug_print_P(PSTR("Master module.\n"), debug);
+
+	while (1) {
+		if (cmd_getline(&line, 0,
+				!(store_get_cfg(STORE_CFG_FLAGS) & STORE_FLAG_NOECHO)))
+			cmd_exec(master_cmd, line.buf, htv, debug);
+
+		if (sched_due(&entry))
+			tx_sched(htv, &entry);
+
+		tx_run(htv, debug);
 	}
 
 	htv_free(htv);
@@ -21,18 +21,94 @@
 
 #ifndef TX_H
 #define TX_H
-/*! the header of the packet to tx */
-#define TX_HEAD "xxxxxx"
-/*! id of the master modules, required if more than 1 master is
- * present.
- */
-#define TX_ID "0"
+/*! lenght of a tx slot in ms, longer than the longest frame. */
+#define TX_SLOT_MS 250
+/*! a frame starts only in the first ms of the slot. */
+#define TX_SLOT_GUARD 20
+/*! max number of frames sent back to back. */
+#define TX_BURST 8
+/*! frames waiting for airtime, power of 2. */
+#define TXQ_SIZE 4
+/*! mask used to wrap the queue index. */
+#define TXQ_MASK (TXQ_SIZE - 1)
+/*! txq_t scene: a single frame. */
+#define TXQ_FRAME 0xff
+/*! tx channel: the radio on the USART1 */
+#define TX_CH_RADIO _BV(DUTY_RADIO)
+/*! tx channel: the radio on the software UART, see suart.c */
+#define TX_CH_SUART _BV(DUTY_SUART)
+/*! the addresses from this one up are on the TX_CH_SUART */
+#define TX_SUART_FROM 0x8000
+/*! ack mode: ms to wait for the ack of a frame. */
+#define TX_ACK_MS 300
+/*! ack mode: max times a frame is sent. */
+#define TX_TRIES 3
+/*! ms a pin command waits in the queue, a newer command for the
+ * same remote and pin replaces it, see tx_frame(). */
+#ifndef TX_HOLD_MS
+#define TX_HOLD_MS 150
+#endif
+/*! ms the transmitter stays keyed after a frame, the next frame
+ * in this time goes out at once after the RADIO_SYNC, 0 never,
+ * see radio_hold(). Never with repeaters, see tx_close(). */
+#ifndef TX_HANG_MS
+#define TX_HANG_MS 50
+#endif
 
 #include "led.h"
 #include "uart.h"
 #include "debug.h"
 #include "htv.h"
+#include "store.h"
+#include "cmd.h"
+#include "tick.h"
+#include "radio.h"
+#include "scene.h"
+#include "sched.h"
+#include "duty.h"
+#include "sync.h"
+#include "auth.h"
+#include "suart.h"
+#include "bench.h"
+#include "xio.h"
+
+/*! \struct txq_t
+ * A transmission waiting for airtime, a frame or a scene.
+ */
+struct txq_t {
+	/*! the frame with envelope and crc */
+	char frame[MAX_CMD_LENGHT];
+	/*! the scene to send or TXQ_FRAME */
+	uint8_t scene;
+	/*! scene, the next entry to send */
+	uint8_t idx;
+	/*! the frame address */
+	uint16_t address;
+	/*! the channels of the frame, TX_CH_* */
+	uint8_t ch;
+	/*! the pin of a pin command */
+	uint8_t pin;
+	/*! the command of a pin command, IO_CMD_* */
+	uint8_t cmd;
+	/*! a pin command, a newer one for address and pin replaces it */
+	uint8_t lww;
+	/*! tick_ms() when the first command for the pin was queued */
+	uint16_t queued;
+	/*! ack mode: the frame sequence number */
+	uint8_t seq;
+	/*! ack mode: times sent */
+	uint8_t tries;
+	/*! ack mode: tick_ms() of the last try */
+	uint16_t sent;
+	/*! the receiver must ack the frame */
+	uint8_t ack;
+};
 
+uint8_t p_cmd(char *line, struct htv_t *htv, struct debug_t *debug);
+uint8_t sa_cmd(char *line, struct htv_t *htv, struct debug_t *debug);
+uint8_t x_cmd(char *line, struct htv_t *htv, struct debug_t *debug);
+uint8_t t_cmd(char *line, struct htv_t *htv, struct debug_t *debug);
+uint8_t tx_run(struct htv_t *htv, struct debug_t *debug);
 void master(struct debug_t *debug);
 
 #endif
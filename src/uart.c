@@ -16,46 +16,20 @@
  */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "uart.h"
 
 /*! \file uart.c
-  \brief low level interface to the serial port */
+  \brief low level interface to the serial port
 
-/*! \brief enable/disable the trasmit part of a serial port.
-  \param port Serial port number (0 or 1)
-  \param enable 0 = disable, 1 = enable
- */
-void uart_tx(const uint8_t port, const uint8_t enable)
-{
-	if (port)
-		if (enable)
-			UCSR1B |= _BV(TXEN1);
-		else
-			UCSR1B &= ~_BV(TXEN1);
-	else
-		if (enable)
-			UCSR0B |= _BV(TXEN0);
-		else
-			UCSR0B &= ~_BV(TXEN0);
-}
+  Only the setup and the IRQ are here, the per char functions
+  are inline in uart.h.
+  */
 
-/*! \brief enable/disable the receive part of a serial port.
-  \param port Serial port number (0 or 1)
-  \param enable 0 = disable, 1 = enable
- */
-void uart_rx(const uint8_t port, const uint8_t enable)
-{
-	if (port)
-		if (enable)
-			UCSR1B |= _BV(RXEN1);
-		else
-			UCSR1B &= ~_BV(RXEN1);
-	else
-		if (enable)
-			UCSR0B |= _BV(RXEN0);
-		else
-			UCSR0B &= ~_BV(RXEN0);
-}
+/*! the IRQ buffers of the ports */
+struct uartStruct uart_buf[2];
+/*! tx buffer area of the port 0 */
+static char uart0_tx_buffer[UART_TXBUF_SIZE];
 
 /*! \brief initialize the serial port and speed.
  * \param port the port to initialize.
@@ -63,28 +37,24 @@ void uart_rx(const uint8_t port, const uint8_t enable)
  */
 void uart_init(const uint8_t port)
 {
-	if (port) {
-		/* improve baud rate error by using 2x clk */
-#if F_CPU < 2000000UL && defined(U2X1)
-		UCSR1A = _BV(U2X1);
-		UBRR1L = (F_CPU / (8UL * UART_BAUD_1)) - 1;
-#else
-		UBRR1L = (F_CPU / (16UL * UART_BAUD_1)) - 1;
-#endif
+	uart_buf[port].rxIdx = 0;
+	uart_buf[port].rxEnd = 0;
 
-		/* 8n2 */
-		UCSR1C = _BV(USBS1) | _BV(UCSZ10) | _BV(UCSZ11);
-	} else {
-		/* improve baud rate error by using 2x clk */
-#if F_CPU < 2000000UL && defined(U2X0)
-		UCSR0A = _BV(U2X0);
-		UBRR0L = (F_CPU / (8UL * UART_BAUD_0)) - 1;
+	/* improve baud rate error by using 2x clk */
+#if F_CPU < 2000000UL
+	UART_UCSRA(port) = _BV(UART_U2X);
+	UART_UBRRL(port) = (F_CPU / (8UL * (port ? UART_BAUD_1 : UART_BAUD_0))) - 1;
 #else
-		UBRR0L = (F_CPU / (16UL * UART_BAUD_0)) - 1;
+	UART_UBRRL(port) = (F_CPU / (16UL * (port ? UART_BAUD_1 : UART_BAUD_0))) - 1;
 #endif
 
-		/* 8n2 */
-		UCSR0C = _BV(USBS0) | _BV(UCSZ00) | _BV(UCSZ01);
+	/* 8n2 */
+	UART_UCSRC(port) = _BV(UART_USBS) | _BV(UART_UCSZ0) | _BV(UART_UCSZ1);
+
+	if (!port) {
+		uart_buf[0].tx_buffer = uart0_tx_buffer;
+		uart_buf[0].txIdx = 0;
+		uart_buf[0].txEnd = 0;
 	}
 }
 
@@ -93,72 +63,10 @@ void uart_init(const uint8_t port)
  */
 void uart_shutdown(const uint8_t port)
 {
-	if (port) {
-		UCSR1C = 0;
-		UCSR1B = 0;
-		UBRR1L = 0;
-		UCSR1A = 0;
-	} else {
-		UCSR0C = 0;
-		UCSR0B = 0;
-		UBRR0L = 0;
-		UCSR0A = 0;
-	}
-}
-
-/*! \brief get a char from the serial port.
- * \param port the port.
- * \param locked 1 - wait forever until a char is received.
- * 0 - get a char if it is present or exit with 0.
- *
- * \return the char or 0.
- */
-char uart_getchar(const uint8_t port, const uint8_t locked)
-{
-	if (locked) {
-		if (port) {
-			loop_until_bit_is_set(UCSR1A, RXC1);
-			return(UDR1);
-		} else {
-			loop_until_bit_is_set(UCSR0A, RXC0);
-			return(UDR0);
-		}
-	} else {
-		if (port) {
-			if (bit_is_set(UCSR1A, RXC1))
-				return(UDR1);
-			else
-				return(0);
-		} else {
-			if (bit_is_set(UCSR0A, RXC0))
-				return(UDR0);
-			else
-				return(0);
-		}
-	}
-}
-
-/*! \brief send a single char down to the serial port.
-
-  Send character c down the UART Tx, wait until tx holding register
-  is empty.
-  \param port serial port 0 or 1.
-  \param c char to send.
- */
-void uart_putchar(const uint8_t port, const char c)
-{
-	/*
-	   if (c == '\n')
-	   uart_putchar(port, '\r');
-	   */
-
-	if (port) {
-		loop_until_bit_is_set(UCSR1A, UDRE1);
-		UDR1 = c;
-	} else {
-		loop_until_bit_is_set(UCSR0A, UDRE0);
-		UDR0 = c;
-	}
+	UART_UCSRC(port) = 0;
+	UART_UCSRB(port) = 0;
+	UART_UBRRL(port) = 0;
+	UART_UCSRA(port) = 0;
 }
 
 /*! Send a C (NUL-terminated) string to the UART Tx.
@@ -169,12 +77,34 @@ void uart_putchar(const uint8_t port, const char c)
  */
 void uart_printstr(const uint8_t port, const char *s)
 {
-	while (*s)
-		uart_putchar(port, *s++);
+	/* a copy of the loop for each port, no test per char */
+	if (port)
+		while (*s)
+			uart_putchar(1, *s++);
+	else
+		while (*s)
+			uart_putchar(0, *s++);
+}
+
+/*! \brief IRQ rx of the console */
+ISR(USART0_RX_vect)
+{
+	uart_rx_put(0, UART_UDR(0));
 }
 
-/*! \brief flush the port */
-void uart_flush(const uint8_t port)
+/*! \brief IRQ rx of the radio */
+ISR(USART1_RX_vect)
 {
-	while (uart_getchar(port, 0));
+	uart_rx_put(1, UART_UDR(1));
+}
+
+/*! \brief IRQ tx of the console, send the next char */
+ISR(USART0_UDRE_vect)
+{
+	if (uart_buf[0].txIdx == uart_buf[0].txEnd) {
+		UART_UCSRB(0) &= ~_BV(UART_UDRIE);
+	} else {
+		UART_UDR(0) = uart_buf[0].tx_buffer[uart_buf[0].txEnd];
+		uart_buf[0].txEnd = (uart_buf[0].txEnd + 1) & UART_TXBUF_MASK;
+	}
 }
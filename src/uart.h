@@ -18,6 +18,10 @@
 #ifndef _UART_H_
 #define _UART_H_
 
+#include <stdint.h>
+
+#include "board.h"
+
 /* UART baud rate */
 #define UART_BAUD_0 9600
 #define UART_BAUD_1 1200
@@ -32,29 +36,188 @@
 #error TX buffer size is not a power of 2
 #endif
 
-/*! used as buffer area for IRQ rx/tx */
+/*! used as buffer area for IRQ rx/tx.
+ *
+ * Both ports receive under IRQ, the console (port 0) also
+ * transmit under IRQ. The radio (port 1) transmit is polled
+ * because the timing of the carrier depends on it.
+ */
 struct uartStruct {
 	/*! rx buffer area */
-        char *rx_buffer;
-	/*! tx buffer area */
-        char *tx_buffer;
-	/*! an IRQ rx string is received. */
-        volatile uint8_t rx_flag;
-	/*! the IRQ tx has been completed. */
-        volatile uint8_t tx_flag;
-	/*! rx index */
+        char rx_buffer[UART_RXBUF_SIZE];
+	/*! rx index, where the IRQ put the next char */
         volatile uint8_t rxIdx;
-	/*! tx index */
+	/*! rx index, where the next char is taken */
+        volatile uint8_t rxEnd;
+	/*! tx buffer area, port 0 only */
+        char *tx_buffer;
+	/*! tx index, where the next char is put */
         volatile uint8_t txIdx;
+	/*! tx index, where the IRQ takes the next char */
+        volatile uint8_t txEnd;
 };
 
-void uart_tx(const uint8_t port, const uint8_t enable);
-void uart_rx(const uint8_t port, const uint8_t enable);
 void uart_init(const uint8_t port);
 void uart_shutdown(const uint8_t port);
+void uart_printstr(const uint8_t port, const char *s);
+
+#ifdef UART_STUB
+/* the host simulator has its own, see sim/stub.c */
+void uart_tx(const uint8_t port, const uint8_t enable);
+void uart_rx(const uint8_t port, const uint8_t enable);
 char uart_getchar(const uint8_t port, const uint8_t locked);
 void uart_putchar(const uint8_t port, const char c);
-void uart_printstr(const uint8_t port, const char *s);
 void uart_flush(const uint8_t port);
+void uart_rx_put(const uint8_t port, const char c);
+uint8_t uart_tx_free(const uint8_t port);
+uint8_t uart_rx_head(const uint8_t port);
+char uart_rx_peek(const uint8_t port, const uint8_t i);
+uint8_t uart_rx_full(const uint8_t port);
+#else
+/*
+ * The per char functions are inline, the port and the other
+ * arguments are almost always constant and the compiler keeps
+ * only the code of the port, see board.h.
+ */
+
+/*! the IRQ buffers of the ports, see uart.c */
+extern struct uartStruct uart_buf[2];
+
+/*! \brief enable/disable the trasmit part of a serial port.
+  \param port Serial port number (0 or 1)
+  \param enable 0 = disable, 1 = enable
+ */
+static inline void uart_tx(const uint8_t port, const uint8_t enable)
+{
+	if (enable) {
+		UART_UCSRB(port) |= _BV(UART_TXEN);
+	} else {
+		/* let the IRQ empty the buffer */
+		if (!port)
+			loop_until_bit_is_clear(UART_UCSRB(0), UART_UDRIE);
+
+		UART_UCSRB(port) &= ~_BV(UART_TXEN);
+	}
+}
+
+/*! \brief enable/disable the receive part of a serial port.
+  \param port Serial port number (0 or 1)
+  \param enable 0 = disable, 1 = enable
+ */
+static inline void uart_rx(const uint8_t port, const uint8_t enable)
+{
+	if (enable)
+		UART_UCSRB(port) |= _BV(UART_RXEN) | _BV(UART_RXCIE);
+	else
+		UART_UCSRB(port) &= ~(_BV(UART_RXEN) | _BV(UART_RXCIE));
+}
+
+/*! \brief get a char from the serial port.
+ * \param port the port.
+ * \param locked 1 - wait forever until a char is received.
+ * 0 - get a char if it is present or exit with 0.
+ *
+ * \return the char or 0.
+ */
+static inline char uart_getchar(const uint8_t port, const uint8_t locked)
+{
+	struct uartStruct *p;
+	char c;
+
+	p = &uart_buf[port];
+
+	if (locked)
+		while (p->rxIdx == p->rxEnd);
+	else if (p->rxIdx == p->rxEnd)
+		return(0);
+
+	c = p->rx_buffer[p->rxEnd];
+	p->rxEnd = (p->rxEnd + 1) & UART_RXBUF_MASK;
+	return(c);
+}
+
+/*! \brief send a single char down to the serial port.
+
+  The radio port waits until the tx holding register is empty,
+  the console waits for room in the buffer.
+  \param port serial port 0 or 1.
+  \param c char to send.
+ */
+static inline void uart_putchar(const uint8_t port, const char c)
+{
+	uint8_t i;
+
+	if (port) {
+		loop_until_bit_is_set(UART_UCSRA(1), UART_UDRE);
+		UART_UDR(1) = c;
+	} else {
+		i = (uart_buf[0].txIdx + 1) & UART_TXBUF_MASK;
+
+		/* wait for room in the buffer */
+		while (i == uart_buf[0].txEnd);
+
+		uart_buf[0].tx_buffer[uart_buf[0].txIdx] = c;
+		uart_buf[0].txIdx = i;
+		UART_UCSRB(0) |= _BV(UART_UDRIE);
+	}
+}
+
+/*! \brief flush the port */
+static inline void uart_flush(const uint8_t port)
+{
+	uart_buf[port].rxEnd = uart_buf[port].rxIdx;
+}
+
+/*! \brief number of char which can be sent without waiting.
+ * \note the radio port is not buffered, always 0.
+ */
+static inline uint8_t uart_tx_free(const uint8_t port)
+{
+	if (port)
+		return(0);
+	else
+		return((uart_buf[0].txEnd - uart_buf[0].txIdx - 1) &
+				UART_TXBUF_MASK);
+}
+
+/*! \brief store the received char, if the buffer is full
+ * the char is lost.
+ * \note call it with the IRQ disabled, ex. from icp.c.
+ */
+static inline void uart_rx_put(const uint8_t port, const char c)
+{
+	struct uartStruct *p;
+	uint8_t i;
+
+	p = &uart_buf[port];
+	i = (p->rxIdx + 1) & UART_RXBUF_MASK;
+
+	if (i != p->rxEnd) {
+		p->rx_buffer[p->rxIdx] = c;
+		p->rxIdx = i;
+	}
+}
+
+/*! \brief where the next char received goes, to look at the
+ * chars without taking them, see uart_rx_peek().
+ */
+static inline uint8_t uart_rx_head(const uint8_t port)
+{
+	return(uart_buf[port].rxIdx);
+}
+
+/*! \brief the char received at the index i, see uart_rx_head(). */
+static inline char uart_rx_peek(const uint8_t port, const uint8_t i)
+{
+	return(uart_buf[port].rx_buffer[i & UART_RXBUF_MASK]);
+}
+
+/*! \brief true if the rx buffer is full, the next chars are lost. */
+static inline uint8_t uart_rx_full(const uint8_t port)
+{
+	return(((uart_buf[port].rxIdx + 1) & UART_RXBUF_MASK) ==
+			uart_buf[port].rxEnd);
+}
+#endif
 
 #endif
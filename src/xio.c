@@ -0,0 +1,130 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file xio.c
+ * \brief Outputs on a chain of 74HC595 on the SPI.
+ *
+ * With HTV_USE_XIO the outputs of the receiver are the XIO_PINS
+ * outputs of a chain of XIO_CHIPS 74HC595 instead of IO_PIN0 and
+ * IO_PIN1, the output n is the pin Qn%8 of the chip n/8, the chip
+ * 0 is the one wired to the MOSI. The pins are in board.h.
+ *
+ * xio_put() changes only a copy in the RAM, xio_flush() shifts the
+ * whole chain in the SPI IRQ, a byte at a time, and latches it
+ * at the end: all the outputs changed by a frame go out together,
+ * in a single transfer, and the receiver does not wait for it. A
+ * flush while shifting shifts the chain again at the end.
+ *
+ * /OE keeps the outputs off until the first latch, the 74HC595
+ * has random outputs at power on.
+ *
+ * The SPI is the one of the packet radio, HTV_USE_RFM can not be
+ * used with it.
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "board.h"
+#include "xio.h"
+
+/*! the outputs, a byte every chip */
+static uint8_t out[XIO_CHIPS];
+/*! the chip whose byte is shifting, XIO_IDLE none */
+static volatile uint8_t chip = XIO_IDLE;
+/*! the outputs changed while shifting */
+static volatile uint8_t dirty;
+
+/*! \brief set up the SPI, the outputs stay off. */
+void xio_init(void)
+{
+	XIO_PORT |= _BV(XIO_OE);
+	XIO_PORT &= ~_BV(XIO_RCLK);
+	XIO_DDR |= _BV(XIO_OE) | _BV(XIO_RCLK) | _BV(XIO_MOSI) |
+		_BV(XIO_SCK);
+	/* master, mode 0, msb first, F_CPU / 2 */
+	SPCR = _BV(SPE) | _BV(MSTR);
+	SPSR = _BV(SPI2X);
+}
+
+/*! \brief the state of an output, 1 on. */
+uint8_t xio_get(const uint8_t pin)
+{
+	return((out[pin >> 3] & _BV(pin & 7)) ? 1 : 0);
+}
+
+/*! \brief change an output, see xio_flush(). */
+void xio_put(const uint8_t pin, const uint8_t on)
+{
+	if (on)
+		out[pin >> 3] |= _BV(pin & 7);
+	else
+		out[pin >> 3] &= ~_BV(pin & 7);
+}
+
+/*! \brief start to shift the chain, the last chip first.
+ * \note with the IRQ off.
+ */
+static void xio_start(void)
+{
+	dirty = 0;
+	chip = XIO_CHIPS - 1;
+	SPCR |= _BV(SPIE);
+	SPDR = out[chip];
+}
+
+/*! \brief send the outputs to the chain, in background. */
+void xio_flush(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (chip == XIO_IDLE)
+			xio_start();
+		else
+			dirty = 1;
+	}
+}
+
+/*! \brief true while the chain is shifting. */
+uint8_t xio_busy(void)
+{
+	return(chip != XIO_IDLE);
+}
+
+#ifdef HTV_USE_XIO
+/*! \brief a byte is in the chain, shift the next or latch. */
+ISR(SPI_STC_vect)
+{
+	if (chip) {
+		SPDR = out[--chip];
+		return;
+	}
+
+	/* the rising edge of RCLK moves the chain to the outputs */
+	XIO_PORT |= _BV(XIO_RCLK);
+	XIO_PORT &= ~_BV(XIO_RCLK);
+	XIO_PORT &= ~_BV(XIO_OE);
+
+	if (dirty) {
+		xio_start();
+	} else {
+		SPCR &= ~_BV(SPIE);
+		chip = XIO_IDLE;
+	}
+}
+#endif
@@ -0,0 +1,48 @@
+/* This file is part of OneWay
+ * Copyright (C) 2011 Enrico Rossi
+ *
+ * OneWay is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OneWay is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file xio.h
+  \brief Outputs on a chain of 74HC595 on the SPI.
+  */
+
+#ifndef XIO_H
+#define XIO_H
+
+#include <stdint.h>
+
+#include "htv.h"
+
+#if defined(HTV_USE_XIO) && defined(HTV_USE_RFM)
+#error HTV_USE_XIO needs the SPI of the packet radio
+#endif
+
+/*! number of 74HC595 in the chain */
+#ifndef XIO_CHIPS
+#define XIO_CHIPS 8
+#endif
+/*! number of outputs, 8 every chip */
+#define XIO_PINS (XIO_CHIPS * 8)
+/*! the IRQ is not shifting the chain */
+#define XIO_IDLE 0xff
+
+void xio_init(void);
+uint8_t xio_get(const uint8_t pin);
+void xio_put(const uint8_t pin, const uint8_t on);
+void xio_flush(void);
+uint8_t xio_busy(void);
+
+#endif